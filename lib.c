@@ -1,25 +1,36 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <time.h>
 #include <signal.h>
+#include <limits.h>
+
+#ifdef __linux__
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/epoll.h>
+    #include <sys/resource.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+#endif
+
+#include "library_core.h"
 
-#define MAX_STR 100
-#define FILENAME "library.dat"
-#define USERFILE "users.dat"
-#define LOGFILE "library.log"
-#define MAX_BORROWER_NAME 50
-#define MAX_USERS 100
-#define MAX_USERNAME 30
-#define MAX_PASSWORD 30
-#define FINE_PER_DAY 5.0
 #define MAX_ATTEMPTS 3
+#define DUE_SOON_COUNT 10
+#define SERVER_SOCKET "library.sock"
+
 
 // Cross-platform clear screen and password input
 #ifdef _WIN32
     #define CLEAR_SCREEN "cls"
     #include <conio.h>
+    #include <io.h>
 
     void getPasswordInput(char* password, int max_len) {
         int i = 0;
@@ -47,7 +58,7 @@
     void getPasswordInput(char* password, int max_len) {
         struct termios old, new;
         int i = 0;
-        char ch;
+        int ch;
 
         // Disable echo
         tcgetattr(STDIN_FILENO, &old);
@@ -57,13 +68,13 @@
 
         while (i < max_len - 1) {
             ch = getchar();
-            if (ch == '\n' || ch == '\r') {
+            if (ch == '\n' || ch == '\r' || ch == EOF) {
                 break;
             } else if ((ch == 127 || ch == '\b') && i > 0) {
                 printf("\b \b");
                 i--;
             } else if (ch != 127 && ch != '\b') {
-                password[i++] = ch;
+                password[i++] = (char)ch;
                 printf("*");
             }
         }
@@ -75,51 +86,15 @@
     }
 #endif
 
-// Book structure
-typedef struct Book {
-    int id;
-    char title[MAX_STR];
-    char author[MAX_STR];
-    char isbn[20];
-    int year;
-    int is_issued;
-    char issued_to[MAX_BORROWER_NAME];
-    time_t issue_date;
-    time_t due_date;
-    struct Book* next;
-} Book;
-
-// User structure
-typedef struct User {
-    char username[MAX_USERNAME];
-    unsigned long password_hash;
-    int is_admin;
-    char full_name[MAX_STR];
-} User;
+// Front end state: the open catalog and the signed-in account
+LibCatalog* catalog = NULL;
+LibUser session;
+LibUser* current_user = NULL;
+FILE* batch_out = NULL;
 
-// Statistics structure
-typedef struct {
-    int total_books;
-    int issued_books;
-    int available_books;
-    double total_fines;
-} LibraryStats;
-
-// Log levels
-typedef enum {
-    LOG_INFO,
-    LOG_WARNING,
-    LOG_ERROR
-} LogLevel;
-
-// Global variables
-Book* head = NULL;
-User users[MAX_USERS];
-int book_count = 0;
-int user_count = 0;
-int next_id = 1;
-User* current_user = NULL;
-volatile sig_atomic_t save_needed = 0;
+// Set by SIGINT and SIGTERM. The handler does nothing else: saving takes
+// locks and allocates, so it happens at the next read from the terminal.
+volatile sig_atomic_t interrupted = 0;
 
 // Function prototypes
 void displayMainMenu();
@@ -135,53 +110,161 @@ void displayBooks();
 void searchBooks();
 void viewBookDetails();
 void libraryStatistics();
-void saveToFile();
-void loadFromFile();
+int runBatch();
+int serverListen(const char* path);
+int runServer(int listener, const char* path);
+int runClient(const char* path);
+void saveCatalog();
 void exportToText();
-void saveUsersToFile();
-void loadUsersFromFile();
-Book* createBook(int id, char* title, char* author, char* isbn, int year);
-void insertBook(Book* newBook);
-Book* searchBook(int id);
-Book* searchBookByTitle(char* title);
-Book* searchBookByISBN(char* isbn);
-void freeList();
+void importBooks();
 void clearInputBuffer();
 int getIntegerInput(const char* prompt);
 int getIntegerInputSafe(const char* prompt, int min, int max);
-void safe_strcpy(char* dest, const char* src, size_t dest_size);
-void printBookDetails(Book* book);
-int validateISBN(char* isbn);
-int validateISBN13(const char* isbn);
+void printBookDetails(const LibBook* book);
 void sortBooksByTitle();
 void sortBooksByAuthor();
-Book* mergeSort(Book* head, int (*compare)(Book*, Book*));
-int compareByTitle(Book* a, Book* b);
-int compareByAuthor(Book* a, Book* b);
-void initializeDefaultAdmin();
-unsigned long hash_password(const char* password);
-void log_message(LogLevel level, const char* message);
-double calculateFine(Book* book);
+void listBooksInOrder(const char* order, const char* heading);
+void dueDateReport();
+void viewPatronLoans();
 void backupDatabase();
 void signal_handler(int signum);
 void cleanup_and_exit();
-char* strcasestr_custom(const char* haystack, const char* needle);
+void checkInterrupt();
+char* readInput(char* buffer, int size);
 void clearScreen();
 void pauseScreen();
 
-int main() {
-    // Setup signal handlers
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "--bench-search") == 0) {
+        benchmarkSearch(stdout, argc >= 3 ? atoi(argv[2]) : 200000);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "--bench-sort") == 0) {
+        benchmarkSort(stdout, argc >= 3 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "--bench-concurrent") == 0) {
+        benchmarkConcurrent(stdout, argc >= 3 ? atoi(argv[2]) : 100000);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "--bench-writes") == 0) {
+        benchmarkWrites(stdout, argc >= 3 ? atoi(argv[2]) : 100000);
+        return 0;
+    }
+
+    // Logging options: --log-level info|warning|error, --log-flush-ms N,
+    // --log-no-sync (do not fsync ERROR lines before returning).
+    // --batch reads commands from stdin instead of showing the menus.
+    // --serve answers the same commands on a Unix domain socket and
+    // --client talks to that server; --socket PATH picks the socket.
+    // --shards N splits the catalog into N shards (0 = one per CPU).
+    int batch = 0;
+    int serve = 0;
+    int client = 0;
+    const char* socket_path = SERVER_SOCKET;
+    LogLevel log_level = LOG_INFO;
+    int log_flush_ms = LOG_FLUSH_MS;
+    int log_sync = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "--serve") == 0) {
+            serve = 1;
+        } else if (strcmp(argv[i], "--client") == 0) {
+            client = 1;
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            i++;
+            for (int level = LOG_INFO; level <= LOG_ERROR; level++) {
+                if (strcasecmp(argv[i], log_level_names[level]) == 0) {
+                    log_level = (LogLevel)level;
+                }
+            }
+        } else if (strcmp(argv[i], "--log-flush-ms") == 0 && i + 1 < argc) {
+            log_flush_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--log-no-sync") == 0) {
+            log_sync = 0;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            libConfigureShards(atoi(argv[++i]));
+        }
+    }
+    if (client) {
+        return runClient(socket_path);
+    }
+    int listener = -1;
+    if (serve && (listener = serverListen(socket_path)) < 0) {
+        return 1;
+    }
+    logConfigure(log_level, log_flush_ms, log_sync);
+    logOpen();
+
+    // Batch responses get the real stdout; everything the shared code
+    // prints for humans goes to stderr so it cannot corrupt the protocol
+    if (batch) {
+        batch_out = fdopen(dup(STDOUT_FILENO), "w");
+        if (batch_out == NULL) {
+            perror("batch");
+            return 1;
+        }
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    // Setup signal handlers. Without SA_RESTART a read waiting on the
+    // terminal returns at once, so the interrupt is acted on right away.
+#ifdef _WIN32
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+#else
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = signal_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+#endif
 
-    // Initialize default admin account
-    initializeDefaultAdmin();
+    // Load users (the default admin when there are none), the library
+    // data and the changes journaled since that snapshot
+    LibOpenReport report;
+    catalog = libOpen(NULL, &report);
+    if (catalog == NULL) {
+        printf("Error: Not enough memory to open the library!\n");
+        logClose();
+        return 1;
+    }
 
-    // Load users from file (this will override default if file exists)
-    loadUsersFromFile();
+    if (!report.user_file) {
+        printf("No existing user file found. Using default admin account.\n");
+    } else if (report.users == 0) {
+        printf("No users found in file. Using default admin account.\n");
+    } else {
+        printf("Loaded %d users from file.\n", report.users);
+    }
+    if (report.data == LIB_ERR_NOT_FOUND) {
+        printf("No existing data file found. Starting with empty library.\n");
+    } else if (report.data == LIB_ERR_CORRUPT) {
+        printf("Error: Data file is corrupt or unreadable!\n");
+    } else {
+        printf("Loaded %d books from file.\n", report.books);
+    }
+    if (report.journal_records >= 0) {
+        printf("Replayed %d journal records.\n", report.journal_records);
+    }
 
-    // Load library data
-    loadFromFile();
+    if (serve) {
+        if (runServer(listener, socket_path) != 0) {
+            libClose(catalog);
+            logClose();
+            return 1;
+        }
+        cleanup_and_exit();
+    }
+    if (batch) {
+        log_message(LOG_INFO, "Batch session started");
+        runBatch();
+        cleanup_and_exit();
+    }
 
     int choice;
 
@@ -203,8 +286,8 @@ int main() {
     printf("    ----------------------------------------------------------------\n");
     printf("\n");
     printf("    ==================== SYSTEM STATUS ====================\n");
-    printf("        Books in Library      : %d\n", book_count);
-    printf("        Registered Users      : %d\n", user_count);
+    printf("        Books in Library      : %d\n", libBookCount(catalog));
+    printf("        Registered Users      : %d\n", libUserCount(catalog));
     printf("        Security Level        : High (Encrypted)\n");
     printf("    =======================================================\n");
     printf("\n");
@@ -256,8 +339,807 @@ int main() {
     return 0;
 }
 
+// Batch mode: one command per line on stdin, fields separated by tabs.
+//
+//   login <user> <password>           add <title> <author> <isbn> <year>
+//   remove <id>                       issue <id> <borrower> <days>
+//   return <id>                       get <id>
+//   search <query>                    list [all|available|issued|overdue] [order]
+//   overdue                           due <n>
+//   loans <borrower>                  stats
+//   save                              import <path>
+//   quit
+//
+// The list order is title, author, or a comma-separated key list over
+// title, author, year and id (e.g. author,year,title). overdue lists every
+// overdue loan, most overdue first; due lists the next n loans to fall due.
+// loans answers a "fine <amount>" line, then one line per book the
+// borrower holds.
+//
+// Every command answers "OK <n>" followed by n tab-separated result
+// lines, or a single "ERR <code> <message>" line; a line longer than
+// BATCH_LINE_MAX - 1 characters runs nothing and answers
+// "ERR 400 line too long". Output is flushed only
+// when no more input is waiting, so piped scripts are not limited by
+// one write per command.
+#define BATCH_LINE_MAX 1024
+#define BATCH_MAX_FIELDS 8
+
+typedef struct {
+    char data[65536];
+    size_t start;
+    size_t end;
+    int eof;
+    int skipping;           // inside a line that overflowed `data`
+} BatchInput;
+
+// Next input line without its newline, or NULL at end of input. A line
+// longer than BATCH_LINE_MAX - 1 characters is discarded up to its
+// newline and comes back empty with *too_long set.
+static char* batchReadLine(BatchInput* in, char* line, int* too_long) {
+    *too_long = 0;
+    line[0] = '\0';
+    for (;;) {
+        char* begin = in->data + in->start;
+        size_t avail = in->end - in->start;
+        char* nl = (char*)memchr(begin, '\n', avail);
+
+        if (nl != NULL || (in->eof && (avail > 0 || in->skipping))) {
+            size_t length = nl ? (size_t)(nl - begin) : avail;
+            in->start += nl ? length + 1 : length;
+            if (length > 0 && begin[length - 1] == '\r') length--;
+            if (in->skipping || length > BATCH_LINE_MAX - 1) {
+                in->skipping = 0;
+                *too_long = 1;
+                return line;
+            }
+            memcpy(line, begin, length);
+            line[length] = '\0';
+            return line;
+        }
+        if (in->eof) return NULL;
+
+        // No complete line buffered: compact and read more. A line that
+        // fills the whole buffer is dropped as it arrives.
+        if (avail == sizeof(in->data)) {
+            avail = 0;
+            in->skipping = 1;
+        }
+        memmove(in->data, begin, avail);
+        in->start = 0;
+        in->end = avail;
+
+        // About to block: let the client see every answer so far
+        fflush(batch_out);
+        long got = (long)read(STDIN_FILENO, in->data + in->end, sizeof(in->data) - in->end);
+        if (got <= 0) {
+            in->eof = 1;
+        } else {
+            in->end += (size_t)got;
+        }
+    }
+}
+
+static void batchBookLine(const LibBook* book) {
+    fprintf(batch_out, "%d\t%s\t%s\t%s\t%d\t%s\t%s\t%ld\n",
+            book->id, book->title, book->author, book->isbn, book->year,
+            book->is_issued ? "issued" : "available", book->issued_to,
+            (long)book->due_date);
+}
+
+static void batchError(int code, const char* message) {
+    fprintf(batch_out, "ERR %d %s\n", code, message);
+}
+
+static void batchStatus(LibStatus status) {
+    int code = 500;
+    switch (status) {
+        case LIB_ERR_INVALID: code = 400; break;
+        case LIB_ERR_NOT_FOUND: code = 404; break;
+        case LIB_ERR_AUTH: code = 401; break;
+        case LIB_ERR_DUPLICATE_TITLE:
+        case LIB_ERR_DUPLICATE_ISBN:
+        case LIB_ERR_DUPLICATE_USER:
+        case LIB_ERR_ISSUED:
+        case LIB_ERR_NOT_ISSUED: code = 409; break;
+        case LIB_ERR_BUSY: code = 503; break;
+        default: break;
+    }
+    batchError(code, libStatusMessage(status));
+}
+
+// "OK <n>" and one line per result. Takes the caller's result pointer by
+// address so it is read only after the query that fills it has run.
+static void batchResults(LibStatus status, LibResults** result_set) {
+    LibResults* results = *result_set;
+
+    if (status != LIB_OK) {
+        batchStatus(status);
+        return;
+    }
+
+    size_t count = libResultsCount(results);
+    fprintf(batch_out, "OK %zu\n", count);
+    for (size_t i = 0; i < count; i++) {
+        LibBook book;
+        libResultsGet(results, i, &book);
+        batchBookLine(&book);
+    }
+    libResultsFree(results);
+}
+
+static int batchParseInt(const char* text, int* value) {
+    char* end;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < INT_MIN || parsed > INT_MAX) {
+        return 0;
+    }
+    *value = (int)parsed;
+    return 1;
+}
+
+static void batchCommand(char** field, int count) {
+    const char* cmd = field[0];
+    LibResults* results;
+    LibBook book;
+    int id;
+
+    if (strcmp(cmd, "login") == 0) {
+        if (count != 3) { batchError(400, "usage: login <user> <password>"); return; }
+        current_user = NULL;
+        if (libAuthenticate(catalog, field[1], field[2], &session) != LIB_OK) {
+            log_message(LOG_WARNING, "Failed login attempt");
+            batchError(401, "invalid username or password");
+            return;
+        }
+        current_user = &session;
+        log_message(LOG_INFO, current_user->is_admin ? "Admin logged in" : "User logged in");
+        fprintf(batch_out, "OK 1\n%s\n", current_user->is_admin ? "admin" : "user");
+        return;
+    }
+    if (strcmp(cmd, "quit") == 0) {
+        fprintf(batch_out, "OK 0\n");
+        return;
+    }
+    if (current_user == NULL) {
+        batchError(401, "login required");
+        return;
+    }
+
+    // Read-only commands
+    if (strcmp(cmd, "get") == 0) {
+        if (count != 2 || !batchParseInt(field[1], &id)) { batchError(400, "usage: get <id>"); return; }
+        if (libGetBook(catalog, id, &book) != LIB_OK) { batchStatus(LIB_ERR_NOT_FOUND); return; }
+        fprintf(batch_out, "OK 1\n");
+        batchBookLine(&book);
+        return;
+    }
+    if (strcmp(cmd, "search") == 0) {
+        if (count != 2 || field[1][0] == '\0') { batchError(400, "usage: search <query>"); return; }
+        batchResults(libSearch(catalog, field[1], &results), &results);
+        return;
+    }
+    if (strcmp(cmd, "list") == 0) {
+        const char* filter = count >= 2 ? field[1] : "all";
+        int mode = strcmp(filter, "all") == 0 ? FILTER_ALL :
+                   strcmp(filter, "available") == 0 ? FILTER_AVAILABLE :
+                   strcmp(filter, "issued") == 0 ? FILTER_ISSUED :
+                   strcmp(filter, "overdue") == 0 ? FILTER_OVERDUE : 0;
+        LibStatus status = mode == 0 ? LIB_ERR_INVALID :
+                           libList(catalog, (StatusFilter)mode, count >= 3 ? field[2] : NULL, &results);
+        if (status == LIB_ERR_INVALID) {
+            batchError(400, "usage: list [all|available|issued|overdue] [title|author|<key>,<key>...]");
+            return;
+        }
+        batchResults(status, &results);
+        return;
+    }
+    if (strcmp(cmd, "overdue") == 0 || strcmp(cmd, "due") == 0) {
+        // overdue: every overdue loan, most overdue first
+        // due <n>: the next n loans to fall due
+        int overdue = cmd[0] == 'o';
+        int limit = 0;
+        if ((overdue && count != 1) ||
+            (!overdue && (count != 2 || !batchParseInt(field[1], &limit) || limit < 0))) {
+            batchError(400, overdue ? "usage: overdue" : "usage: due <n>");
+            return;
+        }
+        batchResults(overdue ? libList(catalog, FILTER_OVERDUE, NULL, &results) :
+                               libDueSoon(catalog, (size_t)limit, &results), &results);
+        return;
+    }
+    if (strcmp(cmd, "loans") == 0) {
+        // A fine line, then one line per book the patron holds
+        if (count != 2 || field[1][0] == '\0') { batchError(400, "usage: loans <borrower>"); return; }
+        LibStatus status = libPatronLoans(catalog, field[1], &results);
+        if (status != LIB_OK) {
+            batchStatus(status);
+            return;
+        }
+        time_t now = time(NULL);
+        size_t loans = libResultsCount(results);
+        double fine = 0.0;
+        for (size_t i = 0; i < loans; i++) {
+            libResultsGet(results, i, &book);
+            fine += calculateFineAt(book.due_date, now);
+        }
+        fprintf(batch_out, "OK %zu\nfine\t%.2f\n", loans + 1, fine);
+        for (size_t i = 0; i < loans; i++) {
+            libResultsGet(results, i, &book);
+            batchBookLine(&book);
+        }
+        libResultsFree(results);
+        return;
+    }
+    if (strcmp(cmd, "stats") == 0) {
+        LibraryStats stats = libStatistics(catalog, time(NULL));
+        fprintf(batch_out, "OK 5\ntotal\t%d\navailable\t%d\nissued\t%d\noverdue\t%d\nfines\t%.2f\n",
+                stats.total_books, stats.available_books, stats.issued_books,
+                stats.overdue_books, stats.total_fines);
+        return;
+    }
+
+    // Everything else changes the catalog
+    if (!current_user->is_admin) {
+        batchError(403, "administrator required");
+        return;
+    }
+
+    LibStatus status;
+    if (strcmp(cmd, "add") == 0) {
+        int year;
+        if (count != 5 || !batchParseInt(field[4], &year)) {
+            batchError(400, "usage: add <title> <author> <isbn> <year>");
+            return;
+        }
+        char title[MAX_STR], author[MAX_STR], isbn[20];
+        safe_strcpy(title, field[1], MAX_STR);
+        safe_strcpy(author, field[2], MAX_STR);
+        safe_strcpy(isbn, field[3], 20);
+        status = libAddBook(catalog, title, author, isbn, year, &book);
+        if (status == LIB_OK) fprintf(batch_out, "OK 1\n%d\n", book.id);
+    } else if (strcmp(cmd, "remove") == 0) {
+        if (count != 2 || !batchParseInt(field[1], &id)) { batchError(400, "usage: remove <id>"); return; }
+        status = libRemoveBook(catalog, id);
+        if (status == LIB_OK) fprintf(batch_out, "OK 0\n");
+    } else if (strcmp(cmd, "issue") == 0) {
+        int days;
+        if (count != 4 || !batchParseInt(field[1], &id) || !batchParseInt(field[3], &days)) {
+            batchError(400, "usage: issue <id> <borrower> <days>");
+            return;
+        }
+        char borrower[MAX_BORROWER_NAME];
+        safe_strcpy(borrower, field[2], MAX_BORROWER_NAME);
+        status = libIssueBook(catalog, id, borrower, days, &book);
+        if (status == LIB_OK) fprintf(batch_out, "OK 1\n%ld\n", (long)book.due_date);
+    } else if (strcmp(cmd, "return") == 0) {
+        double fine;
+        if (count != 2 || !batchParseInt(field[1], &id)) { batchError(400, "usage: return <id>"); return; }
+        status = libReturnBook(catalog, id, &fine, &book);
+        if (status == LIB_OK) fprintf(batch_out, "OK 1\n%.2f\n", fine);
+    } else if (strcmp(cmd, "import") == 0) {
+        if (count != 2) { batchError(400, "usage: import <path>"); return; }
+        ImportReport* report = (ImportReport*)malloc(sizeof(ImportReport));
+        if (report == NULL) { batchStatus(LIB_ERR_NO_MEMORY); return; }
+        if (libImport(catalog, field[1], report) != LIB_OK) {
+            free(report);
+            batchError(404, "cannot read import file");
+            return;
+        }
+        // saved is 0 when the rows were added but could not be committed
+        fprintf(batch_out, "OK %d\nrows\t%d\nimported\t%d\nduplicates\t%d\ninvalid\t%d\nisbn_warnings\t%d\nsaved\t%d\n",
+                6 + report->error_count, report->rows, report->imported, report->duplicates,
+                report->invalid, report->isbn_warnings, report->saved);
+        for (int i = 0; i < report->error_count; i++) {
+            fprintf(batch_out, "row\t%d\t%s\n", report->errors[i].row, report->errors[i].reason);
+        }
+        if (!report->saved) log_message(LOG_ERROR, "Import could not be saved");
+        free(report);
+        return;
+    } else if (strcmp(cmd, "save") == 0) {
+        status = libSave(catalog);
+        if (status == LIB_OK) fprintf(batch_out, "OK 0\n");
+    } else {
+        batchError(400, "unknown command");
+        return;
+    }
+
+    if (status != LIB_OK) {
+        batchStatus(status);
+    }
+}
+
+
+// Split a command line into tab-separated fields in place. Blank lines
+// and comments have no fields.
+static int batchSplit(char* line, char** field) {
+    int count = 0;
+    char* p = line;
+
+    if (line[0] == '\0' || line[0] == '#') return 0;
+    while (count < BATCH_MAX_FIELDS) {
+        field[count++] = p;
+        p = strchr(p, '\t');
+        if (p == NULL) break;
+        *p++ = '\0';
+    }
+    return count;
+}
+
+// Run commands from stdin until "quit" or end of input
+int runBatch() {
+    static BatchInput in;
+    char line[BATCH_LINE_MAX];
+    int commands = 0;
+    int too_long;
+
+    while (batchReadLine(&in, line, &too_long) != NULL) {
+        char* field[BATCH_MAX_FIELDS];
+        if (too_long) {
+            batchError(400, "line too long");
+            continue;
+        }
+        int count = batchSplit(line, field);
+
+        if (count == 0) continue;
+        batchCommand(field, count);
+        commands++;
+        if (strcmp(field[0], "quit") == 0) break;
+    }
+
+    fflush(batch_out);
+    return commands;
+}
+
+// Daemon mode. --serve keeps one catalog resident and answers the batch
+// protocol on a Unix domain socket, so every desk works on the same books
+// instead of loading library.dat and overwriting it at logout. A single
+// epoll loop serves all connections; each connection has its own login
+// and may pipeline commands. --client pipes stdin and stdout through the
+// socket, so a batch script runs unchanged against a server.
+#define SERVER_MAX_EVENTS 256
+#define SERVER_INPUT_MAX (4 * BATCH_LINE_MAX)
+#define SERVER_OUTPUT_MAX (256 * 1024)  // stop reading from a client this far behind
+
+#ifdef __linux__
+
+typedef struct ServerClient {
+    int fd;
+    int logged_in;
+    int closing;            // quit or end of input seen: close once answered
+    int skipping;           // inside a line that overflowed `in`
+    unsigned events;        // epoll interest currently registered
+    LibUser user;
+    char in[SERVER_INPUT_MAX];
+    size_t in_len;
+    char* out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    struct ServerClient* prev;
+    struct ServerClient* next;
+} ServerClient;
+
+static volatile sig_atomic_t server_stop = 0;
+static char* server_reply = NULL;       // batch_out's buffer while serving
+static size_t server_reply_size = 0;
+static ServerClient* server_clients = NULL;
+static int server_client_count = 0;
+
+static void serverSignal(int signum) {
+    (void)signum;
+    server_stop = 1;
+}
+
+static int serverAddress(const char* path, struct sockaddr_un* addr) {
+    size_t length = strlen(path);
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (length == 0 || length >= sizeof(addr->sun_path)) {
+        return 0;
+    }
+    memcpy(addr->sun_path, path, length + 1);
+    return 1;
+}
+
+static int setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Append an answer to the client's pending output
+static int serverQueue(ServerClient* client, const char* data, size_t length) {
+    if (client->out_len + length > client->out_cap) {
+        size_t cap = client->out_cap ? client->out_cap : 4096;
+        while (cap < client->out_len + length) cap *= 2;
+        char* grown = (char*)realloc(client->out, cap);
+        if (grown == NULL) return 0;
+        client->out = grown;
+        client->out_cap = cap;
+    }
+    memcpy(client->out + client->out_len, data, length);
+    client->out_len += length;
+    return 1;
+}
+
+// Run one command line as this client: its login is the session while
+// the command runs, and the answer is captured from batch_out
+static int serverCommand(ServerClient* client, char* line) {
+    char* field[BATCH_MAX_FIELDS];
+    int count = batchSplit(line, field);
+
+    if (count == 0) return 1;
+
+    if (client->logged_in) {
+        session = client->user;
+        current_user = &session;
+    } else {
+        current_user = NULL;
+    }
+    rewind(batch_out);
+    batchCommand(field, count);
+    fflush(batch_out);
+
+    client->logged_in = current_user != NULL;
+    if (client->logged_in) client->user = session;
+    current_user = NULL;
+    if (strcmp(field[0], "quit") == 0) client->closing = 1;
+
+    return serverQueue(client, server_reply, server_reply_size);
+}
+
+// Answer the line ending at `end`; lines batch mode would not accept, or
+// whose start was dropped, get an error instead
+static int serverLine(ServerClient* client, size_t start, size_t end) {
+    char* line = client->in + start;
+    size_t length = end - start;
+
+    if (length > 0 && line[length - 1] == '\r') length--;
+    if (client->skipping || length > BATCH_LINE_MAX - 1) {
+        client->skipping = 0;
+        rewind(batch_out);
+        batchError(400, "line too long");
+        fflush(batch_out);
+        return serverQueue(client, server_reply, server_reply_size);
+    }
+    line[length] = '\0';
+    return serverCommand(client, line);
+}
+
+// Take one read's worth of input and answer every complete line. Returns
+// 0 when the connection is broken.
+static int serverRead(ServerClient* client) {
+    if (client->in_len == sizeof(client->in)) {
+        client->in_len = 0;         // absurdly long line, drop it as it arrives
+        client->skipping = 1;
+    }
+
+    long got = (long)recv(client->fd, client->in + client->in_len,
+                          sizeof(client->in) - client->in_len, 0);
+    if (got < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    size_t scanned = client->in_len;
+    size_t start = 0;
+    char* nl;
+
+    client->in_len += (size_t)got;
+    while (!client->closing &&
+           (nl = (char*)memchr(client->in + scanned, '\n', client->in_len - scanned)) != NULL) {
+        size_t end = (size_t)(nl - client->in);
+        if (!serverLine(client, start, end)) return 0;
+        start = scanned = end + 1;
+    }
+
+    if (got == 0) {
+        // Peer finished sending: a last line without a newline still counts
+        if (!client->closing && (start < client->in_len || client->skipping)) {
+            if (!serverLine(client, start, client->in_len)) return 0;
+        }
+        client->closing = 1;
+    }
+
+    if (client->closing) {
+        client->in_len = 0;
+    } else {
+        memmove(client->in, client->in + start, client->in_len - start);
+        client->in_len -= start;
+    }
+    return 1;
+}
+
+// Send as much pending output as the socket takes. Returns 0 when the
+// client has gone away.
+static int serverFlush(ServerClient* client) {
+    while (client->out_sent < client->out_len) {
+        long sent = (long)send(client->fd, client->out + client->out_sent,
+                               client->out_len - client->out_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        client->out_sent += (size_t)sent;
+    }
+    client->out_len = 0;
+    client->out_sent = 0;
+    return 1;
+}
+
+// Watch for input unless the client is closing or too far behind, and
+// for writability while answers are pending. Returns 0 when a closing
+// client has been fully answered.
+static int serverWatch(int epfd, ServerClient* client) {
+    size_t pending = client->out_len - client->out_sent;
+    unsigned events = 0;
+
+    if (!client->closing && pending < SERVER_OUTPUT_MAX) events |= EPOLLIN;
+    if (pending > 0) events |= EPOLLOUT;
+    if (events == 0) return 0;
+
+    if (events != client->events) {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = client;
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, client->fd, &ev) != 0) return 0;
+        client->events = events;
+    }
+    return 1;
+}
+
+static void serverDrop(int epfd, ServerClient* client) {
+    epoll_ctl(epfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    if (client->prev) client->prev->next = client->next;
+    else server_clients = client->next;
+    if (client->next) client->next->prev = client->prev;
+    server_client_count--;
+    free(client->out);
+    free(client);
+}
+
+// Accept every connection waiting on the listening socket
+static void serverAccept(int epfd, int listener) {
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_message(LOG_WARNING, "Server could not accept a connection");
+            }
+            return;
+        }
+
+        ServerClient* client = (ServerClient*)calloc(1, sizeof(ServerClient));
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = client;
+        if (client == NULL || !setNonBlocking(fd) || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            log_message(LOG_WARNING, "Server dropped a connection it could not set up");
+            free(client);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->events = EPOLLIN;
+        client->next = server_clients;
+        if (server_clients) server_clients->prev = client;
+        server_clients = client;
+        server_client_count++;
+    }
+}
+
+// Bind the server socket before the catalog is opened, so a second
+// server never touches the files of a running one. Returns -1 on failure.
+int serverListen(const char* path) {
+    struct sockaddr_un addr;
+
+    if (!serverAddress(path, &addr)) {
+        printf("Error: Invalid socket path '%s'!\n", path);
+        return -1;
+    }
+
+    // Never take over a live server's socket; clear a stale one
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        close(probe);
+        printf("Error: A server is already listening on %s!\n", path);
+        return -1;
+    }
+    if (probe >= 0) close(probe);
+    unlink(path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listener, SOMAXCONN) != 0 || !setNonBlocking(listener)) {
+        perror("serve");
+        if (listener >= 0) close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+// Serve the open catalog on the listening socket until SIGINT or SIGTERM
+int runServer(int listener, const char* path) {
+    // Thousands of desks need thousands of descriptors
+    struct rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    int epfd = epoll_create1(0);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    batch_out = open_memstream(&server_reply, &server_reply_size);
+    if (epfd < 0 || batch_out == NULL || epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &ev) != 0) {
+        perror("serve");
+        if (batch_out) fclose(batch_out);
+        batch_out = NULL;
+        free(server_reply);
+        if (epfd >= 0) close(epfd);
+        close(listener);
+        unlink(path);
+        return 1;
+    }
+
+    signal(SIGINT, serverSignal);
+    signal(SIGTERM, serverSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Serving %d books on %s (Ctrl+C to stop)\n", libBookCount(catalog), path);
+    fflush(stdout);
+    log_message(LOG_INFO, "Server started");
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!server_stop) {
+        int ready = epoll_wait(epfd, events, SERVER_MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            ServerClient* client = (ServerClient*)events[i].data.ptr;
+            unsigned happened = events[i].events;
+
+            if (client == NULL) {
+                serverAccept(epfd, listener);
+                continue;
+            }
+
+            int alive = !(happened & EPOLLERR);
+            if (alive && (client->events & EPOLLIN) && (happened & (EPOLLIN | EPOLLHUP))) {
+                alive = serverRead(client);
+            }
+            if (alive) alive = serverFlush(client);
+            if (alive) alive = serverWatch(epfd, client);
+            if (!alive) serverDrop(epfd, client);
+        }
+    }
+
+    printf("\nStopping server (%d clients connected)...\n", server_client_count);
+    while (server_clients != NULL) {
+        serverDrop(epfd, server_clients);
+    }
+    close(epfd);
+    close(listener);
+    unlink(path);
+    fclose(batch_out);
+    batch_out = NULL;
+    free(server_reply);
+    server_reply = NULL;
+    log_message(LOG_INFO, "Server stopped");
+    return 0;
+}
+
+// Thin client: send stdin to the server and copy its answers to stdout.
+// Both directions stay open at once so a pipelined script cannot
+// deadlock against the server's output limit.
+int runClient(const char* path) {
+    struct sockaddr_un addr;
+    static char up[65536];
+    static char down[65536];
+    size_t up_len = 0;
+    size_t up_sent = 0;
+    int input_open = 1;
+
+    if (!serverAddress(path, &addr)) {
+        fprintf(stderr, "Error: Invalid socket path '%s'!\n", path);
+        return 1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 || !setNonBlocking(sock)) {
+        fprintf(stderr, "Error: No library server listening on %s!\n", path);
+        if (sock >= 0) close(sock);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+        struct pollfd fds[2];
+        fds[0].fd = input_open && up_len == 0 ? STDIN_FILENO : -1;
+        fds[0].events = POLLIN;
+        fds[1].fd = sock;
+        fds[1].events = POLLIN | (up_len > 0 ? POLLOUT : 0);
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        if (fds[0].revents) {
+            long got = (long)read(STDIN_FILENO, up, sizeof(up));
+            if (got > 0) {
+                up_len = (size_t)got;
+                up_sent = 0;
+            } else {
+                input_open = 0;
+                shutdown(sock, SHUT_WR);
+            }
+        }
+        if (up_len > 0 && (fds[1].revents & POLLOUT || fds[0].revents)) {
+            long sent = (long)send(sock, up + up_sent, up_len - up_sent, MSG_NOSIGNAL);
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) break;
+            if (sent > 0) up_sent += (size_t)sent;
+            if (up_sent == up_len) up_len = 0;
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            long got = (long)recv(sock, down, sizeof(down), 0);
+            if (got == 0) break;
+            if (got < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) continue;
+                break;
+            }
+            for (long done = 0; done < got; ) {
+                long wrote = (long)write(STDOUT_FILENO, down + done, (size_t)(got - done));
+                if (wrote <= 0) {
+                    close(sock);
+                    return 1;
+                }
+                done += wrote;
+            }
+        }
+    }
+
+    close(sock);
+    return 0;
+}
+
+#else
+
+int serverListen(const char* path) {
+    (void)path;
+    printf("Error: Server mode is only available on Linux!\n");
+    return -1;
+}
+
+int runServer(int listener, const char* path) {
+    (void)listener;
+    (void)path;
+    return 1;
+}
+
+int runClient(const char* path) {
+    (void)path;
+    fprintf(stderr, "Error: Client mode is only available on Linux!\n");
+    return 1;
+}
+
+#endif
+
 void clearScreen() {
+#ifdef _WIN32
     system(CLEAR_SCREEN);
+#else
+    // ANSI clear instead of forking a shell; nothing when not on a terminal
+    if (isatty(STDOUT_FILENO)) {
+        fputs("\033[H\033[2J", stdout);
+    }
+#endif
 }
 
 void pauseScreen() {
@@ -266,18 +1148,44 @@ void pauseScreen() {
 }
 
 void signal_handler(int signum) {
-    printf("\n\nReceived interrupt signal. Saving data...\n");
-    cleanup_and_exit();
+    (void)signum;
+    interrupted = 1;
 }
 
 void cleanup_and_exit() {
-    saveToFile();
-    saveUsersToFile();
-    freeList();
+    saveCatalog();
+    libClose(catalog);
     log_message(LOG_INFO, "System shutdown gracefully");
+    logClose();
     exit(0);
 }
 
+// Act on an interrupt between reads from the terminal, outside signal
+// context, where saving the catalog is safe
+void checkInterrupt() {
+    if (interrupted) {
+        printf("\n\nReceived interrupt signal. Saving data...\n");
+        cleanup_and_exit();
+    }
+}
+
+// fgets on stdin for the menus. An interrupt that arrives while it waits
+// cuts the read short; one that arrived earlier is caught before blocking.
+char* readInput(char* buffer, int size) {
+    checkInterrupt();
+    char* line = fgets(buffer, size, stdin);
+    checkInterrupt();
+    return line;
+}
+
+// Save the catalog and users, reporting a failure on the terminal
+void saveCatalog() {
+    if (libSave(catalog) != LIB_OK) {
+        printf("Error: Cannot open file for writing!\n");
+    }
+}
+
+
 void displayMainMenu() {
     printf("\n=== Library Management System ===\n");
     printf("1. Login\n");
@@ -299,13 +1207,16 @@ void adminMenu() {
         printf("5. Display All Books\n");
         printf("6. Search Books\n");
         printf("7. View Book Details\n");
-        printf("8. Sort Books by Title\n");
-        printf("9. Sort Books by Author\n");
+        printf("8. List Books by Title\n");
+        printf("9. List Books by Author\n");
         printf("10. Library Statistics\n");
         printf("11. Save Data to File\n");
         printf("12. Export to Text File\n");
         printf("13. Backup Database\n");
-        printf("14. Logout\n");
+        printf("14. Import Books from CSV/TSV\n");
+        printf("15. Overdue and Due Soon Report\n");
+        printf("16. Patron Loans\n");
+        printf("17. Logout\n");
         printf("===================\n");
 
         choice = getIntegerInput("Enter your choice: ");
@@ -314,25 +1225,21 @@ void adminMenu() {
             case 1:
                 clearScreen();
                 addBook();
-                save_needed = 1;
                 pauseScreen();
                 break;
             case 2:
                 clearScreen();
                 removeBook();
-                save_needed = 1;
                 pauseScreen();
                 break;
             case 3:
                 clearScreen();
                 issueBook();
-                save_needed = 1;
                 pauseScreen();
                 break;
             case 4:
                 clearScreen();
                 returnBook();
-                save_needed = 1;
                 pauseScreen();
                 break;
             case 5:
@@ -367,9 +1274,7 @@ void adminMenu() {
                 break;
             case 11:
                 clearScreen();
-                saveToFile();
-                saveUsersToFile();
-                save_needed = 0;
+                saveCatalog();
                 printf("Data saved successfully!\n");
                 pauseScreen();
                 break;
@@ -384,15 +1289,30 @@ void adminMenu() {
                 pauseScreen();
                 break;
             case 14:
-                if (save_needed) {
+                clearScreen();
+                importBooks();
+                pauseScreen();
+                break;
+            case 15:
+                clearScreen();
+                dueDateReport();
+                pauseScreen();
+                break;
+            case 16:
+                clearScreen();
+                viewPatronLoans();
+                pauseScreen();
+                break;
+            case 17:
+                if (libHasUnsavedChanges(catalog)) {
                     clearScreen();
                     printf("Save changes before logout? (y/n): ");
-                    char ch;
+                    char ch = 'n';
+                    checkInterrupt();
                     scanf(" %c", &ch);
                     clearInputBuffer();
                     if (ch == 'y' || ch == 'Y') {
-                        saveToFile();
-                        saveUsersToFile();
+                        saveCatalog();
                         printf("Data saved successfully!\n");
                     }
                 }
@@ -404,7 +1324,7 @@ void adminMenu() {
                 printf("Invalid choice! Please try again.\n");
                 pauseScreen();
         }
-    } while(choice != 14);
+    } while(choice != 17);
 }
 
 void userMenu() {
@@ -418,8 +1338,8 @@ void userMenu() {
         printf("3. View Book Details\n");
         printf("4. Request For Borrowing Books\n");
         printf("5. Return Book\n");
-        printf("6. Sort Books by Title\n");
-        printf("7. Sort Books by Author\n");
+        printf("6. List Books by Title\n");
+        printf("7. List Books by Author\n");
         printf("8. Library Statistics\n");
         printf("9. Logout\n");
         printf("==================\n");
@@ -479,28 +1399,6 @@ void userMenu() {
     } while(choice != 9);
 }
 
-unsigned long hash_password(const char* password) {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = *password++))
-        hash = ((hash << 5) + hash) + c;
-    return hash;
-}
-
-void log_message(LogLevel level, const char* message) {
-    FILE* log = fopen(LOGFILE, "a");
-    if (log) {
-        time_t now = time(NULL);
-        struct tm* t = localtime(&now);
-        char* level_str[] = {"INFO", "WARNING", "ERROR"};
-        fprintf(log, "[%04d-%02d-%02d %02d:%02d:%02d] %s: %s\n",
-                t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-                t->tm_hour, t->tm_min, t->tm_sec,
-                level_str[level], message);
-        fclose(log);
-    }
-}
-
 void registerUser() {
     char username[MAX_USERNAME];
     char password[MAX_PASSWORD];
@@ -509,14 +1407,8 @@ void registerUser() {
 
     printf("\n=== User Registration ===\n");
 
-    if (user_count >= MAX_USERS) {
-        printf("Sorry, maximum user limit reached!\n");
-        log_message(LOG_WARNING, "User registration failed - limit reached");
-        return;
-    }
-
     printf("Enter full name: ");
-    fgets(full_name, MAX_STR, stdin);
+    readInput(full_name, MAX_STR);
     full_name[strcspn(full_name, "\n")] = 0;
 
     if (strlen(full_name) == 0) {
@@ -525,7 +1417,7 @@ void registerUser() {
     }
 
     printf("Enter username (4-29 chars): ");
-    fgets(username, MAX_USERNAME, stdin);
+    readInput(username, MAX_USERNAME);
     username[strcspn(username, "\n")] = 0;
 
     if (strlen(username) < 4) {
@@ -534,11 +1426,9 @@ void registerUser() {
     }
 
     // Check if username already exists
-    for (int i = 0; i < user_count; i++) {
-        if (strcmp(users[i].username, username) == 0) {
-            printf("Username already exists! Please choose a different username.\n");
-            return;
-        }
+    if (libUserExists(catalog, username)) {
+        printf("Username already exists! Please choose a different username.\n");
+        return;
     }
 
     printf("Enter password (min 4 chars): ");
@@ -558,14 +1448,20 @@ void registerUser() {
     }
 
     // Add new user with hashed password
-    safe_strcpy(users[user_count].username, username, MAX_USERNAME);
-    users[user_count].password_hash = hash_password(password);
-    safe_strcpy(users[user_count].full_name, full_name, MAX_STR);
-    users[user_count].is_admin = 0;
-    user_count++;
-
-    saveUsersToFile();
-    log_message(LOG_INFO, "New user registered");
+    switch (libRegisterUser(catalog, username, password, full_name)) {
+        case LIB_OK:
+            break;
+        case LIB_ERR_DUPLICATE_USER:
+            printf("Username already exists! Please choose a different username.\n");
+            return;
+        case LIB_ERR_NO_MEMORY:
+            printf("Error: Not enough memory to register!\n");
+            return;
+        default:
+            printf("Registration failed!\n");
+            return;
+    }
+
     printf("\n✓ Registration successful! You can now login with your credentials.\n");
 }
 
@@ -578,21 +1474,15 @@ int loginUser() {
 
     while (attempts < MAX_ATTEMPTS) {
         printf("Enter username: ");
-        fgets(username, MAX_USERNAME, stdin);
+        readInput(username, MAX_USERNAME);
         username[strcspn(username, "\n")] = 0;
 
         printf("Enter password: ");
         getPasswordInput(password, MAX_PASSWORD);
 
-        unsigned long input_hash = hash_password(password);
-
-        // Check credentials
-        for (int i = 0; i < user_count; i++) {
-            if (strcmp(users[i].username, username) == 0 &&
-                users[i].password_hash == input_hash) {
-                current_user = &users[i];
-                return 1; // Login successful
-            }
+        if (libAuthenticate(catalog, username, password, &session) == LIB_OK) {
+            current_user = &session;
+            return 1; // Login successful
         }
 
         attempts++;
@@ -610,81 +1500,6 @@ int loginUser() {
     return 0; // Login failed
 }
 
-void initializeDefaultAdmin() {
-    // Create default admin account with hashed password
-    safe_strcpy(users[0].username, "admin", MAX_USERNAME);
-    users[0].password_hash = hash_password("admin123");
-    safe_strcpy(users[0].full_name, "System Administrator", MAX_STR);
-    users[0].is_admin = 1;
-    user_count = 1;
-}
-
-void saveUsersToFile() {
-    FILE* file = fopen(USERFILE, "w");
-    if (file == NULL) {
-        printf("Error: Cannot open user file for writing!\n");
-        log_message(LOG_ERROR, "Cannot save users to file");
-        return;
-    }
-
-    for (int i = 0; i < user_count; i++) {
-        fprintf(file, "%s|%lu|%d|%s\n",
-                users[i].username, users[i].password_hash,
-                users[i].is_admin, users[i].full_name);
-    }
-
-    fclose(file);
-}
-
-void loadUsersFromFile() {
-    FILE* file = fopen(USERFILE, "r");
-    if (file == NULL) {
-        printf("No existing user file found. Using default admin account.\n");
-        log_message(LOG_INFO, "Using default admin account");
-        return;
-    }
-
-    char line[256];
-    int temp_count = 0;
-    User temp_users[MAX_USERS];
-
-    while (fgets(line, sizeof(line), file) && temp_count < MAX_USERS) {
-        char* token;
-
-        token = strtok(line, "|");
-        if (token) safe_strcpy(temp_users[temp_count].username, token, MAX_USERNAME);
-
-        token = strtok(NULL, "|");
-        if (token) temp_users[temp_count].password_hash = strtoul(token, NULL, 10);
-
-        token = strtok(NULL, "|");
-        if (token) temp_users[temp_count].is_admin = atoi(token);
-
-        token = strtok(NULL, "|");
-        if (token) {
-            token[strcspn(token, "\n")] = 0;
-            safe_strcpy(temp_users[temp_count].full_name, token, MAX_STR);
-        }
-
-        temp_count++;
-    }
-
-    fclose(file);
-
-    // If we loaded users, replace the default admin
-    if (temp_count > 0) {
-        user_count = temp_count;
-        for (int i = 0; i < temp_count; i++) {
-            users[i] = temp_users[i];
-        }
-        printf("Loaded %d users from file.\n", user_count);
-        log_message(LOG_INFO, "Users loaded from file");
-    } else {
-        printf("No users found in file. Using default admin account.\n");
-        log_message(LOG_INFO, "Using default admin account");
-    }
-}
-
 void addBook() {
     if (current_user == NULL || !current_user->is_admin) {
         printf("Error: Only administrators can add books!\n");
@@ -698,7 +1513,7 @@ void addBook() {
 
     // Get book details
     printf("Enter book title: ");
-    fgets(title, MAX_STR, stdin);
+    readInput(title, MAX_STR);
     title[strcspn(title, "\n")] = 0;
 
     if (strlen(title) == 0) {
@@ -707,7 +1522,7 @@ void addBook() {
     }
 
     printf("Enter author name: ");
-    fgets(author, MAX_STR, stdin);
+    readInput(author, MAX_STR);
     author[strcspn(author, "\n")] = 0;
 
     if (strlen(author) == 0) {
@@ -716,7 +1531,7 @@ void addBook() {
     }
 
     printf("Enter ISBN: ");
-    fgets(isbn, 20, stdin);
+    readInput(isbn, 20);
     isbn[strcspn(isbn, "\n")] = 0;
 
     if (!validateISBN(isbn)) {
@@ -726,31 +1541,20 @@ void addBook() {
     year = getIntegerInputSafe("Enter publication year", 1000, 2100);
     if (year == -1) return;
 
-    // Check if book with same title or ISBN already exists
-    Book* existing = searchBookByTitle(title);
-    if (existing != NULL) {
-        printf("Error: A book with title '%s' already exists (ID: %d)!\n", title, existing->id);
-        return;
-    }
-
-    existing = searchBookByISBN(isbn);
-    if (existing != NULL) {
-        printf("Error: A book with ISBN '%s' already exists (ID: %d)!\n", isbn, existing->id);
-        return;
+    LibBook book;
+    switch (libAddBook(catalog, title, author, isbn, year, &book)) {
+        case LIB_OK:
+            printf("\n✓ Book added successfully! Book ID: %d\n", book.id);
+            break;
+        case LIB_ERR_DUPLICATE_TITLE:
+            printf("Error: A book with title '%s' already exists (ID: %d)!\n", title, book.id);
+            break;
+        case LIB_ERR_DUPLICATE_ISBN:
+            printf("Error: A book with ISBN '%s' already exists (ID: %d)!\n", isbn, book.id);
+            break;
+        default:
+            printf("Error: Failed to add book! Memory allocation failed.\n");
     }
-
-    Book* newBook = createBook(next_id, title, author, isbn, year);
-    if (newBook == NULL) {
-        printf("Error: Failed to add book! Memory allocation failed.\n");
-        log_message(LOG_ERROR, "Memory allocation failed for new book");
-        return;
-    }
-
-    insertBook(newBook);
-    book_count++;
-    printf("\n✓ Book added successfully! Book ID: %d\n", next_id);
-    log_message(LOG_INFO, "Book added to library");
-    next_id++;
 }
 
 void removeBook() {
@@ -763,50 +1567,41 @@ void removeBook() {
 
     printf("\n=== Remove Book ===\n");
 
-    if (head == NULL) {
+    if (libBookCount(catalog) == 0) {
         printf("No books in the library!\n");
         return;
     }
 
     id = getIntegerInput("Enter book ID to remove: ");
 
-    Book* current = head;
-    Book* prev = NULL;
+    LibBook current;
+    if (libGetBook(catalog, id, &current) != LIB_OK) {
+        printf("Book with ID %d not found!\n", id);
+        return;
+    }
 
-    while (current != NULL) {
-        if (current->id == id) {
-            if (current->is_issued) {
-                printf("Cannot remove book! It's currently issued to: %s\n", current->issued_to);
-                return;
-            }
+    if (current.is_issued) {
+        printf("Cannot remove book! It's currently issued to: %s\n", current.issued_to);
+        return;
+    }
 
-            printf("\nAre you sure you want to remove '%s' by %s? (y/n): ",
-                   current->title, current->author);
-            char confirm;
-            scanf(" %c", &confirm);
-            clearInputBuffer();
-
-            if (confirm == 'y' || confirm == 'Y') {
-                if (prev == NULL) {
-                    head = current->next;
-                } else {
-                    prev->next = current->next;
-                }
+    printf("\nAre you sure you want to remove '%s' by %s? (y/n): ",
+           current.title, current.author);
+    char confirm = 'n';
+    checkInterrupt();
+    scanf(" %c", &confirm);
+    clearInputBuffer();
 
-                free(current);
-                book_count--;
-                printf("\n✓ Book removed successfully!\n");
-                log_message(LOG_INFO, "Book removed from library");
-            } else {
-                printf("Removal cancelled.\n");
-            }
-            return;
-        }
-        prev = current;
-        current = current->next;
+    if (confirm != 'y' && confirm != 'Y') {
+        printf("Removal cancelled.\n");
+        return;
     }
 
-    printf("Book with ID %d not found!\n", id);
+    if (libRemoveBook(catalog, id) != LIB_OK) {
+        printf("Error: Book could not be removed!\n");
+        return;
+    }
+    printf("\n✓ Book removed successfully!\n");
 }
 
 void issueBook() {
@@ -820,29 +1615,28 @@ void issueBook() {
 
     printf("\n=== Issue Book ===\n");
 
-    if (head == NULL) {
+    if (libBookCount(catalog) == 0) {
         printf("No books in the library!\n");
         return;
     }
 
     id = getIntegerInput("Enter book ID to issue: ");
 
-    Book* book = searchBook(id);
-    if (book == NULL) {
+    LibBook book;
+    if (libGetBook(catalog, id, &book) != LIB_OK) {
         printf("Book with ID %d not found!\n", id);
         return;
     }
 
-    if (book->is_issued) {
-        printf("Book is already issued to: %s\n", book->issued_to);
-        time_t now = time(NULL);
-        printf("Issued on: %s", ctime(&book->issue_date));
-        printf("Due date: %s", ctime(&book->due_date));
+    if (book.is_issued) {
+        printf("Book is already issued to: %s\n", book.issued_to);
+        printf("Issued on: %s", ctime(&book.issue_date));
+        printf("Due date: %s", ctime(&book.due_date));
         return;
     }
 
     printf("Enter borrower's name: ");
-    fgets(issued_to, MAX_BORROWER_NAME, stdin);
+    readInput(issued_to, MAX_BORROWER_NAME);
     issued_to[strcspn(issued_to, "\n")] = 0;
 
     if (strlen(issued_to) == 0) {
@@ -853,26 +1647,13 @@ void issueBook() {
     days = getIntegerInputSafe("Enter number of days for issuance", 1, 365);
     if (days == -1) return;
 
-    book->is_issued = 1;
-    safe_strcpy(book->issued_to, issued_to, MAX_BORROWER_NAME);
-    book->issue_date = time(NULL);
-    book->due_date = book->issue_date + (days * 24 * 60 * 60);
-
-    printf("\n✓ Book '%s' issued successfully to %s!\n", book->title, issued_to);
-    printf("Due date: %s", ctime(&book->due_date));
-    log_message(LOG_INFO, "Book issued");
-}
-
-double calculateFine(Book* book) {
-    if (!book->is_issued) return 0.0;
-
-    time_t now = time(NULL);
-    double days_overdue = difftime(now, book->due_date) / (24 * 60 * 60);
-
-    if (days_overdue > 0) {
-        return days_overdue * FINE_PER_DAY;
+    if (libIssueBook(catalog, id, issued_to, days, &book) != LIB_OK) {
+        printf("Error: Book could not be issued!\n");
+        return;
     }
-    return 0.0;
+
+    printf("\n✓ Book '%s' issued successfully to %s!\n", book.title, issued_to);
+    printf("Due date: %s", ctime(&book.due_date));
 }
 
 void returnBook() {
@@ -885,29 +1666,28 @@ void returnBook() {
 
     printf("\n=== Return Book ===\n");
 
-    if (head == NULL) {
+    if (libBookCount(catalog) == 0) {
         printf("No books in the library!\n");
         return;
     }
 
     id = getIntegerInput("Enter book ID to return: ");
 
-    Book* book = searchBook(id);
-    if (book == NULL) {
-        printf("Book with ID %d not found!\n", id);
-        return;
-    }
-
-    if (!book->is_issued) {
-        printf("Book is not issued to anyone!\n");
-        return;
+    LibBook book;
+    double fine;
+    switch (libReturnBook(catalog, id, &fine, &book)) {
+        case LIB_OK:
+            break;
+        case LIB_ERR_NOT_FOUND:
+            printf("Book with ID %d not found!\n", id);
+            return;
+        default:
+            printf("Book is not issued to anyone!\n");
+            return;
     }
 
-    time_t current_time = time(NULL);
-    double days_overdue = difftime(current_time, book->due_date) / (24 * 60 * 60);
-    double fine = calculateFine(book);
-
-    printf("\n✓ Book '%s' returned by %s!\n", book->title, book->issued_to);
+    double days_overdue = difftime(time(NULL), book.due_date) / (24 * 60 * 60);
+    printf("\n✓ Book '%s' returned by %s!\n", book.title, book.issued_to);
 
     if (days_overdue > 0) {
         printf("\n⚠ Warning: This book is %.1f days overdue!\n", days_overdue);
@@ -915,82 +1695,77 @@ void returnBook() {
     } else {
         printf("Book returned on time. No fine.\n");
     }
+}
+
+static void printBookRow(const LibBook* book) {
+    char status[10];
+    char issued_info[20];
+
+    if (book->is_issued) {
+        strcpy(status, "Issued");
+        safe_strcpy(issued_info, book->issued_to, 20);
+    } else {
+        strcpy(status, "Available");
+        strcpy(issued_info, "-");
+    }
 
-    book->is_issued = 0;
-    book->issued_to[0] = '\0';
-    book->issue_date = 0;
-    book->due_date = 0;
+    printf("%-5d %-30s %-25s %-15s %-6d %-10s %-20s\n",
+           book->id, book->title, book->author,
+           book->isbn, book->year, status, issued_info);
+}
 
-    log_message(LOG_INFO, "Book returned");
+// Table rows for every result, then free them
+static int printResultRows(LibResults* results) {
+    size_t count = libResultsCount(results);
+    for (size_t i = 0; i < count; i++) {
+        LibBook book;
+        libResultsGet(results, i, &book);
+        printBookRow(&book);
+    }
+    libResultsFree(results);
+    return (int)count;
 }
 
 void displayBooks() {
-    Book* current = head;
-    int count = 0;
-
     printf("\n=== All Books in Library ===\n\n");
 
-    if (head == NULL) {
+    if (libBookCount(catalog) == 0) {
         printf("No books in the library!\n");
         return;
     }
 
-    printf("%-5s %-30s %-25s %-15s %-6s %-10s %-20s\n",
-           "ID", "Title", "Author", "ISBN", "Year", "Status", "Issued To");
-    printf("------------------------------------------------------------------------------------------------------------------\n");
-
-    while (current != NULL) {
-        char status[10];
-        char issued_info[20];
-
-        if (current->is_issued) {
-            strcpy(status, "Issued");
-            safe_strcpy(issued_info, current->issued_to, 20);
-        } else {
-            strcpy(status, "Available");
-            strcpy(issued_info, "-");
-        }
+    printf("Show: 1. All  2. Available  3. Issued  4. Overdue\n");
+    int filter = getIntegerInputSafe("Select filter", FILTER_ALL, FILTER_OVERDUE);
+    if (filter == -1) return;
 
-        printf("%-5d %-30s %-25s %-15s %-6d %-10s %-20s\n",
-               current->id, current->title, current->author,
-               current->isbn, current->year, status, issued_info);
-        current = current->next;
-        count++;
+    LibResults* results;
+    LibStatus status = libList(catalog, (StatusFilter)filter, NULL, &results);
+    if (status != LIB_OK) {
+        printf("Error: %s!\n", libStatusMessage(status));
+        return;
     }
+
+    printf("\n%-5s %-30s %-25s %-15s %-6s %-10s %-20s\n",
+           "ID", "Title", "Author", "ISBN", "Year", "Status", "Issued To");
+    printf("------------------------------------------------------------------------------------------------------------------\n");
+    int count = printResultRows(results);
     printf("\nTotal books: %d\n", count);
 }
 
-char* strcasestr_custom(const char* haystack, const char* needle) {
-    if (!*needle) return (char*)haystack;
-
-    for (; *haystack; haystack++) {
-        const char* h = haystack;
-        const char* n = needle;
-
-        while (*h && *n && (tolower((unsigned char)*h) == tolower((unsigned char)*n))) {
-            h++;
-            n++;
-        }
-
-        if (!*n) return (char*)haystack;
-    }
-
-    return NULL;
-}
 
 void searchBooks() {
     char query[MAX_STR];
-    int found = 0;
+    int found;
 
     printf("\n=== Search Books ===\n");
 
-    if (head == NULL) {
+    if (libBookCount(catalog) == 0) {
         printf("No books in the library!\n");
         return;
     }
 
     printf("Enter title, author, or ISBN to search: ");
-    fgets(query, MAX_STR, stdin);
+    readInput(query, MAX_STR);
     query[strcspn(query, "\n")] = 0;
 
     if (strlen(query) == 0) {
@@ -998,28 +1773,30 @@ void searchBooks() {
         return;
     }
 
-    Book* current = head;
+    LibResults* results;
+    LibStatus status = libSearch(catalog, query, &results);
+    if (status != LIB_OK) {
+        printf("Error: %s!\n", libStatusMessage(status));
+        return;
+    }
+    found = (int)libResultsCount(results);
 
     printf("\n=== Search Results ===\n");
     printf("%-5s %-30s %-25s %-15s %-6s %-10s\n",
            "ID", "Title", "Author", "ISBN", "Year", "Status");
     printf("--------------------------------------------------------------------------------------------\n");
 
-    while (current != NULL) {
-        if (strcasestr_custom(current->title, query) ||
-            strcasestr_custom(current->author, query) ||
-            strcasestr_custom(current->isbn, query)) {
-
-            char status[10];
-            strcpy(status, current->is_issued ? "Issued" : "Available");
+    for (int i = 0; i < found; i++) {
+        LibBook current;
+        libResultsGet(results, (size_t)i, &current);
+        char status[10];
+        strcpy(status, current.is_issued ? "Issued" : "Available");
 
-            printf("%-5d %-30s %-25s %-15s %-6d %-10s\n",
-                   current->id, current->title, current->author,
-                   current->isbn, current->year, status);
-            found = 1;
-        }
-        current = current->next;
+        printf("%-5d %-30s %-25s %-15s %-6d %-10s\n",
+               current.id, current.title, current.author,
+               current.isbn, current.year, status);
     }
+    libResultsFree(results);
 
     if (!found) {
         printf("\nNo books found matching '%s'\n", query);
@@ -1031,234 +1808,141 @@ void viewBookDetails() {
 
     printf("\n=== View Book Details ===\n");
 
-    if (head == NULL) {
+    if (libBookCount(catalog) == 0) {
         printf("No books in the library!\n");
         return;
     }
 
     id = getIntegerInput("Enter book ID: ");
 
-    Book* book = searchBook(id);
-    if (book == NULL) {
+    LibBook book;
+    if (libGetBook(catalog, id, &book) != LIB_OK) {
         printf("Book with ID %d not found!\n", id);
         return;
     }
 
-    printBookDetails(book);
+    printBookDetails(&book);
 }
 
 void libraryStatistics() {
-    LibraryStats stats = {0, 0, 0, 0.0};
-    Book* current = head;
-
     printf("\n=== Library Statistics ===\n\n");
 
-    if (head == NULL) {
+    if (libBookCount(catalog) == 0) {
         printf("No books in the library!\n");
         return;
     }
 
-    while (current != NULL) {
-        stats.total_books++;
-        if (current->is_issued) {
-            stats.issued_books++;
-            stats.total_fines += calculateFine(current);
-        } else {
-            stats.available_books++;
-        }
-        current = current->next;
-    }
+    LibraryStats stats = libStatistics(catalog, time(NULL));
 
     printf("Total Books: %d\n", stats.total_books);
     printf("Available Books: %d\n", stats.available_books);
     printf("Issued Books: %d\n", stats.issued_books);
+    printf("Overdue Books: %d\n", stats.overdue_books);
     printf("Availability Rate: %.1f%%\n",
            (float)stats.available_books / stats.total_books * 100);
     printf("Total Pending Fines: %.2f currency units\n", stats.total_fines);
-}
-
-Book* createBook(int id, char* title, char* author, char* isbn, int year) {
-    Book* newBook = (Book*)malloc(sizeof(Book));
-    if (newBook == NULL) {
-        return NULL;
-    }
-
-    newBook->id = id;
-    safe_strcpy(newBook->title, title, MAX_STR);
-    safe_strcpy(newBook->author, author, MAX_STR);
-    safe_strcpy(newBook->isbn, isbn, 20);
-    newBook->year = year;
-    newBook->is_issued = 0;
-    newBook->issued_to[0] = '\0';
-    newBook->issue_date = 0;
-    newBook->due_date = 0;
-    newBook->next = NULL;
-
-    return newBook;
-}
-
-void insertBook(Book* newBook) {
-    if (head == NULL) {
-        head = newBook;
-    } else {
-        Book* current = head;
-        while (current->next != NULL) {
-            current = current->next;
-        }
-        current->next = newBook;
-    }
-}
-
-Book* searchBook(int id) {
-    Book* current = head;
-    while (current != NULL) {
-        if (current->id == id) {
-            return current;
-        }
-        current = current->next;
-    }
-    return NULL;
-}
 
-Book* searchBookByTitle(char* title) {
-    Book* current = head;
-    while (current != NULL) {
-        if (strcasecmp(current->title, title) == 0) {
-            return current;
-        }
-        current = current->next;
+    if (current_user != NULL && current_user->is_admin) {
+        PoolStats pool = libPoolStats(catalog);
+        printf("\nBook Pool: %zu slabs (%.1f KB), %zu live, %zu free slots\n",
+               pool.slabs, pool.bytes / 1024.0, pool.live, pool.free);
     }
-    return NULL;
 }
 
-Book* searchBookByISBN(char* isbn) {
-    Book* current = head;
-    while (current != NULL) {
-        if (strcmp(current->isbn, isbn) == 0) {
-            return current;
-        }
-        current = current->next;
-    }
-    return NULL;
-}
+// Overdue books, most overdue first, then the next loans to fall due.
+// Both lists come from the due-date queue under one clock reading.
+void dueDateReport() {
+    printf("\n=== Overdue and Due Soon ===\n");
 
-void saveToFile() {
-    FILE* file = fopen(FILENAME, "w");
-    if (file == NULL) {
-        printf("Error: Cannot open file for writing!\n");
-        log_message(LOG_ERROR, "Cannot save to file");
+    LibResults* overdue;
+    LibResults* upcoming;
+    LibStatus status = libList(catalog, FILTER_OVERDUE, NULL, &overdue);
+    if (status != LIB_OK) {
+        printf("Error: %s!\n", libStatusMessage(status));
         return;
     }
-
-    // Write metadata header
-    fprintf(file, "VERSION:2\n");
-    fprintf(file, "NEXT_ID:%d\n", next_id);
-    fprintf(file, "BOOK_COUNT:%d\n", book_count);
-    fprintf(file, "---\n");
-
-    Book* current = head;
-    while (current != NULL) {
-        fprintf(file, "%d|%s|%s|%s|%d|%d|%s|%ld|%ld\n",
-                current->id, current->title, current->author, current->isbn,
-                current->year, current->is_issued, current->issued_to,
-                (long)current->issue_date, (long)current->due_date);
-        current = current->next;
-    }
-
-    fclose(file);
-    log_message(LOG_INFO, "Data saved to file");
-}
-
-void loadFromFile() {
-    FILE* file = fopen(FILENAME, "r");
-    if (file == NULL) {
-        printf("No existing data file found. Starting with empty library.\n");
+    status = libDueSoon(catalog, DUE_SOON_COUNT, &upcoming);
+    if (status != LIB_OK) {
+        libResultsFree(overdue);
+        printf("Error: %s!\n", libStatusMessage(status));
         return;
     }
 
-    char line[512];
-    int version = 1;
+    time_t now = time(NULL);
+    size_t count = libResultsCount(overdue);
+    double total_fines = 0.0;
+    LibBook book;
+
+    printf("\nOverdue (%zu):\n", count);
+    if (count > 0) {
+        printf("%-5s %-30s %-20s %-12s %-10s\n", "ID", "Title", "Issued To", "Days Late", "Fine");
+        printf("-------------------------------------------------------------------------------\n");
+    }
+    for (size_t i = 0; i < count; i++) {
+        libResultsGet(overdue, i, &book);
+        double fine = calculateFineAt(book.due_date, now);
+        total_fines += fine;
+        printf("%-5d %-30.30s %-20.20s %-12.1f %-10.2f\n", book.id, book.title, book.issued_to,
+               difftime(now, book.due_date) / (24 * 60 * 60), fine);
+    }
+    if (count > 0) {
+        printf("Total pending fines: %.2f currency units\n", total_fines);
+    }
+
+    count = libResultsCount(upcoming);
+    printf("\nNext %zu due:\n", count);
+    if (count > 0) {
+        printf("%-5s %-30s %-20s %-12s\n", "ID", "Title", "Issued To", "Days Left");
+        printf("---------------------------------------------------------------------\n");
+    }
+    for (size_t i = 0; i < count; i++) {
+        libResultsGet(upcoming, i, &book);
+        printf("%-5d %-30.30s %-20.20s %-12.1f\n", book.id, book.title, book.issued_to,
+               difftime(book.due_date, now) / (24 * 60 * 60));
+    }
+    libResultsFree(overdue);
+    libResultsFree(upcoming);
+}
 
-    // Try to read version info
-    if (fgets(line, sizeof(line), file)) {
-        if (strncmp(line, "VERSION:", 8) == 0) {
-            version = atoi(line + 8);
 
-            // Read next_id
-            if (fgets(line, sizeof(line), file) && strncmp(line, "NEXT_ID:", 8) == 0) {
-                next_id = atoi(line + 8);
-            }
+void viewPatronLoans() {
+    char borrower[MAX_BORROWER_NAME];
 
-            // Read book_count (we'll verify this)
-            if (fgets(line, sizeof(line), file) && strncmp(line, "BOOK_COUNT:", 11) == 0) {
-                // Just skip, we'll count books as we load
-            }
+    printf("\n=== Patron Loans ===\n");
+    printf("Enter borrower's name: ");
+    if (readInput(borrower, MAX_BORROWER_NAME) == NULL) return;
+    borrower[strcspn(borrower, "\n")] = 0;
 
-            // Read separator
-            fgets(line, sizeof(line), file);
-        } else {
-            // Old format, rewind
-            rewind(file);
-        }
+    LibResults* loans;
+    LibStatus status = libPatronLoans(catalog, borrower, &loans);
+    if (status != LIB_OK) {
+        printf("Error: %s!\n", libStatusMessage(status));
+        return;
     }
-
-    book_count = 0;
-    int max_id = 0;
-
-    while (fgets(line, sizeof(line), file)) {
-        Book book;
-        char* token;
-
-        token = strtok(line, "|");
-        if (token) book.id = atoi(token);
-
-        token = strtok(NULL, "|");
-        if (token) safe_strcpy(book.title, token, MAX_STR);
-
-        token = strtok(NULL, "|");
-        if (token) safe_strcpy(book.author, token, MAX_STR);
-
-        token = strtok(NULL, "|");
-        if (token) safe_strcpy(book.isbn, token, 20);
-
-        token = strtok(NULL, "|");
-        if (token) book.year = atoi(token);
-
-        token = strtok(NULL, "|");
-        if (token) book.is_issued = atoi(token);
-
-        token = strtok(NULL, "|");
-        if (token) safe_strcpy(book.issued_to, token, MAX_BORROWER_NAME);
-
-        token = strtok(NULL, "|");
-        if (token) book.issue_date = (time_t)atol(token);
-
-        token = strtok(NULL, "|");
-        if (token) book.due_date = (time_t)atol(token);
-
-        Book* newBook = createBook(book.id, book.title, book.author, book.isbn, book.year);
-        if (newBook != NULL) {
-            newBook->is_issued = book.is_issued;
-            safe_strcpy(newBook->issued_to, book.issued_to, MAX_BORROWER_NAME);
-            newBook->issue_date = book.issue_date;
-            newBook->due_date = book.due_date;
-            insertBook(newBook);
-            book_count++;
-
-            if (book.id >= max_id) {
-                max_id = book.id + 1;
-            }
-        }
+    if (libResultsCount(loans) == 0) {
+        libResultsFree(loans);
+        printf("No books are issued to %s.\n", borrower);
+        return;
     }
 
-    // If we didn't get next_id from file, calculate it
-    if (version == 1 || next_id <= max_id) {
-        next_id = max_id;
+    time_t now = time(NULL);
+    int count = 0;
+    double total_fine = 0.0;
+    printf("\n%-5s %-30s %-25s %-26s %-10s\n", "ID", "Title", "Author", "Due Date", "Fine");
+    printf("------------------------------------------------------------------------------------------------\n");
+    for (size_t i = 0; i < libResultsCount(loans); i++) {
+        LibBook loan;
+        char due[32];
+        libResultsGet(loans, i, &loan);
+        double fine = calculateFineAt(loan.due_date, now);
+        strftime(due, sizeof(due), "%Y-%m-%d %H:%M", localtime(&loan.due_date));
+        printf("%-5d %-30.30s %-25.25s %-26s %-10.2f\n", loan.id, loan.title, loan.author, due, fine);
+        total_fine += fine;
+        count++;
     }
-
-    fclose(file);
-    printf("Loaded %d books from file.\n", book_count);
-    log_message(LOG_INFO, "Data loaded from file");
+    libResultsFree(loans);
+    printf("\nBooks on loan: %d\n", count);
+    printf("Total fine: %.2f currency units\n", total_fine);
 }
 
 void exportToText() {
@@ -1267,7 +1951,7 @@ void exportToText() {
 
     printf("\n=== Export Library Catalog ===\n");
     printf("Enter filename for export (without extension): ");
-    fgets(base_filename, sizeof(base_filename), stdin);
+    readInput(base_filename, sizeof(base_filename));
     base_filename[strcspn(base_filename, "\n")] = 0;
 
     if (strlen(base_filename) == 0) {
@@ -1277,95 +1961,73 @@ void exportToText() {
     // Safe concatenation
     snprintf(filename, MAX_STR, "%s.txt", base_filename);
 
-    FILE* file = fopen(filename, "w");
-    if (file == NULL) {
+    if (libExportText(catalog, filename) != LIB_OK) {
         printf("Error: Cannot create file %s!\n", filename);
-        log_message(LOG_ERROR, "Cannot create export file");
         return;
     }
-
-    time_t now = time(NULL);
-    fprintf(file, "=== Library Catalog Export ===\n");
-    fprintf(file, "Generated on: %s", ctime(&now));
-    fprintf(file, "Total books: %d\n\n", book_count);
-
-    Book* current = head;
-    while (current != NULL) {
-        fprintf(file, "ID: %d\n", current->id);
-        fprintf(file, "Title: %s\n", current->title);
-        fprintf(file, "Author: %s\n", current->author);
-        fprintf(file, "ISBN: %s\n", current->isbn);
-        fprintf(file, "Year: %d\n", current->year);
-        fprintf(file, "Status: %s\n", current->is_issued ? "Issued" : "Available");
-        if (current->is_issued) {
-            fprintf(file, "Issued to: %s\n", current->issued_to);
-            fprintf(file, "Issue date: %s", ctime(&current->issue_date));
-            fprintf(file, "Due date: %s", ctime(&current->due_date));
-            double fine = calculateFine(current);
-            if (fine > 0) {
-                fprintf(file, "Fine: %.2f currency units\n", fine);
-            }
-        }
-        fprintf(file, "---------------------------\n");
-        current = current->next;
-    }
-
-    fclose(file);
     printf("\n✓ Library catalog exported to %s successfully!\n", filename);
-    log_message(LOG_INFO, "Catalog exported to text file");
 }
 
-void backupDatabase() {
-    char backup_name[MAX_STR];
-    time_t now = time(NULL);
-    struct tm* t = localtime(&now);
-
-    printf("\n=== Backup Database ===\n");
-
-    snprintf(backup_name, MAX_STR, "library_backup_%04d%02d%02d_%02d%02d%02d.dat",
-             t->tm_year + 1900, t->tm_mon + 1, t->tm_mday,
-             t->tm_hour, t->tm_min, t->tm_sec);
+void importBooks() {
+    char path[MAX_STR];
 
-    FILE* src = fopen(FILENAME, "r");
-    FILE* dest = fopen(backup_name, "w");
+    printf("\n=== Import Books ===\n");
+    printf("Columns: title, author, isbn, year (a header row may reorder them)\n");
+    printf("Enter CSV or TSV file to import: ");
+    readInput(path, sizeof(path));
+    path[strcspn(path, "\n")] = 0;
 
-    if (!src) {
-        printf("No data file to backup!\n");
+    if (strlen(path) == 0) {
+        printf("No file entered!\n");
         return;
     }
 
-    if (!dest) {
-        printf("Backup failed - cannot create backup file!\n");
-        fclose(src);
-        log_message(LOG_ERROR, "Backup creation failed");
+    ImportReport* report = (ImportReport*)malloc(sizeof(ImportReport));
+    if (report == NULL || libImport(catalog, path, report) != LIB_OK) {
+        printf("Error: Cannot read %s!\n", path);
+        free(report);
         return;
     }
 
-    char buffer[1024];
-    while (fgets(buffer, sizeof(buffer), src)) {
-        fputs(buffer, dest);
+    for (int i = 0; i < report->error_count; i++) {
+        printf("Row %d: %s\n", report->errors[i].row, report->errors[i].reason);
+    }
+    int unlisted = report->duplicates + report->invalid - report->error_count;
+    if (unlisted > 0) {
+        printf("... and %d more rejected rows\n", unlisted);
     }
 
-    fclose(src);
-    fclose(dest);
-    printf("\n✓ Backup created successfully: %s\n", backup_name);
-    log_message(LOG_INFO, "Database backup created");
+    printf("\n✓ Imported %d of %d rows (%d duplicates, %d invalid, %d ISBN warnings)\n",
+           report->imported, report->rows, report->duplicates, report->invalid,
+           report->isbn_warnings);
+    if (!report->saved) {
+        printf("Warning: imported books could not be saved yet!\n");
+    }
+    free(report);
 }
 
-void freeList() {
-    Book* current = head;
-    while (current != NULL) {
-        Book* temp = current;
-        current = current->next;
-        free(temp);
+void backupDatabase() {
+    char backup_name[MAX_STR];
+
+    printf("\n=== Backup Database ===\n");
+
+    switch (libBackup(catalog, backup_name, sizeof(backup_name))) {
+        case LIB_OK:
+            printf("\n✓ Backup created successfully: %s\n", backup_name);
+            break;
+        case LIB_ERR_NOT_FOUND:
+            printf("No data file to backup!\n");
+            break;
+        default:
+            printf("Backup failed - cannot create backup file!\n");
     }
-    head = NULL;
-    book_count = 0;
 }
 
+
 void clearInputBuffer() {
     int c;
     while ((c = getchar()) != '\n' && c != EOF);
+    checkInterrupt();
 }
 
 int getIntegerInput(const char* prompt) {
@@ -1374,7 +2036,7 @@ int getIntegerInput(const char* prompt) {
 
     while (1) {
         printf("%s", prompt);
-        if (fgets(buffer, sizeof(buffer), stdin)) {
+        if (readInput(buffer, sizeof(buffer))) {
             if (sscanf(buffer, "%d", &value) == 1) {
                 return value;
             }
@@ -1389,7 +2051,7 @@ int getIntegerInputSafe(const char* prompt, int min, int max) {
 
     while (attempts < MAX_ATTEMPTS) {
         printf("%s (%d-%d): ", prompt, min, max);
-        if (fgets(buffer, sizeof(buffer), stdin)) {
+        if (readInput(buffer, sizeof(buffer))) {
             if (sscanf(buffer, "%d", &value) == 1) {
                 if (value >= min && value <= max) {
                     return value;
@@ -1405,14 +2067,7 @@ int getIntegerInputSafe(const char* prompt, int min, int max) {
     return -1;
 }
 
-void safe_strcpy(char* dest, const char* src, size_t dest_size) {
-    if (dest_size > 0) {
-        strncpy(dest, src, dest_size - 1);
-        dest[dest_size - 1] = '\0';
-    }
-}
-
-void printBookDetails(Book* book) {
+void printBookDetails(const LibBook* book) {
     printf("\n=== Book Details ===\n");
     printf("ID: %d\n", book->id);
     printf("Title: %s\n", book->title);
@@ -1429,7 +2084,7 @@ void printBookDetails(Book* book) {
         time_t current_time = time(NULL);
         if (current_time > book->due_date) {
             double days_overdue = difftime(current_time, book->due_date) / (24 * 60 * 60);
-            double fine = calculateFine(book);
+            double fine = calculateFineAt(book->due_date, current_time);
             printf("\n⚠ WARNING: This book is %.1f days overdue!\n", days_overdue);
             printf("Fine: %.2f currency units\n", fine);
         } else {
@@ -1439,110 +2094,34 @@ void printBookDetails(Book* book) {
     }
 }
 
-int validateISBN13(const char* isbn) {
-    if (strlen(isbn) != 13) return 0;
-
-    int sum = 0;
-    for (int i = 0; i < 12; i++) {
-        if (!isdigit((unsigned char)isbn[i])) return 0;
-        int digit = isbn[i] - '0';
-        sum += (i % 2 == 0) ? digit : digit * 3;
-    }
-
-    int checksum = (10 - (sum % 10)) % 10;
-    return checksum == (isbn[12] - '0');
-}
-
-int validateISBN(char* isbn) {
-    int len = strlen(isbn);
-
-    // Remove hyphens for validation
-    char clean_isbn[20];
-    int j = 0;
-    for (int i = 0; i < len && j < 19; i++) {
-        if (isdigit((unsigned char)isbn[i]) || isbn[i] == 'X' || isbn[i] == 'x') {
-            clean_isbn[j++] = isbn[i];
-        }
-    }
-    clean_isbn[j] = '\0';
-    len = j;
-
-    // Check for ISBN-10 or ISBN-13
-    if (len == 10) {
-        // Basic ISBN-10 validation
-        return 1;
-    } else if (len == 13) {
-        return validateISBN13(clean_isbn);
-    }
-
-    return 0;
-}
-
+// Sorted listings walk the ordered indexes; the book list keeps its order
 void sortBooksByTitle() {
-    if (head == NULL || head->next == NULL) {
-        printf("Not enough books to sort!\n");
-        return;
-    }
-    head = mergeSort(head, compareByTitle);
-    printf("\n✓ Books sorted by title successfully!\n");
-    log_message(LOG_INFO, "Books sorted by title");
+    listBooksInOrder("title", "Books by Title");
+    log_message(LOG_INFO, "Books listed by title");
 }
 
 void sortBooksByAuthor() {
-    if (head == NULL || head->next == NULL) {
-        printf("Not enough books to sort!\n");
-        return;
-    }
-    head = mergeSort(head, compareByAuthor);
-    printf("\n✓ Books sorted by author successfully!\n");
-    log_message(LOG_INFO, "Books sorted by author");
+    listBooksInOrder("author", "Books by Author");
+    log_message(LOG_INFO, "Books listed by author");
 }
 
-Book* mergeSort(Book* head, int (*compare)(Book*, Book*)) {
-    if (head == NULL || head->next == NULL) {
-        return head;
-    }
+void listBooksInOrder(const char* order, const char* heading) {
+    printf("\n=== %s ===\n", heading);
 
-    // Split the list
-    Book* slow = head;
-    Book* fast = head->next;
-
-    while (fast != NULL && fast->next != NULL) {
-        slow = slow->next;
-        fast = fast->next->next;
+    if (libBookCount(catalog) == 0) {
+        printf("No books in the library!\n");
+        return;
     }
-
-    Book* mid = slow->next;
-    slow->next = NULL;
-
-    // Recursively sort both halves
-    Book* left = mergeSort(head, compare);
-    Book* right = mergeSort(mid, compare);
-
-    // Merge
-    Book dummy;
-    Book* tail = &dummy;
-    dummy.next = NULL;
-
-    while (left != NULL && right != NULL) {
-        if (compare(left, right) <= 0) {
-            tail->next = left;
-            left = left->next;
-        } else {
-            tail->next = right;
-            right = right->next;
-        }
-        tail = tail->next;
+    LibResults* results;
+    LibStatus status = libList(catalog, FILTER_ALL, order, &results);
+    if (status != LIB_OK) {
+        printf("Error: %s!\n", libStatusMessage(status));
+        return;
     }
 
-    tail->next = (left != NULL) ? left : right;
-    return dummy.next;
-}
-
-int compareByTitle(Book* a, Book* b) {
-    return strcasecmp(a->title, b->title);
+    printf("%-5s %-30s %-25s %-15s %-6s %-10s %-20s\n",
+           "ID", "Title", "Author", "ISBN", "Year", "Status", "Issued To");
+    printf("--------------------------------------------------------------------------------------------------------------\n");
+    printResultRows(results);
 }
 
-int compareByAuthor(Book* a, Book* b) {
-    return strcasecmp(a->author, b->author);
-}
@@ -0,0 +1,6431 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "library_core.h"
+
+#define FILENAME "library.dat"
+#define USERFILE "users.dat"
+#define JOURNALFILE "library.journal"
+#define JOURNAL_OLD_FILE "library.journal.old"
+#define LOGFILE "library.log"
+#define DATA_FORMAT_VERSION 3   // 2 = pipe-delimited text, 3 = binary snapshot
+#define SLAB_BOOKS 1024
+#define CACHE_LINE 64
+#define MAX_BOOK_TRIGRAMS (2 * MAX_STR + 20)
+#define SEARCH_TEXT_LEN 256     // folded title\0author\0isbn plus SIMD padding
+#ifndef POOL_THREADS
+#define POOL_THREADS 0                  // worker pool threads including the caller, 0 = one per CPU
+#endif
+#define PARALLEL_LOAD_MIN (1 << 20)     // smaller text files parse on one thread
+#define PARALLEL_SORT_MIN (1 << 16)     // smaller sorts run on one thread
+#define CATALOG_SHARDS 0                // catalog shards, 0 = one per CPU (rounded up to a power of two)
+#define MAX_SHARDS 64
+#define PARALLEL_SCAN_MIN (1 << 16)     // smaller catalogs are scanned on one thread
+#define SCAN_GRAIN 16                   // slabs per scan task
+#define EXPORT_BATCH 16384              // books formatted per export round
+#define EXPORT_GRAIN 1024               // books per export task
+#define JOURNAL_FLUSH_MS 200                    // group commit interval
+#define JOURNAL_BUFFER_LIMIT (64 * 1024)        // commit early past this much pending
+#define JOURNAL_COMPACT_BYTES (8 * 1024 * 1024) // fold into a snapshot past this size
+
+#ifdef _WIN32
+    #include <io.h>
+    #include <fcntl.h>
+    #define fsync _commit
+#else
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+// Book structure
+typedef struct Book {
+    int id;
+    char title[MAX_STR];
+    char author[MAX_STR];
+    char isbn[20];
+    int year;
+    int is_issued;
+    char issued_to[MAX_BORROWER_NAME];
+    time_t issue_date;
+    time_t due_date;
+    struct Book* next;
+    struct Book* prev;
+    int slot;               // position in the pool's hot columns
+    int due_index;          // heap position in due_queue, DUE_OVERDUE, or -1 when not issued
+    struct Book* overdue_prev;      // due_queue overdue list links
+    struct Book* overdue_next;
+    struct Book* loan_prev;         // borrower's loan list, see borrower_index
+    struct Book* loan_next;
+    unsigned int seq;               // odd while a writer changes the loan fields, see copyBook
+    uint64_t order;                 // rises along the list, so shard scans can merge in catalog order
+} Book;
+
+// User structure
+typedef struct User {
+    char username[MAX_USERNAME];
+    unsigned long password_hash;
+    int is_admin;
+    char full_name[MAX_STR];
+} User;
+
+// User store: users live in fixed-size chunks so User pointers such as
+// current_user stay valid while it grows, and `index` maps username
+// hashes to user numbers (linear probing, -1 marks an empty slot)
+#define USER_CHUNK 1024
+
+typedef struct {
+    User** chunks;
+    size_t chunk_count;
+    int* index;
+    size_t capacity;
+} UserTable;
+
+
+// Open-addressing hash index slot: key is the book ID (or the string hash
+// for title/ISBN indexes), book is NULL when the slot has never been used
+// and INDEX_TOMBSTONE once its entry is removed
+typedef struct {
+    int key;
+    struct Book* book;
+} IndexSlot;
+
+// Hash index over the book list (linear probing, power-of-two capacity).
+// Lookups read it without locks: slots are filled key first, book last,
+// and the table is replaced under `seq` rather than rehashed in place.
+typedef struct {
+    IndexSlot* slots;
+    size_t capacity;
+    size_t count;
+    size_t tombstones;
+    unsigned int seq;       // odd while slots and capacity are being replaced
+    int locked;             // only read under a lock, so old tables are freed at once
+} BookIndex;
+
+#define INDEX_MIN_CAPACITY 64
+#define INDEX_TOMBSTONE ((Book*)1)
+
+// Slab of book records handed out by the pool allocator. The scalar fields
+// that scans read (status, dates) are mirrored into dense per-slot columns
+// so statistics and status filters never pull the string-heavy records
+// into cache; the Book records themselves form the cold region. Substring
+// search reads its own column of case-folded text built by createBook.
+typedef struct {
+    int id[SLAB_BOOKS];
+    int year[SLAB_BOOKS];
+    unsigned char live[SLAB_BOOKS];
+    unsigned char is_issued[SLAB_BOOKS];
+    time_t issue_date[SLAB_BOOKS];
+    time_t due_date[SLAB_BOOKS];
+    unsigned short search_len[SLAB_BOOKS];
+    unsigned char dirty[SLAB_BOOKS];
+    uint64_t record_offset[SLAB_BOOKS];     // record position in library.dat, 0 if none
+    char search_text[SLAB_BOOKS][SEARCH_TEXT_LEN];
+    Book books[SLAB_BOOKS];
+} BookSlab;
+
+// Pool allocator for Book records: bump allocation inside the newest slab,
+// removed books are recycled through a free list threaded on `next`
+typedef struct {
+    BookSlab** slabs;
+    size_t slab_count;
+    size_t slab_capacity;
+    size_t slab_used;       // slots handed out from the newest slab
+    Book* free_list;
+    size_t live;
+    size_t free_count;      // books waiting on the free list
+} BookPool;
+
+// Posting list of book IDs containing one trigram, ascending. IDs are
+// appended in place past `count`; anything else replaces the whole list.
+typedef struct {
+    int count;
+    int capacity;
+    int ids[];
+} PostingList;
+
+// Trigram table slot (three case-folded bytes packed into `trigram`; 0
+// marks an unused slot)
+typedef struct {
+    unsigned int trigram;
+    PostingList* list;
+} Posting;
+
+// Open-addressing table of posting lists. Searches read it without locks,
+// so it is replaced rather than resized in place.
+typedef struct {
+    size_t capacity;
+    Posting slots[];
+} PostingTable;
+
+// Trigram inverted index over title, author and ISBN. Built on the first
+// substring search and maintained incrementally afterwards. Removed books
+// are left in the posting lists and filtered out when queried.
+typedef struct {
+    PostingTable* table;
+    size_t used;
+    size_t stale;
+    int built;
+} TrigramIndex;
+
+// Ordered secondary index: a skip list of books sorted by `compare`
+// (case-insensitive title or author) with the book ID breaking ties.
+// Built on the first sorted listing and maintained incrementally after
+// that, so listings never sort and never reorder the book list.
+#define SKIP_MAX_LEVEL 16
+
+typedef struct SkipNode {
+    Book* book;
+    struct SkipNode* forward[];     // `level` entries
+} SkipNode;
+
+typedef struct {
+    SkipNode* head;
+    int level;
+    size_t count;
+    unsigned int seed;
+    int built;
+    int (*compare)(Book*, Book*);
+} SkipList;
+
+// Issued books, split at `watermark`, the latest time statistics or an
+// overdue query have asked about. Loans due after it sit in a binary
+// min-heap on due date whose entries carry their own copy of the due date,
+// so sifting never touches the book records; books remember their heap
+// position for O(log n) removal. Loans due before it are on an intrusive
+// list in due order with a running count and due-date sum, which is all
+// the statistics need: accrued fines are FINE_PER_DAY * (count * now - sum)
+// over the seconds in a day.
+typedef struct {
+    time_t due_date;
+    Book* book;
+} DueEntry;
+
+typedef struct {
+    DueEntry* entries;          // heap of loans not yet overdue
+    size_t count;
+    size_t capacity;
+    time_t next_due;            // due date at the top of the heap, DUE_NEVER when empty
+    Book* overdue_head;         // overdue loans, earliest due first
+    Book* overdue_tail;
+    size_t overdue_count;
+    int64_t overdue_due_sum;
+    time_t watermark;
+} DueQueue;
+
+// Loan counters of one shard as statistics see them
+typedef struct {
+    size_t loans;
+    size_t overdue;
+    int64_t due_sum;
+} LoanTotals;
+
+#define DUE_NEVER ((time_t)INT64_MAX)
+#define DUE_OVERDUE (-2)
+
+// Sort engine. Books are sorted as (key prefix, book) pairs: the prefix
+// holds the first eight case-folded bytes of the leading string key (or
+// the biased integer key) so most comparisons never touch the records.
+typedef enum {
+    SORT_TITLE,
+    SORT_AUTHOR,
+    SORT_YEAR,
+    SORT_ID
+} SortKey;
+
+#define SORT_MAX_KEYS 4
+
+typedef struct {
+    SortKey keys[SORT_MAX_KEYS];
+    int count;
+} SortSpec;
+
+typedef struct {
+    uint64_t prefix;
+    Book* book;
+} SortItem;
+
+// Binary snapshot (VERSION:3) layout: the "VERSION:3\n" line, a header,
+// `book_count` fixed-width records and a heap of NUL-terminated strings.
+// Title, author and ISBN live in the heap; the borrower name is kept
+// inline so circulation changes never need to touch the heap. Integers are
+// stored in host byte order.
+//
+// Incremental saves patch records in place, mark removed ones with a
+// tombstone and append new books as segments (a segment header followed by
+// its own records and heap) after the main heap. `segments` counts the
+// committed segments; it is updated only after the segment is on disk.
+#define SNAPSHOT_MAGIC "VERSION:3\n"
+#define SNAPSHOT_MAGIC_LEN 10
+#define SNAPSHOT_MAX_SEGMENTS 64
+
+typedef struct {
+    uint32_t next_id;
+    uint32_t book_count;
+    uint32_t record_size;
+    uint32_t segments;
+    uint64_t records_offset;
+    uint64_t heap_offset;
+    uint64_t heap_size;
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t book_count;
+    uint32_t reserved;
+    uint64_t heap_size;
+} SnapshotSegment;
+
+typedef struct {
+    int32_t id;
+    int32_t year;
+    int32_t is_issued;
+    uint32_t title_off;
+    uint32_t author_off;
+    uint32_t isbn_off;
+    int64_t issue_date;
+    int64_t due_date;
+    char issued_to[MAX_BORROWER_NAME];
+    unsigned char removed;
+    char reserved[5];
+} SnapshotRecord;
+
+// Books changed since library.dat was last written. Changed slots are
+// listed by their shard, once per dirty period (the per-slot dirty bit
+// guards against duplicates); records of removed books are remembered by
+// file offset so they can be tombstoned. `base_valid` says library.dat is
+// a snapshot whose record offsets match the ones kept in the pools, i.e.
+// it can be patched.
+typedef struct {
+    uint64_t* removed;
+    size_t removed_count;
+    size_t removed_capacity;
+    int base_valid;
+    uint64_t snapshot_end;      // end of the last committed segment
+    uint32_t segments;
+    size_t dead_records;        // tombstones already in the file
+} ChangeSet;
+
+// One parsed line of a text data file. Strings point into the mapped file
+// (title, author, isbn, issued_to) and are copied when the book is built.
+typedef struct {
+    int id;
+    int year;
+    int is_issued;
+    time_t issue_date;
+    time_t due_date;
+    const char* field[4];
+    size_t length[4];
+    Book* book;
+} ParsedLine;
+
+// A newline-aligned slice of a text data file and the lines parsed from it
+typedef struct {
+    const char* begin;
+    const char* end;
+    ParsedLine* lines;
+    int count;
+    int capacity;
+    int failed;
+    LibCatalog* cat;            // catalog the books are built for
+} ParseChunk;
+
+// Growable byte buffer for snapshot images and journal batches
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} ByteBuffer;
+
+// Write-ahead journal. Every catalog change is appended as one record
+// ([length][checksum][op][payload]); records are batched in `pending` and
+// written with a single write+fsync by the flusher thread (group commit)
+// or by journalCommit. Once the file grows past JOURNAL_COMPACT_BYTES it
+// is rotated to JOURNAL_OLD_FILE and a background thread folds the
+// catalog into a fresh snapshot. Replay is idempotent, so records that
+// are already part of the snapshot are harmless.
+#define JOURNAL_MAGIC "LMSJRNL1"
+#define JOURNAL_MAGIC_LEN 8
+#define JOURNAL_RECORD_HEADER 8
+
+typedef enum {
+    JOURNAL_ADD = 1,
+    JOURNAL_REMOVE,
+    JOURNAL_ISSUE,
+    JOURNAL_RETURN
+} JournalOp;
+
+typedef struct {
+    int enabled;
+    int fd;
+    ByteBuffer pending;
+    ByteBuffer writing;
+    size_t file_size;
+    pthread_mutex_t lock;       // guards pending
+    pthread_mutex_t io_lock;    // serializes writes to fd
+    pthread_cond_t wake;
+    pthread_t flusher;
+    int running;
+    pthread_t compactor;
+    int compacting;
+    ByteBuffer image;           // snapshot being written by the compactor
+    int compact_failed;
+} Journal;
+
+
+// Asynchronous logger. log_message copies the line into a bounded
+// lock-free ring (one sequence number per slot, producers claim slots with
+// a CAS); a writer thread drains it every `flush_ms` into one large write.
+// A full ring drops the message and counts it rather than blocking.
+#define LOG_RING_SIZE 4096              // power of two
+#define LOG_LINE_MAX 200
+#define LOG_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+    size_t sequence;
+    LogLevel level;
+    time_t time;
+    char text[LOG_LINE_MAX];
+} LogEntry;
+
+typedef struct {
+    size_t enqueue_pos;
+    size_t dequeue_pos;         // writer thread only
+    size_t written;             // entries handed to the kernel or counted as dropped
+    unsigned long dropped;
+    int fd;
+    int running;
+    LogLevel min_level;
+    int flush_ms;
+    int sync_on_error;          // ERROR lines wait until fsynced
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t flushed;
+} Logger;
+
+// Epoch-based reclamation. Lookups, searches and listings take no lock:
+// they pin the catalog's epoch while they hold pointers into it, and a
+// result set keeps its pin until it is freed. Writers retire what they
+// unlink instead of freeing it, always under the catalog lock (indexes
+// only read under a shard lock free old tables directly);
+// it is released once the epoch has moved on twice, when no pinned reader
+// can still reach it.
+#define EPOCH_SLOTS 256
+#define EPOCH_PIN_ROUNDS 64     // scans for a free slot before a reader gives up
+#define EPOCH_COLLECT_BATCH 32  // retired items before a writer tries to release them
+
+typedef struct {
+    uint64_t state;             // (epoch << 1) | 1 while pinned, 0 when free
+    char pad[CACHE_LINE - sizeof(uint64_t)];
+} EpochSlot;
+
+typedef void (*ReleaseFn)(LibCatalog* cat, void* ptr);
+
+typedef struct {
+    void* ptr;
+    ReleaseFn release;          // NULL for plain free()
+    uint64_t epoch;
+} Retired;
+
+typedef struct {
+    uint64_t global;
+    EpochSlot* slots;
+    Retired* retired;
+    size_t retired_count;
+    size_t retired_capacity;
+} EpochState;
+
+// Process-wide work-stealing pool behind parallelFor and parallelReduce,
+// started on first use. Each worker owns a deque of index ranges: it
+// halves the range it is running, pushes the upper half on the bottom of
+// its deque and carries on with the lower, and when its deque is empty it
+// steals from the top of another's, where the oldest and largest ranges
+// sit. Threads outside the pool share deque 0 and help run ranges until
+// their own call is complete, so nested calls never wait on idle workers.
+#define POOL_DEQUE_SIZE 256
+
+typedef void (*PoolBody)(void* ctx, size_t begin, size_t end);
+typedef void (*PoolPart)(void* ctx, size_t begin, size_t end, void* partial);
+typedef void (*PoolMerge)(void* ctx, void* result, void* partial);
+
+typedef struct {
+    PoolBody body;
+    void* ctx;
+    size_t grain;               // ranges this long are not split further
+    size_t remaining;           // indices not yet run
+} PoolJob;
+
+typedef struct {
+    PoolJob* job;
+    size_t begin;
+    size_t end;
+} PoolRange;
+
+typedef struct {
+    pthread_mutex_t lock;
+    size_t top;                 // oldest range, taken by thieves
+    size_t bottom;              // one past the newest, pushed and popped by the owner
+    PoolRange ranges[POOL_DEQUE_SIZE];
+    char pad[CACHE_LINE];
+} PoolDeque;
+
+typedef struct {
+    pthread_once_t once;
+    pthread_mutex_t lock;       // sleeping workers and waiting callers
+    pthread_cond_t work;        // a range was pushed
+    pthread_cond_t done;        // a job finished
+    int threads;                // workers plus the calling thread
+    int idle;                   // workers asleep on `work`
+    size_t queued;              // ranges on all deques
+    PoolDeque* deques;          // [0] threads outside the pool, [1..] workers
+} WorkPool;
+
+// One partition of the catalog. Books go to a shard by a hash of their
+// ID; the shard owns their records, the ID index over them and their
+// circulation state. Issues and returns only take the shard's lock, so
+// circulation on different shards never contends. Adds and removes hold
+// the catalog lock as well, and so does everything that allocates from
+// the pool or changes the ID index.
+typedef struct {
+    pthread_mutex_t lock;
+    BookPool pool;
+    BookIndex id_index;
+    BookIndex borrower_index;   // borrower name -> first loan
+    DueQueue due_queue;
+    int* dirty;                 // slots changed since library.dat was written
+    size_t dirty_count;
+    size_t dirty_capacity;
+    int book_count;
+    unsigned int stats_seq;     // odd while loan counters are changing, see libStatistics
+    char pad[CACHE_LINE];       // keeps the next shard's lock off this shard's lines
+} CatalogShard;
+
+// Catalog state. One LibCatalog owns its books, users, indexes, journal
+// and file paths; nothing in it is shared with another catalog.
+#define LIB_PATH_MAX 1024
+
+struct LibCatalog {
+    Book* head;
+    Book* tail;
+    int book_count;
+    int next_id;
+    uint64_t next_order;
+    UserTable users;
+    int user_count;
+    int users_saved;            // users already written to users.dat
+    int users_first_dirty;      // lowest user changed since then, user_count when none
+    BookIndex title_index;
+    BookIndex isbn_index;
+    CatalogShard* shards;
+    int shard_count;            // a power of two
+    int shard_bits;
+    TrigramIndex trigram_index;
+    ChangeSet changes;
+    SkipList title_order;
+    SkipList author_order;
+    Journal journal;
+    pthread_mutex_t write_lock; // the catalog lock, see catalogLock
+    EpochState epoch;
+    int persistent;             // 0 for libCreate catalogs, which never touch disk
+    char dir[LIB_PATH_MAX];     // directory of the data files, "" for the working one
+    char data_path[LIB_PATH_MAX];
+    char user_path[LIB_PATH_MAX];
+    char journal_path[LIB_PATH_MAX];
+    char journal_old_path[LIB_PATH_MAX];
+};
+
+// Books a query matched, see libSearch and libList. The rows stay valid
+// while the result set holds its epoch pin.
+struct LibResults {
+    Book** books;
+    LibBook* copies;            // rows as they passed a status filter, NULL for live rows
+    size_t count;
+    LibCatalog* cat;
+    int pin;                    // epoch slot, -1 when none is held
+};
+
+// Process-wide state: the log and the worker pool are shared by every
+// catalog, and catalogs take their shard count from shard_setting when
+// they are created
+static int shard_setting = CATALOG_SHARDS;
+static LogEntry log_ring[LOG_RING_SIZE];
+const char* log_level_names[] = {"INFO", "WARNING", "ERROR"};
+static Logger logger = {0, 0, 0, 0, -1, 0, LOG_INFO, LOG_FLUSH_MS, 1, 0,
+                        PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};
+// Timestamp text cached per thread: the writer formats most lines, but
+// without it every caller formats its own
+static __thread time_t log_stamp_time = (time_t)-1;    // second the cached timestamp belongs to
+static __thread char log_stamp[64];
+static WorkPool pool = {PTHREAD_ONCE_INIT, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                        PTHREAD_COND_INITIALIZER, 1, 0, 0, NULL};
+static __thread int pool_self;         // this thread's deque, 0 outside the pool
+static __thread LibCatalog* read_locked;       // catalog whose lock this thread holds as a reader
+static __thread int read_lock_depth;           // catalogLock calls nested inside that read section
+
+// Function prototypes. Only what library_core.h declares is exported.
+static int compareByTitle(Book* a, Book* b);
+static int compareByAuthor(Book* a, Book* b);
+static void gatherLoans(CatalogShard* shard, time_t now, LoanTotals* totals);
+static int saveToFile(LibCatalog* cat);
+static LibStatus loadFromFile(LibCatalog* cat);
+static int saveCatalogFile(LibCatalog* cat);
+static int patchSnapshot(LibCatalog* cat);
+static void markBookDirty(LibCatalog* cat, Book* book);
+static void clearChangeSet(LibCatalog* cat);
+static int hasUnsavedChanges(LibCatalog* cat);
+static int buildSnapshotImage(LibCatalog* cat, ByteBuffer* out);
+static int buildTextImage(LibCatalog* cat, ByteBuffer* out);
+static int writeFileAtomic(const char* path, const char* data, size_t length);
+static int journalOpen(LibCatalog* cat, int* replayed);
+static void journalClose(LibCatalog* cat);
+static int journalCommit(LibCatalog* cat);
+static int journalCheckpoint(LibCatalog* cat, int wait);
+static void journalAddBook(LibCatalog* cat, const Book* book);
+static void journalRemoveBook(LibCatalog* cat, int id);
+static void journalIssueBook(LibCatalog* cat, const Book* book);
+static void journalReturnBook(LibCatalog* cat, int id);
+static Book* catalogAddBook(LibCatalog* cat, int id, const char* title, const char* author, const char* isbn, int year);
+static void catalogRemoveBook(LibCatalog* cat, Book* book);
+static void catalogIssueBook(LibCatalog* cat, Book* book, const char* borrower, time_t issue_date, time_t due_date);
+static void catalogReturnBook(LibCatalog* cat, Book* book);
+static int loadSnapshotData(LibCatalog* cat, const char* data, size_t size);
+static int loadTextData(LibCatalog* cat, const char* data, size_t size);
+static void finishBook(LibCatalog* cat, Book* book);
+static int importCatalog(LibCatalog* cat, const char* path, ImportReport* report);
+static int saveUsersToFile(LibCatalog* cat);
+static void loadUsersFromFile(LibCatalog* cat, LibOpenReport* report);
+static User* userAt(LibCatalog* cat, int number);
+static User* userFind(LibCatalog* cat, const char* username);
+static User* userAdd(LibCatalog* cat, const char* username, unsigned long password_hash, int is_admin, const char* full_name);
+static void userClear(LibCatalog* cat);
+static Book* createBook(LibCatalog* cat, int id, char* title, char* author, char* isbn, int year);
+static void insertBook(LibCatalog* cat, Book* newBook);
+static void appendBooks(LibCatalog* cat, Book* first, Book* last, int count);
+static void unlinkBook(LibCatalog* cat, Book* book);
+static Book* firstBook(LibCatalog* cat);
+static Book* nextBook(const Book* book);
+static Book* searchBook(LibCatalog* cat, int id);
+static Book* searchBookByTitle(LibCatalog* cat, char* title);
+static Book* searchBookByISBN(LibCatalog* cat, char* isbn);
+static int indexReserve(LibCatalog* cat, BookIndex* index, size_t expected);
+static int indexInsert(LibCatalog* cat, BookIndex* index, int key, Book* book);
+static void indexRemove(BookIndex* index, int key, Book* book);
+static Book* indexLookup(const BookIndex* index, int id);
+static Book* indexFind(const BookIndex* index, int key,
+                       int (*match)(const Book*, const char*), const char* value);
+static void indexClear(BookIndex* index);
+static int indexBook(LibCatalog* cat, Book* book);
+static void unindexBook(LibCatalog* cat, Book* book);
+static int hashString(const char* str);
+static int hashStringFolded(const char* str);
+static void* alignedAlloc(size_t size);
+static void alignedFree(void* ptr);
+static Book* poolAlloc(LibCatalog* cat, BookPool* pool);
+static void poolFree(BookPool* pool, Book* book);
+static void poolReset(BookPool* pool);
+static PoolStats poolStats(const BookPool* pool);
+static void syncHotColumns(LibCatalog* cat, Book* book);
+static void freeList(LibCatalog* cat);
+static int validateISBN13(const char* isbn);
+static int skipBuild(LibCatalog* cat, SkipList* list);
+static int skipInsert(SkipList* list, Book* book);
+static void skipRemove(LibCatalog* cat, SkipList* list, Book* book);
+static void skipClear(LibCatalog* cat, SkipList* list);
+static SortItem* sortCatalog(LibCatalog* cat, const SortSpec* spec, size_t* count);
+static void dueQueueUpdate(LibCatalog* cat, Book* book);
+static void dueQueueRemove(LibCatalog* cat, Book* book);
+static void dueQueueClear(DueQueue* due);
+static void dueAdvance(CatalogShard* shard, time_t now);
+static size_t dueLoanCount(const DueQueue* due);
+static size_t dueBooks(const DueQueue* due, time_t from, time_t until, size_t limit, DueEntry* out);
+static size_t shardDueBooks(LibCatalog* cat, time_t now, time_t from, time_t until, size_t limit, Book** out);
+static void loanLink(LibCatalog* cat, Book* book);
+static void loanUnlink(LibCatalog* cat, Book* book);
+static Book* patronLoans(CatalogShard* shard, const char* borrower);
+static int parseSortSpec(const char* text, SortSpec* spec);
+static void initializeDefaultAdmin(LibCatalog* cat);
+static unsigned long hash_password(const char* password);
+static double calculateFine(Book* book);
+static char* strcasestr_custom(const char* haystack, const char* needle);
+static int bookMatchesQuery(LibCatalog* cat, const Book* book, const char* folded, size_t len);
+static size_t foldSearchText(char* dest, const char* src, size_t dest_size);
+static void initSearchKernel();
+static Book** searchCatalog(LibCatalog* cat, const char* query, int* count);
+static int trigramBuild(LibCatalog* cat, TrigramIndex* index);
+static int trigramAdd(LibCatalog* cat, TrigramIndex* index, const Book* book);
+static void trigramRemove(LibCatalog* cat, TrigramIndex* index, const Book* book);
+static void trigramClear(LibCatalog* cat, TrigramIndex* index);
+static int threadCount(int configured, size_t size, size_t minimum);
+static void runChunks(void* (*body)(void*), void* tasks, size_t stride, int count);
+static int poolThreads();
+static void parallelFor(size_t count, size_t grain, PoolBody body, void* ctx);
+static void parallelReduce(size_t count, size_t grain, size_t partial_size, PoolPart body, PoolMerge merge,
+                           void* ctx, void* result);
+static void catalogLock(LibCatalog* cat);
+static void catalogUnlock(LibCatalog* cat);
+static void catalogLockAll(LibCatalog* cat);
+static void catalogUnlockAll(LibCatalog* cat);
+static void shardLock(CatalogShard* shard);
+static void shardUnlock(CatalogShard* shard);
+static CatalogShard* shardFor(LibCatalog* cat, int id);
+static int epochPin(LibCatalog* cat);
+static void epochUnpin(LibCatalog* cat, int slot);
+static void epochRetire(LibCatalog* cat, void* ptr, ReleaseFn release);
+static void epochCollect(LibCatalog* cat);
+static void epochDrain(LibCatalog* cat);
+
+static unsigned long hash_password(const char* password) {
+    unsigned long hash = 5381;
+    int c;
+    while ((c = *password++))
+        hash = ((hash << 5) + hash) + c;
+    return hash;
+}
+
+// Format "[YYYY-MM-DD HH:MM:SS] LEVEL: message\n" into `out`, reusing this
+// thread's timestamp text while the second has not changed
+static size_t logFormat(char* out, LogLevel level, time_t when, const char* message) {
+    if (when != log_stamp_time) {
+        struct tm t;
+        localtime_r(&when, &t);
+        snprintf(log_stamp, sizeof(log_stamp), "[%04d-%02d-%02d %02d:%02d:%02d] ",
+                 t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                 t.tm_hour, t.tm_min, t.tm_sec);
+        log_stamp_time = when;
+    }
+
+    size_t length = strlen(log_stamp);
+    memcpy(out, log_stamp, length);
+    length += (size_t)sprintf(out + length, "%s: ", log_level_names[level]);
+    size_t text = strnlen(message, LOG_LINE_MAX - 1);
+    memcpy(out + length, message, text);
+    length += text;
+    out[length++] = '\n';
+    return length;
+}
+
+// Hand a buffer of formatted lines to the kernel. Lines that cannot be
+// written are counted as dropped rather than retried, so a full or broken
+// log never holds up the callers waiting on them.
+static void logWrite(const char* buffer, size_t used, unsigned long lines) {
+    if (used > 0 && (long)write(logger.fd, buffer, used) != (long)used) {
+        __atomic_fetch_add(&logger.dropped, lines, __ATOMIC_RELAXED);
+    }
+}
+
+// Move everything queued into the log file. Writer thread (or, once it
+// has stopped, the caller) only.
+static void logDrain() {
+    static char buffer[LOG_BUFFER_SIZE];
+    size_t used = 0;
+    unsigned long lines = 0;    // messages in `buffer`, the dropped ones included
+    int saw_error = 0;
+
+    unsigned long dropped = __atomic_exchange_n(&logger.dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        char note[64];
+        snprintf(note, sizeof(note), "%lu log messages dropped", dropped);
+        used += logFormat(buffer, LOG_WARNING, time(NULL), note);
+        lines = dropped;
+    }
+
+    for (;;) {
+        LogEntry* entry = &log_ring[logger.dequeue_pos & (LOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE) != logger.dequeue_pos + 1) {
+            break;
+        }
+
+        if (used + LOG_LINE_MAX + 64 > sizeof(buffer)) {
+            logWrite(buffer, used, lines);
+            used = 0;
+            lines = 0;
+        }
+        used += logFormat(buffer + used, entry->level, entry->time, entry->text);
+        lines++;
+        saw_error |= entry->level == LOG_ERROR;
+
+        __atomic_store_n(&entry->sequence, logger.dequeue_pos + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        logger.dequeue_pos++;
+    }
+
+    logWrite(buffer, used, lines);
+    if (saw_error && logger.sync_on_error) {
+        fsync(logger.fd);
+    }
+
+    pthread_mutex_lock(&logger.lock);
+    logger.written = logger.dequeue_pos;
+    pthread_cond_broadcast(&logger.flushed);
+    pthread_mutex_unlock(&logger.lock);
+}
+
+static void* logWriterThread(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&logger.lock);
+    while (logger.running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)logger.flush_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&logger.wake, &logger.lock, &deadline);
+
+        pthread_mutex_unlock(&logger.lock);
+        logDrain();
+        pthread_mutex_lock(&logger.lock);
+    }
+    pthread_mutex_unlock(&logger.lock);
+    return NULL;
+}
+
+void logConfigure(LogLevel min_level, int flush_ms, int sync_on_error) {
+    logger.min_level = min_level;
+    logger.flush_ms = flush_ms > 0 ? flush_ms : LOG_FLUSH_MS;
+    logger.sync_on_error = sync_on_error;
+}
+
+void logOpen() {
+    logger.fd = open(LOGFILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (logger.fd < 0) return;
+
+    for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+        log_ring[i].sequence = i;
+    }
+    logger.running = 1;
+    if (pthread_create(&logger.writer, NULL, logWriterThread, NULL) != 0) {
+        logger.running = 0;
+    }
+}
+
+// Stop the writer and flush whatever is still queued; later messages are
+// written synchronously
+void logClose() {
+    if (!logger.running) return;
+
+    pthread_mutex_lock(&logger.lock);
+    logger.running = 0;
+    pthread_cond_signal(&logger.wake);
+    pthread_mutex_unlock(&logger.lock);
+    pthread_join(logger.writer, NULL);
+    logDrain();
+}
+
+void log_message(LogLevel level, const char* message) {
+    if (level < logger.min_level) return;
+
+    if (!logger.running) {
+        FILE* log = fopen(LOGFILE, "a");
+        if (log) {
+            char line[LOG_LINE_MAX + 64];
+            fwrite(line, 1, logFormat(line, level, time(NULL), message), log);
+            fclose(log);
+        }
+        return;
+    }
+
+    size_t pos = __atomic_load_n(&logger.enqueue_pos, __ATOMIC_RELAXED);
+    LogEntry* entry;
+    for (;;) {
+        entry = &log_ring[pos & (LOG_RING_SIZE - 1)];
+        size_t sequence = __atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE);
+        long diff = (long)(sequence - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&logger.enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_fetch_add(&logger.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&logger.enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    entry->level = level;
+    entry->time = time(NULL);
+    size_t length = strnlen(message, LOG_LINE_MAX - 1);
+    memcpy(entry->text, message, length);
+    entry->text[length] = '\0';
+    __atomic_store_n(&entry->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    // Wake the writer early during bursts instead of waiting out flush_ms
+    if (((pos + 1) & (LOG_RING_SIZE / 4 - 1)) == 0) {
+        pthread_cond_signal(&logger.wake);
+    }
+
+    if (level == LOG_ERROR && logger.sync_on_error) {
+        pthread_mutex_lock(&logger.lock);
+        pthread_cond_signal(&logger.wake);
+        while (logger.running && logger.written <= pos) {
+            pthread_cond_wait(&logger.flushed, &logger.lock);
+        }
+        pthread_mutex_unlock(&logger.lock);
+    }
+}
+
+// Accounts change rarely, so they are simply kept under the catalog lock
+LibStatus libAuthenticate(LibCatalog* cat, const char* username, const char* password, LibUser* user) {
+    catalogLock(cat);
+    const User* found = userFind(cat, username);
+    if (found == NULL || found->password_hash != hash_password(password)) {
+        catalogUnlock(cat);
+        return LIB_ERR_AUTH;
+    }
+
+    memcpy(user->username, found->username, MAX_USERNAME);
+    user->is_admin = found->is_admin;
+    memcpy(user->full_name, found->full_name, MAX_STR);
+    catalogUnlock(cat);
+    return LIB_OK;
+}
+
+// New accounts are regular users and are appended to users.dat at once
+LibStatus libRegisterUser(LibCatalog* cat, const char* username, const char* password,
+                          const char* full_name) {
+    if (full_name[0] == '\0' || strlen(username) < 4 || strlen(username) >= MAX_USERNAME ||
+        strlen(password) < 4) {
+        return LIB_ERR_INVALID;
+    }
+
+    catalogLock(cat);
+    if (userFind(cat, username) != NULL) {
+        catalogUnlock(cat);
+        return LIB_ERR_DUPLICATE_USER;
+    }
+    if (userAdd(cat, username, hash_password(password), 0, full_name) == NULL) {
+        catalogUnlock(cat);
+        log_message(LOG_ERROR, "User registration failed - out of memory");
+        return LIB_ERR_NO_MEMORY;
+    }
+
+    saveUsersToFile(cat);
+    catalogUnlock(cat);
+    log_message(LOG_INFO, "New user registered");
+    return LIB_OK;
+}
+
+int libUserExists(LibCatalog* cat, const char* username) {
+    catalogLock(cat);
+    int exists = userFind(cat, username) != NULL;
+    catalogUnlock(cat);
+    return exists;
+}
+
+int libUserCount(LibCatalog* cat) {
+    catalogLock(cat);
+    int count = cat->user_count;
+    catalogUnlock(cat);
+    return count;
+}
+
+static User* userAt(LibCatalog* cat, int number) {
+    return &cat->users.chunks[number / USER_CHUNK][number % USER_CHUNK];
+}
+
+static int userRehash(LibCatalog* cat, size_t capacity) {
+    int* slots = (int*)malloc(capacity * sizeof(int));
+    if (slots == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i] = -1;
+    }
+
+    size_t mask = capacity - 1;
+    for (int n = 0; n < cat->user_count; n++) {
+        size_t pos = (size_t)(unsigned int)hashString(userAt(cat, n)->username) & mask;
+        while (slots[pos] >= 0) {
+            pos = (pos + 1) & mask;
+        }
+        slots[pos] = n;
+    }
+
+    free(cat->users.index);
+    cat->users.index = slots;
+    cat->users.capacity = capacity;
+    return 1;
+}
+
+static User* userFind(LibCatalog* cat, const char* username) {
+    if (cat->users.capacity == 0) return NULL;
+
+    size_t mask = cat->users.capacity - 1;
+    size_t pos = (size_t)(unsigned int)hashString(username) & mask;
+    while (cat->users.index[pos] >= 0) {
+        User* user = userAt(cat, cat->users.index[pos]);
+        if (strcmp(user->username, username) == 0) {
+            return user;
+        }
+        pos = (pos + 1) & mask;
+    }
+    return NULL;
+}
+
+// Append a user and index it. Returns NULL when out of memory; the caller
+// checks for duplicate usernames first.
+static User* userAdd(LibCatalog* cat, const char* username, unsigned long password_hash, int is_admin, const char* full_name) {
+    if ((size_t)cat->user_count == cat->users.chunk_count * USER_CHUNK) {
+        User** chunks = (User**)realloc(cat->users.chunks, (cat->users.chunk_count + 1) * sizeof(User*));
+        if (chunks == NULL) {
+            return NULL;
+        }
+        cat->users.chunks = chunks;
+        cat->users.chunks[cat->users.chunk_count] = (User*)malloc(USER_CHUNK * sizeof(User));
+        if (cat->users.chunks[cat->users.chunk_count] == NULL) {
+            return NULL;
+        }
+        cat->users.chunk_count++;
+    }
+
+    // Size the index for a load factor under 3/4
+    size_t capacity = cat->users.capacity ? cat->users.capacity : INDEX_MIN_CAPACITY;
+    while (((size_t)cat->user_count + 1) * 4 >= capacity * 3) {
+        capacity *= 2;
+    }
+    if (capacity != cat->users.capacity && !userRehash(cat, capacity)) {
+        return NULL;
+    }
+
+    User* user = userAt(cat, cat->user_count);
+    safe_strcpy(user->username, username, MAX_USERNAME);
+    user->password_hash = password_hash;
+    user->is_admin = is_admin;
+    safe_strcpy(user->full_name, full_name, MAX_STR);
+
+    size_t mask = cat->users.capacity - 1;
+    size_t pos = (size_t)(unsigned int)hashString(user->username) & mask;
+    while (cat->users.index[pos] >= 0) {
+        pos = (pos + 1) & mask;
+    }
+    cat->users.index[pos] = cat->user_count++;
+    return user;
+}
+
+static void userClear(LibCatalog* cat) {
+    for (size_t i = 0; i < cat->users.chunk_count; i++) {
+        free(cat->users.chunks[i]);
+    }
+    free(cat->users.chunks);
+    free(cat->users.index);
+    UserTable empty = {NULL, 0, NULL, 0};
+    cat->users = empty;
+    cat->user_count = 0;
+    cat->users_saved = 0;
+    cat->users_first_dirty = 0;
+}
+
+static void initializeDefaultAdmin(LibCatalog* cat) {
+    // Create default admin account with hashed password
+    userClear(cat);
+    userAdd(cat, "admin", hash_password("admin123"), 1, "System Administrator");
+}
+
+// Only dirty users are written. New users are appended to users.dat; the
+// file is rewritten only when a user already in it has changed.
+static int saveUsersToFile(LibCatalog* cat) {
+    if (cat->users_first_dirty >= cat->user_count || !cat->persistent) return 1;
+
+    int append = cat->users_first_dirty >= cat->users_saved;
+    FILE* file = fopen(cat->user_path, append ? "a" : "w");
+    if (file == NULL) {
+        log_message(LOG_ERROR, "Cannot save users to file");
+        return 0;
+    }
+
+    for (int i = append ? cat->users_saved : 0; i < cat->user_count; i++) {
+        const User* user = userAt(cat, i);
+        fprintf(file, "%s|%lu|%d|%s\n",
+                user->username, user->password_hash, user->is_admin, user->full_name);
+    }
+
+    if (fclose(file) != 0) {
+        log_message(LOG_ERROR, "Cannot save users to file");
+        return 0;
+    }
+    cat->users_saved = cat->user_count;
+    cat->users_first_dirty = cat->user_count;
+    return 1;
+}
+
+static void loadUsersFromFile(LibCatalog* cat, LibOpenReport* report) {
+    FILE* file = fopen(cat->user_path, "r");
+    report->user_file = file != NULL;
+    report->users = 0;
+    if (file == NULL) {
+        log_message(LOG_INFO, "Using default admin account");
+        return;
+    }
+
+    // One streaming pass straight into the table; the default admin is
+    // only kept when the file has no users
+    char line[256];
+    int loaded = 0;
+    userClear(cat);
+
+    while (fgets(line, sizeof(line), file)) {
+        char* rest;
+        char* username = strtok_r(line, "|", &rest);
+        char* hash = strtok_r(NULL, "|", &rest);
+        char* is_admin = strtok_r(NULL, "|", &rest);
+        char* full_name = strtok_r(NULL, "|", &rest);
+        if (username == NULL || username[0] == '\n' || userFind(cat, username) != NULL) continue;
+        if (full_name) full_name[strcspn(full_name, "\n")] = 0;
+
+        if (userAdd(cat, username, hash ? strtoul(hash, NULL, 10) : 0,
+                    is_admin ? atoi(is_admin) : 0, full_name ? full_name : "") == NULL) {
+            log_message(LOG_ERROR, "Out of memory loading users");
+            break;
+        }
+        loaded++;
+    }
+
+    fclose(file);
+
+    if (loaded > 0) {
+        cat->users_saved = cat->user_count;
+        cat->users_first_dirty = cat->user_count;
+        report->users = cat->user_count;
+        log_message(LOG_INFO, "Users loaded from file");
+    } else {
+        initializeDefaultAdmin(cat);
+        log_message(LOG_INFO, "Using default admin account");
+    }
+}
+
+// Adds, removes and whole-catalog work take the catalog lock; issues and
+// returns take only the book's shard lock. Locks are taken catalog first,
+// then shards in ascending order. Leaving the catalog lock is when memory
+// a change retired gets a chance to be released.
+//
+// A reader that found no free epoch slot holds the catalog lock for its
+// whole read section (see readBegin). Lazy index builds inside that
+// section lock again; on that thread those calls only count nesting.
+static void catalogLock(LibCatalog* cat) {
+    if (read_locked == cat) {
+        read_lock_depth++;
+        return;
+    }
+    pthread_mutex_lock(&cat->write_lock);
+}
+
+static void catalogUnlock(LibCatalog* cat) {
+    if (read_locked == cat) {
+        read_lock_depth--;
+        return;
+    }
+    if (cat->epoch.retired_count >= EPOCH_COLLECT_BATCH) {
+        epochCollect(cat);
+    }
+    pthread_mutex_unlock(&cat->write_lock);
+}
+
+static void shardLock(CatalogShard* shard) {
+    pthread_mutex_lock(&shard->lock);
+}
+
+static void shardUnlock(CatalogShard* shard) {
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Everything at once, for saves, imports and backups
+static void catalogLockAll(LibCatalog* cat) {
+    catalogLock(cat);
+    for (int i = 0; i < cat->shard_count; i++) {
+        shardLock(&cat->shards[i]);
+    }
+}
+
+static void catalogUnlockAll(LibCatalog* cat) {
+    for (int i = cat->shard_count - 1; i >= 0; i--) {
+        shardUnlock(&cat->shards[i]);
+    }
+    catalogUnlock(cat);
+}
+
+// Shard of a book ID: the top bits of its Fibonacci hash, as the ID index
+// inside the shard probes from the low bits
+static int shardIndex(const LibCatalog* cat, int id) {
+    if (cat->shard_bits == 0) return 0;
+    return (int)(((unsigned int)id * 2654435769u) >> (32 - cat->shard_bits));
+}
+
+static CatalogShard* shardFor(LibCatalog* cat, int id) {
+    return &cat->shards[shardIndex(cat, id)];
+}
+
+// Slab holding a book's hot columns, in its shard's pool
+static BookSlab* bookSlab(LibCatalog* cat, const Book* book) {
+    return shardFor(cat, book->id)->pool.slabs[book->slot / SLAB_BOOKS];
+}
+
+void libConfigureShards(int shards) {
+    shard_setting = shards;
+}
+
+// Claim an epoch slot for a reader. Returns the slot, or -1 when every
+// slot stays taken. Threads start looking at a slot derived from their
+// stack address so they rarely compete for one.
+static int epochPin(LibCatalog* cat) {
+    EpochState* epoch = &cat->epoch;
+    uintptr_t start = ((uintptr_t)&epoch >> 12) * 2654435761u;
+
+    for (int round = 0; round < EPOCH_PIN_ROUNDS; round++) {
+        for (size_t i = 0; i < EPOCH_SLOTS; i++) {
+            size_t slot = (size_t)((start + i) % EPOCH_SLOTS);
+            uint64_t state = 0;
+            if (__atomic_load_n(&epoch->slots[slot].state, __ATOMIC_RELAXED) != 0) continue;
+
+            uint64_t current = __atomic_load_n(&epoch->global, __ATOMIC_SEQ_CST);
+            if (!__atomic_compare_exchange_n(&epoch->slots[slot].state, &state, (current << 1) | 1, 0,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                continue;
+            }
+
+            // A writer may have moved the epoch before the pin was visible;
+            // announce the epoch current after it, as pointers are only
+            // loaded from here on
+            uint64_t now;
+            while ((now = __atomic_load_n(&epoch->global, __ATOMIC_SEQ_CST)) != current) {
+                current = now;
+                __atomic_store_n(&epoch->slots[slot].state, (current << 1) | 1, __ATOMIC_SEQ_CST);
+            }
+            return (int)slot;
+        }
+        sched_yield();
+    }
+    return -1;
+}
+
+static void epochUnpin(LibCatalog* cat, int slot) {
+    __atomic_store_n(&cat->epoch.slots[slot].state, 0, __ATOMIC_RELEASE);
+}
+
+// Hand memory a writer has unlinked to the reclaimer. Without room to
+// track it, it is leaked rather than freed under a reader.
+static void epochRetire(LibCatalog* cat, void* ptr, ReleaseFn release) {
+    EpochState* epoch = &cat->epoch;
+    if (ptr == NULL) return;
+
+    if (epoch->retired_count == epoch->retired_capacity) {
+        size_t capacity = epoch->retired_capacity ? epoch->retired_capacity * 2 : 64;
+        Retired* retired = (Retired*)realloc(epoch->retired, capacity * sizeof(Retired));
+        if (retired == NULL) {
+            log_message(LOG_WARNING, "Cannot track retired memory, leaking it");
+            return;
+        }
+        epoch->retired = retired;
+        epoch->retired_capacity = capacity;
+    }
+
+    Retired entry = {ptr, release, __atomic_load_n(&epoch->global, __ATOMIC_SEQ_CST)};
+    epoch->retired[epoch->retired_count++] = entry;
+}
+
+static void epochRelease(LibCatalog* cat, const Retired* entry) {
+    if (entry->release != NULL) {
+        entry->release(cat, entry->ptr);
+    } else {
+        free(entry->ptr);
+    }
+}
+
+// Move the epoch on as far as pinned readers allow (twice is all it takes
+// to release everything retired so far) and release what no reader can
+// reach any more. Writers only.
+static void epochCollect(LibCatalog* cat) {
+    EpochState* epoch = &cat->epoch;
+
+    for (int step = 0; step < 2; step++) {
+        uint64_t current = __atomic_load_n(&epoch->global, __ATOMIC_SEQ_CST);
+        int behind = 0;
+        for (size_t i = 0; i < EPOCH_SLOTS && !behind; i++) {
+            uint64_t state = __atomic_load_n(&epoch->slots[i].state, __ATOMIC_SEQ_CST);
+            behind = (state & 1) && (state >> 1) != current;
+        }
+        if (behind) break;
+        __atomic_store_n(&epoch->global, current + 1, __ATOMIC_SEQ_CST);
+    }
+
+    uint64_t current = epoch->global;
+    size_t kept = 0;
+    for (size_t i = 0; i < epoch->retired_count; i++) {
+        if (epoch->retired[i].epoch + 2 <= current) {
+            epochRelease(cat, &epoch->retired[i]);
+        } else {
+            epoch->retired[kept++] = epoch->retired[i];
+        }
+    }
+    epoch->retired_count = kept;
+}
+
+// Release everything retired; only when no reader can be active
+static void epochDrain(LibCatalog* cat) {
+    for (size_t i = 0; i < cat->epoch.retired_count; i++) {
+        epochRelease(cat, &cat->epoch.retired[i]);
+    }
+    cat->epoch.retired_count = 0;
+}
+
+// Readers pin the epoch; when no slot is free they take the catalog lock
+// instead, which keeps away every writer that unlinks anything. The
+// thread remembers it holds the lock, so that nested catalogLock calls
+// do not deadlock on it.
+static int readBegin(LibCatalog* cat) {
+    int pin = epochPin(cat);
+    if (pin < 0) {
+        catalogLock(cat);
+        if (read_locked == NULL) {
+            read_locked = cat;
+            read_lock_depth = 0;
+        }
+    }
+    return pin;
+}
+
+static void readEnd(LibCatalog* cat, int pin) {
+    if (pin < 0) {
+        if (read_locked == cat && read_lock_depth == 0) {
+            read_locked = NULL;
+        }
+        catalogUnlock(cat);
+    } else {
+        epochUnpin(cat, pin);
+    }
+}
+
+// Sequence counts: odd while a writer is changing what they guard, so a
+// reader that saw the same even count before and after its copy knows the
+// copy is consistent
+static void seqWriteBegin(unsigned int* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void seqWriteEnd(unsigned int* seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+// Public view of a book record. A copy that overlapped a loan change is
+// taken again, so callers never see a half-issued book.
+static void copyBook(LibBook* out, const Book* book) {
+    for (;;) {
+        unsigned int seq = __atomic_load_n(&book->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+
+        out->id = book->id;
+        memcpy(out->title, book->title, MAX_STR);
+        memcpy(out->author, book->author, MAX_STR);
+        memcpy(out->isbn, book->isbn, sizeof(out->isbn));
+        out->year = book->year;
+        out->is_issued = book->is_issued;
+        memcpy(out->issued_to, book->issued_to, MAX_BORROWER_NAME);
+        out->issue_date = book->issue_date;
+        out->due_date = book->due_date;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&book->seq, __ATOMIC_RELAXED) == seq) return;
+    }
+}
+
+int libBookCount(LibCatalog* cat) {
+    return __atomic_load_n(&cat->book_count, __ATOMIC_RELAXED);
+}
+
+LibStatus libGetBook(LibCatalog* cat, int id, LibBook* book) {
+    int pin = readBegin(cat);
+    Book* found = searchBook(cat, id);
+    if (found != NULL) {
+        copyBook(book, found);
+    }
+    readEnd(cat, pin);
+    return found != NULL ? LIB_OK : LIB_ERR_NOT_FOUND;
+}
+
+// Checked catalog operations: validate, apply, journal and log. Adds and
+// removes run under the catalog lock and take the book's shard lock for
+// the change itself; issues and returns run under the shard lock alone.
+// The journal record is queued before the shard lock is dropped, so
+// records of one book are always in the order they were applied.
+static LibStatus checkedAddBook(LibCatalog* cat, const char* title, const char* author, const char* isbn,
+                                int year, LibBook* book) {
+    if (title[0] == '\0' || author[0] == '\0' || year < 1000 || year > 2100) {
+        return LIB_ERR_INVALID;
+    }
+
+    // Check if book with same title or ISBN already exists
+    Book* found;
+    if ((found = searchBookByTitle(cat, (char*)title)) != NULL) {
+        copyBook(book, found);
+        return LIB_ERR_DUPLICATE_TITLE;
+    }
+    if ((found = searchBookByISBN(cat, (char*)isbn)) != NULL) {
+        copyBook(book, found);
+        return LIB_ERR_DUPLICATE_ISBN;
+    }
+
+    CatalogShard* shard = shardFor(cat, cat->next_id);
+    shardLock(shard);
+    found = catalogAddBook(cat, cat->next_id, title, author, isbn, year);
+    if (found != NULL) {
+        journalAddBook(cat, found);
+        copyBook(book, found);
+    }
+    shardUnlock(shard);
+    if (found == NULL) {
+        log_message(LOG_ERROR, "Memory allocation failed for new book");
+        return LIB_ERR_NO_MEMORY;
+    }
+    log_message(LOG_INFO, "Book added to library");
+    return LIB_OK;
+}
+
+static LibStatus checkedRemoveBook(LibCatalog* cat, int id) {
+    Book* book = searchBook(cat, id);
+    if (book == NULL) {
+        return LIB_ERR_NOT_FOUND;
+    }
+
+    CatalogShard* shard = shardFor(cat, id);
+    shardLock(shard);
+    int issued = book->is_issued;
+    if (!issued) {
+        journalRemoveBook(cat, book->id);
+        catalogRemoveBook(cat, book);
+    }
+    shardUnlock(shard);
+    if (issued) {
+        return LIB_ERR_ISSUED;
+    }
+    log_message(LOG_INFO, "Book removed from library");
+    return LIB_OK;
+}
+
+static LibStatus checkedIssueBook(LibCatalog* cat, int id, const char* borrower, int days, LibBook* book) {
+    Book* found = searchBook(cat, id);
+    if (found == NULL) {
+        return LIB_ERR_NOT_FOUND;
+    }
+    if (found->is_issued) {
+        copyBook(book, found);
+        return LIB_ERR_ISSUED;
+    }
+    if (borrower[0] == '\0' || days < 1 || days > 365) {
+        return LIB_ERR_INVALID;
+    }
+
+    time_t issue_date = time(NULL);
+    catalogIssueBook(cat, found, borrower, issue_date, issue_date + (days * 24 * 60 * 60));
+    journalIssueBook(cat, found);
+    copyBook(book, found);
+    log_message(LOG_INFO, "Book issued");
+    return LIB_OK;
+}
+
+static LibStatus checkedReturnBook(LibCatalog* cat, int id, double* fine, LibBook* book) {
+    Book* found = searchBook(cat, id);
+    if (found == NULL) {
+        return LIB_ERR_NOT_FOUND;
+    }
+    if (!found->is_issued) {
+        return LIB_ERR_NOT_ISSUED;
+    }
+
+    copyBook(book, found);
+    *fine = calculateFine(found);
+    catalogReturnBook(cat, found);
+    journalReturnBook(cat, found->id);
+    log_message(LOG_INFO, "Book returned");
+    return LIB_OK;
+}
+
+LibStatus libAddBook(LibCatalog* cat, const char* title, const char* author, const char* isbn,
+                     int year, LibBook* book) {
+    catalogLock(cat);
+    LibStatus status = checkedAddBook(cat, title, author, isbn, year, book);
+    catalogUnlock(cat);
+    return status;
+}
+
+LibStatus libRemoveBook(LibCatalog* cat, int id) {
+    catalogLock(cat);
+    LibStatus status = checkedRemoveBook(cat, id);
+    catalogUnlock(cat);
+    return status;
+}
+
+LibStatus libIssueBook(LibCatalog* cat, int id, const char* borrower, int days, LibBook* book) {
+    CatalogShard* shard = shardFor(cat, id);
+    shardLock(shard);
+    LibStatus status = checkedIssueBook(cat, id, borrower, days, book);
+    shardUnlock(shard);
+    return status;
+}
+
+LibStatus libReturnBook(LibCatalog* cat, int id, double* fine, LibBook* book) {
+    CatalogShard* shard = shardFor(cat, id);
+    shardLock(shard);
+    LibStatus status = checkedReturnBook(cat, id, fine, book);
+    shardUnlock(shard);
+    return status;
+}
+
+const char* libStatusMessage(LibStatus status) {
+    switch (status) {
+        case LIB_OK: return "ok";
+        case LIB_ERR_INVALID: return "invalid argument";
+        case LIB_ERR_NOT_FOUND: return "book not found";
+        case LIB_ERR_DUPLICATE_TITLE: return "title already exists";
+        case LIB_ERR_DUPLICATE_ISBN: return "ISBN already exists";
+        case LIB_ERR_ISSUED: return "book is issued";
+        case LIB_ERR_NOT_ISSUED: return "book is not issued";
+        case LIB_ERR_NO_MEMORY: return "out of memory";
+        case LIB_ERR_DUPLICATE_USER: return "username already exists";
+        case LIB_ERR_AUTH: return "invalid username or password";
+        case LIB_ERR_IO: return "file error";
+        case LIB_ERR_CORRUPT: return "data file is corrupt";
+        case LIB_ERR_BUSY: return "too many concurrent readers, try again";
+    }
+    return "unknown error";
+}
+
+static double calculateFine(Book* book) {
+    if (!book->is_issued) return 0.0;
+    return calculateFineAt(book->due_date, time(NULL));
+}
+
+double calculateFineAt(time_t due_date, time_t now) {
+    double days_overdue = difftime(now, due_date) / (24 * 60 * 60);
+
+    if (days_overdue > 0) {
+        return days_overdue * FINE_PER_DAY;
+    }
+    return 0.0;
+}
+
+static char* strcasestr_custom(const char* haystack, const char* needle) {
+    if (!*needle) return (char*)haystack;
+
+    for (; *haystack; haystack++) {
+        const char* h = haystack;
+        const char* n = needle;
+
+        while (*h && *n && (tolower((unsigned char)*h) == tolower((unsigned char)*n))) {
+            h++;
+            n++;
+        }
+
+        if (!*n) return (char*)haystack;
+    }
+
+    return NULL;
+}
+
+// Lower-case `src` into `dest` including its terminator, returns the number
+// of bytes written (strlen + 1)
+static size_t foldSearchText(char* dest, const char* src, size_t dest_size) {
+    size_t i = 0;
+    while (src[i] && i + 1 < dest_size) {
+        dest[i] = (char)tolower((unsigned char)src[i]);
+        i++;
+    }
+    dest[i] = '\0';
+    return i + 1;
+}
+
+// Substring kernels over folded, zero-padded search text. The needle is
+// already folded and non-empty. The vector versions compare the needle's
+// first and last byte against a whole block of candidate positions at once
+// and only run memcmp on positions where both match; the padding after
+// each search text keeps their block loads inside the row.
+typedef int (*SearchKernel)(const char* text, size_t text_len,
+                            const char* needle, size_t needle_len);
+
+static int searchKernelScalar(const char* text, size_t text_len,
+                              const char* needle, size_t needle_len) {
+    if (needle_len > text_len) return 0;
+
+    const char* end = text + text_len - needle_len + 1;
+    const char* p = text;
+    while (p < end && (p = (const char*)memchr(p, needle[0], end - p)) != NULL) {
+        if (p[needle_len - 1] == needle[needle_len - 1] &&
+            memcmp(p + 1, needle + 1, needle_len - 1) == 0) {
+            return 1;
+        }
+        p++;
+    }
+    return 0;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_SIMD_SEARCH 1
+
+__attribute__((target("sse2")))
+static int searchKernelSSE2(const char* text, size_t text_len,
+                            const char* needle, size_t needle_len) {
+    if (needle_len > text_len) return 0;
+
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_len - 1]);
+    size_t limit = text_len - needle_len;
+
+    for (size_t i = 0; i <= limit; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(text + i + needle_len - 1));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                          _mm_cmpeq_epi8(last, block_last)));
+
+        while (mask != 0) {
+            size_t pos = i + (size_t)__builtin_ctz(mask);
+            if (pos <= limit && memcmp(text + pos + 1, needle + 1, needle_len - 1) == 0) {
+                return 1;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return 0;
+}
+
+__attribute__((target("avx2")))
+static int searchKernelAVX2(const char* text, size_t text_len,
+                            const char* needle, size_t needle_len) {
+    if (needle_len > text_len) return 0;
+
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_len - 1]);
+    size_t limit = text_len - needle_len;
+
+    for (size_t i = 0; i <= limit; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(text + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(text + i + needle_len - 1));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                             _mm256_cmpeq_epi8(last, block_last)));
+
+        while (mask != 0) {
+            size_t pos = i + (size_t)__builtin_ctz(mask);
+            if (pos <= limit && memcmp(text + pos + 1, needle + 1, needle_len - 1) == 0) {
+                return 1;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return 0;
+}
+#endif
+
+static SearchKernel search_kernel = searchKernelScalar;
+static const char* search_kernel_name = "scalar";
+static pthread_once_t search_kernel_once = PTHREAD_ONCE_INIT;
+
+static void selectSearchKernel() {
+    search_kernel = searchKernelScalar;
+    search_kernel_name = "scalar";
+#ifdef HAVE_SIMD_SEARCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        search_kernel = searchKernelAVX2;
+        search_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        search_kernel = searchKernelSSE2;
+        search_kernel_name = "sse2";
+    }
+#endif
+}
+
+// Pick the widest kernel the CPU supports. Runs once, when the first
+// catalog is created; every search happens on a catalog, after that.
+static void initSearchKernel() {
+    pthread_once(&search_kernel_once, selectSearchKernel);
+}
+
+static double elapsedMs(clock_t start) {
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+// Fill the catalog with `books` synthetic records; returns how many fit
+static int benchmarkCatalog(LibCatalog* cat, FILE* out, int books) {
+    static const char* words[] = {
+        "History", "Modern", "Science", "Garden", "Ocean", "Silent", "Empire",
+        "Journey", "Winter", "Shadow", "Algorithms", "Letters", "River", "Stone"
+    };
+    int word_count = (int)(sizeof(words) / sizeof(words[0]));
+
+    srand(42);
+    for (int i = 0; i < books; i++) {
+        char title[MAX_STR], author[MAX_STR], isbn[20];
+        snprintf(title, sizeof(title), "The %s %s of the %s %s Vol %d",
+                 words[rand() % word_count], words[rand() % word_count],
+                 words[rand() % word_count], words[rand() % word_count], i % 50);
+        snprintf(author, sizeof(author), "%s Smith-%s",
+                 words[rand() % word_count], words[rand() % word_count]);
+        snprintf(isbn, sizeof(isbn), "978-%d-%06d", rand() % 10, i);
+
+        Book* book = createBook(cat, i + 1, title, author, isbn, 1900 + i % 120);
+        if (book == NULL) {
+            fprintf(out, "Out of memory after %d books\n", i);
+            return i;
+        }
+        insertBook(cat, book);
+    }
+    return books;
+}
+
+// Microbenchmark: brute-force scan of a synthetic catalog with the old
+// strcasestr_custom matcher against each search kernel
+void benchmarkSearch(FILE* out, int books) {
+    static const char* queries[] = {"ocean", "ALGORITHMS OF", "mith", "978-1", "zzz"};
+    int query_count = (int)(sizeof(queries) / sizeof(queries[0]));
+
+    LibCatalog* cat = libCreate();
+    if (cat == NULL) return;
+    if (books <= 0) books = 200000;
+    books = benchmarkCatalog(cat, out, books);
+
+    initSearchKernel();
+    fprintf(out, "Search benchmark: %d books, kernel %s\n\n", books, search_kernel_name);
+    fprintf(out, "%-16s %10s %12s %12s %12s %9s\n",
+            "Query", "Matches", "strcasestr", "scalar", search_kernel_name, "Speedup");
+
+    for (int q = 0; q < query_count; q++) {
+        char folded[MAX_STR];
+        size_t len = foldSearchText(folded, queries[q], MAX_STR) - 1;
+        int baseline_hits = 0, scalar_hits = 0, simd_hits = 0;
+
+        clock_t start = clock();
+        for (Book* b = cat->head; b != NULL; b = b->next) {
+            if (strcasestr_custom(b->title, queries[q]) ||
+                strcasestr_custom(b->author, queries[q]) ||
+                strcasestr_custom(b->isbn, queries[q])) {
+                baseline_hits++;
+            }
+        }
+        double baseline_ms = elapsedMs(start);
+
+        start = clock();
+        for (Book* b = cat->head; b != NULL; b = b->next) {
+            const BookSlab* slab = bookSlab(cat, b);
+            int slot = b->slot % SLAB_BOOKS;
+            scalar_hits += searchKernelScalar(slab->search_text[slot], slab->search_len[slot],
+                                              folded, len);
+        }
+        double scalar_ms = elapsedMs(start);
+
+        start = clock();
+        for (Book* b = cat->head; b != NULL; b = b->next) {
+            simd_hits += bookMatchesQuery(cat, b, folded, len);
+        }
+        double simd_ms = elapsedMs(start);
+
+        fprintf(out, "%-16s %10d %10.1fms %10.1fms %10.1fms %8.1fx%s\n",
+                queries[q], baseline_hits, baseline_ms, scalar_ms, simd_ms,
+                simd_ms > 0 ? baseline_ms / simd_ms : 0.0,
+                (scalar_hits != baseline_hits || simd_hits != baseline_hits) ? "  MISMATCH" : "");
+    }
+
+    libClose(cat);
+}
+
+static unsigned int packTrigram(const char* s) {
+    return ((unsigned int)(unsigned char)tolower((unsigned char)s[0]) << 16) |
+           ((unsigned int)(unsigned char)tolower((unsigned char)s[1]) << 8) |
+           (unsigned int)(unsigned char)tolower((unsigned char)s[2]);
+}
+
+static int compareTrigrams(const void* a, const void* b) {
+    unsigned int x = *(const unsigned int*)a;
+    unsigned int y = *(const unsigned int*)b;
+    return (x > y) - (x < y);
+}
+
+static int compareInts(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// Collect the distinct trigrams of `str` into `out` (sorted), returns count
+static int collectTrigrams(const char* str, unsigned int* out, int count) {
+    size_t len = strlen(str);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        out[count++] = packTrigram(str + i);
+    }
+    return count;
+}
+
+static int uniqueTrigrams(unsigned int* grams, int count) {
+    int unique = 0;
+    qsort(grams, count, sizeof(unsigned int), compareTrigrams);
+    for (int i = 0; i < count; i++) {
+        if (unique == 0 || grams[unique - 1] != grams[i]) {
+            grams[unique++] = grams[i];
+        }
+    }
+    return unique;
+}
+
+static int bookTrigrams(const Book* book, unsigned int* out) {
+    int count = collectTrigrams(book->title, out, 0);
+    count = collectTrigrams(book->author, out, count);
+    count = collectTrigrams(book->isbn, out, count);
+    return uniqueTrigrams(out, count);
+}
+
+static size_t trigramSlot(size_t capacity, unsigned int trigram) {
+    return (size_t)(trigram * 2654435769u) & (capacity - 1);
+}
+
+static Posting* trigramFind(PostingTable* table, unsigned int trigram) {
+    if (table == NULL) return NULL;
+
+    size_t pos = trigramSlot(table->capacity, trigram);
+    unsigned int found;
+    while ((found = __atomic_load_n(&table->slots[pos].trigram, __ATOMIC_ACQUIRE)) != 0) {
+        if (found == trigram) {
+            return &table->slots[pos];
+        }
+        pos = (pos + 1) & (table->capacity - 1);
+    }
+    return NULL;
+}
+
+// Searches may still be reading the old table, so it is retired rather
+// than freed; its posting lists now belong to the new one
+static int trigramGrow(LibCatalog* cat, TrigramIndex* index) {
+    PostingTable* old = index->table;
+    size_t capacity = old != NULL ? old->capacity * 2 : 4096;
+    PostingTable* table = (PostingTable*)calloc(1, sizeof(PostingTable) + capacity * sizeof(Posting));
+    if (table == NULL) {
+        return 0;
+    }
+    table->capacity = capacity;
+
+    for (size_t i = 0; old != NULL && i < old->capacity; i++) {
+        if (old->slots[i].trigram == 0) continue;
+        size_t pos = trigramSlot(capacity, old->slots[i].trigram);
+        while (table->slots[pos].trigram != 0) {
+            pos = (pos + 1) & (capacity - 1);
+        }
+        table->slots[pos] = old->slots[i];
+    }
+
+    __atomic_store_n(&index->table, table, __ATOMIC_RELEASE);
+    epochRetire(cat, old, NULL);
+    return 1;
+}
+
+static Posting* trigramFindOrCreate(LibCatalog* cat, TrigramIndex* index, unsigned int trigram) {
+    Posting* posting = trigramFind(index->table, trigram);
+    if (posting != NULL) {
+        return posting;
+    }
+
+    if ((index->used + 1) * 2 > (index->table != NULL ? index->table->capacity : 0) &&
+        !trigramGrow(cat, index)) {
+        return NULL;
+    }
+
+    PostingTable* table = index->table;
+    size_t pos = trigramSlot(table->capacity, trigram);
+    while (table->slots[pos].trigram != 0) {
+        pos = (pos + 1) & (table->capacity - 1);
+    }
+    posting = &table->slots[pos];
+    // The slot has no list yet; storing the trigram makes it visible
+    __atomic_store_n(&posting->trigram, trigram, __ATOMIC_RELEASE);
+    index->used++;
+    return posting;
+}
+
+// Add `id` to a posting list. A list searches may be reading is only
+// changed in place by appending past its count; a full list, or an ID
+// that belongs in the middle, gets a new list published in one store.
+// An index still being built (`shared` 0) just appends and is sorted once
+// at the end.
+static int postingAppend(LibCatalog* cat, Posting* posting, int id, int shared) {
+    PostingList* list = posting->list;
+    int count = list != NULL ? list->count : 0;
+    int at = count;
+
+    if (shared) {
+        while (at > 0 && list->ids[at - 1] > id) {
+            at--;
+        }
+    }
+
+    if (list == NULL || count == list->capacity || at < count) {
+        int capacity = list == NULL ? 4 : (count == list->capacity ? list->capacity * 2 : list->capacity);
+        PostingList* copy = (PostingList*)malloc(sizeof(PostingList) + capacity * sizeof(int));
+        if (copy == NULL) {
+            return 0;
+        }
+        copy->capacity = capacity;
+        copy->count = count + 1;
+        if (count > 0) {
+            memcpy(copy->ids, list->ids, at * sizeof(int));
+            memcpy(copy->ids + at + 1, list->ids + at, (count - at) * sizeof(int));
+        }
+        copy->ids[at] = id;
+        __atomic_store_n(&posting->list, copy, __ATOMIC_RELEASE);
+        epochRetire(cat, list, NULL);
+        return 1;
+    }
+
+    list->ids[count] = id;
+    __atomic_store_n(&list->count, count + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int trigramAdd(LibCatalog* cat, TrigramIndex* index, const Book* book) {
+    unsigned int grams[MAX_BOOK_TRIGRAMS];
+    int count = bookTrigrams(book, grams);
+
+    for (int i = 0; i < count; i++) {
+        Posting* posting = trigramFindOrCreate(cat, index, grams[i]);
+        if (posting == NULL || !postingAppend(cat, posting, book->id, index->built)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Removal is lazy: queries re-check every candidate against the ID index,
+// so stale IDs are harmless. Once they outnumber live books the index is
+// dropped and rebuilt by the next search.
+static void trigramRemove(LibCatalog* cat, TrigramIndex* index, const Book* book) {
+    (void)book;
+    if (!index->built) return;
+
+    index->stale++;
+    if (index->stale > (size_t)cat->book_count) {
+        trigramClear(cat, index);
+    }
+}
+
+static void releasePostingTable(LibCatalog* cat, void* ptr) {
+    PostingTable* table = (PostingTable*)ptr;
+    (void)cat;
+    for (size_t i = 0; i < table->capacity; i++) {
+        free(table->slots[i].list);
+    }
+    free(table);
+}
+
+static void trigramClear(LibCatalog* cat, TrigramIndex* index) {
+    PostingTable* table = index->table;
+    __atomic_store_n(&index->built, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&index->table, NULL, __ATOMIC_RELEASE);
+    index->used = 0;
+    index->stale = 0;
+    epochRetire(cat, table, releasePostingTable);
+}
+
+// The index is built privately and published whole, table first, so a
+// search that sees it built always finds a table (maybe an empty one)
+static int trigramBuild(LibCatalog* cat, TrigramIndex* index) {
+    TrigramIndex fresh = {NULL, 0, 0, 0};
+
+    trigramClear(cat, index);
+    for (Book* current = cat->head; current != NULL; current = current->next) {
+        if (!trigramAdd(cat, &fresh, current)) {
+            trigramClear(cat, &fresh);
+            log_message(LOG_WARNING, "Trigram index allocation failed");
+            return 0;
+        }
+    }
+    if (fresh.table == NULL && !trigramGrow(cat, &fresh)) {
+        log_message(LOG_WARNING, "Trigram index allocation failed");
+        return 0;
+    }
+
+    // Lists were filled in catalog order
+    for (size_t i = 0; i < fresh.table->capacity; i++) {
+        PostingList* list = fresh.table->slots[i].list;
+        if (list != NULL) {
+            qsort(list->ids, list->count, sizeof(int), compareInts);
+        }
+    }
+
+    index->used = fresh.used;
+    __atomic_store_n(&index->table, fresh.table, __ATOMIC_RELEASE);
+    __atomic_store_n(&index->built, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// `folded` must already be lower-cased (see foldSearchText)
+static int bookMatchesQuery(LibCatalog* cat, const Book* book, const char* folded, size_t len) {
+    const BookSlab* slab = bookSlab(cat, book);
+    int slot = book->slot % SLAB_BOOKS;
+    return search_kernel(slab->search_text[slot], slab->search_len[slot], folded, len);
+}
+
+// A posting list as one search saw it: the count is read once, and
+// writers never change IDs below it
+typedef struct {
+    const int* ids;
+    int count;
+} PostingView;
+
+static int comparePostingSize(const void* a, const void* b) {
+    const PostingView* x = (const PostingView*)a;
+    const PostingView* y = (const PostingView*)b;
+    return (x->count > y->count) - (x->count < y->count);
+}
+
+// Intersect the sorted ID lists `a` (in place) and `b`, returns new length
+static int intersectIds(int* a, int a_count, const int* b, int b_count) {
+    int i = 0, j = 0, n = 0;
+    while (i < a_count && j < b_count) {
+        if (a[i] < b[j]) {
+            i++;
+        } else if (a[i] > b[j]) {
+            j++;
+        } else {
+            if (n == 0 || a[n - 1] != a[i]) {
+                a[n++] = a[i];
+            }
+            i++;
+            j++;
+        }
+    }
+    return n;
+}
+
+// Candidate IDs for `folded`, a query already folded and cut to fit
+// MAX_STR, from the trigram index, or -1 when the query is too short to
+// be answered by trigrams. Caller frees *ids when the count is positive.
+static int trigramCandidates(LibCatalog* cat, TrigramIndex* index, const char* folded, size_t len, int** ids) {
+    int gram_count;
+
+    *ids = NULL;
+    if (len < 3 || len >= MAX_STR) return -1;
+    unsigned int grams[len - 2];    // one per starting position
+    PostingView lists[len - 2];
+    if (!__atomic_load_n(&index->built, __ATOMIC_ACQUIRE)) {
+        // The first search builds the index, under the catalog lock
+        catalogLock(cat);
+        if (!index->built) {
+            trigramBuild(cat, index);
+        }
+        catalogUnlock(cat);
+    }
+
+    // NULL when the index was dropped meanwhile (or could not be built)
+    PostingTable* table = __atomic_load_n(&index->table, __ATOMIC_ACQUIRE);
+    if (table == NULL) return -1;
+
+    gram_count = uniqueTrigrams(grams, collectTrigrams(folded, grams, 0));
+    for (int i = 0; i < gram_count; i++) {
+        Posting* posting = trigramFind(table, grams[i]);
+        PostingList* list = posting != NULL ? __atomic_load_n(&posting->list, __ATOMIC_ACQUIRE) : NULL;
+        if (list == NULL) {
+            return 0;
+        }
+        lists[i].count = __atomic_load_n(&list->count, __ATOMIC_ACQUIRE);
+        lists[i].ids = list->ids;
+    }
+
+    // Start from the shortest list and narrow it by the others
+    qsort(lists, gram_count, sizeof(PostingView), comparePostingSize);
+    int* result = (int*)malloc((lists[0].count > 0 ? lists[0].count : 1) * sizeof(int));
+    if (result == NULL) return -1;
+
+    memcpy(result, lists[0].ids, lists[0].count * sizeof(int));
+    int count = lists[0].count;
+    for (int i = 1; i < gram_count && count > 0; i++) {
+        count = intersectIds(result, count, lists[i].ids, lists[i].count);
+    }
+    if (count == 0) {
+        free(result);
+        return 0;
+    }
+
+    *ids = result;
+    return count;
+}
+
+// A fan-out scan: the live books whose search text holds `folded` or,
+// without a query, whose status passes `filter`. The slabs of every shard
+// are numbered one after another and scanned in parts on the pool; each
+// part collects its matches in a ScanPart.
+typedef struct {
+    LibCatalog* cat;
+    StatusFilter filter;
+    const char* folded;
+    size_t len;
+    BookSlab** slabs[MAX_SHARDS];
+    size_t first[MAX_SHARDS + 1];   // number of the first slab of each shard
+} ScanJob;
+
+typedef struct {
+    Book** rows;
+    size_t count;
+    size_t capacity;
+    int failed;
+} ScanPart;
+
+static void scanSlabs(void* arg, size_t begin, size_t end, void* partial) {
+    ScanJob* job = (ScanJob*)arg;
+    ScanPart* part = (ScanPart*)partial;
+    int s = 0;
+
+    for (size_t n = begin; n < end && !part->failed; n++) {
+        while (job->first[s + 1] <= n) s++;
+        BookSlab* slab = job->slabs[s][n - job->first[s]];
+
+        for (size_t i = 0; i < SLAB_BOOKS; i++) {
+            if (!__atomic_load_n(&slab->live[i], __ATOMIC_ACQUIRE)) continue;
+            if (job->folded != NULL) {
+                if (!search_kernel(slab->search_text[i], slab->search_len[i], job->folded, job->len)) continue;
+            } else if (__atomic_load_n(&slab->is_issued[i], __ATOMIC_RELAXED) != (job->filter == FILTER_ISSUED)) {
+                continue;
+            }
+
+            if (part->count == part->capacity) {
+                size_t capacity = part->capacity ? part->capacity * 2 : 256;
+                Book** rows = (Book**)realloc(part->rows, capacity * sizeof(Book*));
+                if (rows == NULL) {
+                    part->failed = 1;
+                    break;
+                }
+                part->rows = rows;
+                part->capacity = capacity;
+            }
+            part->rows[part->count++] = &slab->books[i];
+        }
+    }
+}
+
+// Append one part's matches to the whole scan's, in slab order
+static void mergeScan(void* arg, void* result, void* partial) {
+    ScanPart* all = (ScanPart*)result;
+    ScanPart* part = (ScanPart*)partial;
+    (void)arg;
+
+    if (!all->failed && !part->failed && all->count + part->count > all->capacity) {
+        size_t capacity = all->count + part->count;
+        if (capacity < all->capacity * 2) capacity = all->capacity * 2;
+        Book** rows = (Book**)realloc(all->rows, capacity * sizeof(Book*));
+        if (rows == NULL) {
+            all->failed = 1;
+        } else {
+            all->rows = rows;
+            all->capacity = capacity;
+        }
+    }
+    all->failed |= part->failed;
+    if (!all->failed && part->count > 0) {
+        memcpy(all->rows + all->count, part->rows, part->count * sizeof(Book*));
+        all->count += part->count;
+    }
+    free(part->rows);
+}
+
+static int compareCatalogOrder(const void* a, const void* b) {
+    uint64_t x = (*(Book* const*)a)->order;
+    uint64_t y = (*(Book* const*)b)->order;
+    return (x > y) - (x < y);
+}
+
+// Scan the hot columns of every shard, in parts on the worker pool in
+// large catalogs, and merge the matches into catalog order. Returns a
+// malloc'd array of *count books, or NULL when out of memory. The caller
+// holds an epoch pin, which covers the pool threads too.
+static Book** scanShards(LibCatalog* cat, StatusFilter filter, const char* folded, size_t len, size_t* count) {
+    ScanJob job;
+    job.cat = cat;
+    job.filter = filter;
+    job.folded = folded;
+    job.len = len;
+    job.first[0] = 0;
+    for (int s = 0; s < cat->shard_count; s++) {
+        BookPool* pool = &cat->shards[s].pool;
+        size_t slab_count = __atomic_load_n(&pool->slab_count, __ATOMIC_ACQUIRE);
+        job.slabs[s] = __atomic_load_n(&pool->slabs, __ATOMIC_ACQUIRE);
+        job.first[s + 1] = job.first[s] + slab_count;
+    }
+
+    size_t slabs = job.first[cat->shard_count];
+    size_t grain = libBookCount(cat) < PARALLEL_SCAN_MIN ? slabs : SCAN_GRAIN;
+    ScanPart all = {NULL, 0, 0, 0};
+    parallelReduce(slabs, grain, sizeof(ScanPart), scanSlabs, mergeScan, &job, &all);
+
+    if (all.failed) {
+        free(all.rows);
+        all.rows = NULL;
+    } else if (all.rows == NULL) {
+        all.rows = (Book**)malloc(sizeof(Book*));     // no matches
+    }
+    Book** rows = all.rows;
+    size_t total = all.count;
+
+    // Runs come out in slot order, which is catalog order until slots
+    // are reused
+    size_t sorted = 1;
+    while (rows != NULL && sorted < total && rows[sorted - 1]->order < rows[sorted]->order) {
+        sorted++;
+    }
+    if (rows != NULL && sorted < total) {
+        qsort(rows, total, sizeof(Book*), compareCatalogOrder);
+    }
+    *count = rows != NULL ? total : 0;
+    return rows;
+}
+
+// All books whose title, author or ISBN contains `query` (case-insensitive),
+// in catalog order.
+// Returns a malloc'd array the caller frees, or NULL with *count == 0.
+static Book** searchCatalog(LibCatalog* cat, const char* query, int* count) {
+    Book** results = NULL;
+    int* ids;
+    int found = 0;
+    char folded[MAX_STR];
+    size_t len = foldSearchText(folded, query, MAX_STR) - 1;
+    int candidates = trigramCandidates(cat, &cat->trigram_index, folded, len, &ids);
+
+    *count = 0;
+    if (candidates == 0) {
+        return NULL;
+    }
+
+    if (candidates > 0) {
+        // Indexed path: verify only the candidates, which come in ID
+        // order, then put the matches in catalog order like the scan
+        results = (Book**)malloc(candidates * sizeof(Book*));
+        if (results != NULL) {
+            for (int i = 0; i < candidates; i++) {
+                Book* book = searchBook(cat, ids[i]);
+                if (book != NULL && bookMatchesQuery(cat, book, folded, len)) {
+                    results[found++] = book;
+                }
+            }
+            qsort(results, (size_t)found, sizeof(Book*), compareCatalogOrder);
+        }
+        free(ids);
+    } else {
+        // Short query (or no index): scan every shard's search column
+        size_t matched;
+        results = scanShards(cat, FILTER_ALL, folded, len, &matched);
+        found = (int)matched;
+    }
+
+    if (found == 0) {
+        free(results);
+        return NULL;
+    }
+    *count = found;
+    return results;
+}
+
+// Empty result set with room for `capacity` rows. It pins the epoch, so
+// rows gathered after this stay valid until libResultsFree. A result set
+// may be freed on another thread, so it cannot fall back to the catalog
+// lock like other readers: when every epoch slot is taken the query
+// fails with LIB_ERR_BUSY.
+static LibStatus resultsNew(LibCatalog* cat, size_t capacity, LibResults** out) {
+    LibResults* results = (LibResults*)malloc(sizeof(LibResults));
+    *out = NULL;
+    if (results == NULL) {
+        return LIB_ERR_NO_MEMORY;
+    }
+    results->books = (Book**)malloc((capacity + 1) * sizeof(Book*));
+    results->copies = NULL;
+    results->count = 0;
+    results->cat = cat;
+    results->pin = results->books != NULL ? epochPin(cat) : -1;
+    if (results->books == NULL) {
+        libResultsFree(results);
+        return LIB_ERR_NO_MEMORY;
+    }
+    if (results->pin < 0) {
+        libResultsFree(results);
+        log_message(LOG_WARNING, "Query refused: no free reader slot");
+        return LIB_ERR_BUSY;
+    }
+    *out = results;
+    return LIB_OK;
+}
+
+size_t libResultsCount(const LibResults* results) {
+    return results->count;
+}
+
+void libResultsGet(const LibResults* results, size_t index, LibBook* book) {
+    if (results->copies != NULL) {
+        *book = results->copies[index];
+    } else {
+        copyBook(book, results->books[index]);
+    }
+}
+
+void libResultsFree(LibResults* results) {
+    if (results == NULL) return;
+    if (results->pin >= 0) {
+        epochUnpin(results->cat, results->pin);
+    }
+    free(results->books);
+    free(results->copies);
+    free(results);
+}
+
+static int passesFilter(const LibBook* book, StatusFilter filter, time_t now) {
+    switch (filter) {
+        case FILTER_AVAILABLE: return !book->is_issued;
+        case FILTER_ISSUED: return book->is_issued;
+        case FILTER_OVERDUE: return book->is_issued && book->due_date < now;
+        default: return 1;
+    }
+}
+
+// Copy the first `count` rows of a status-filtered listing, each under
+// its seqlock, and keep those whose copy still passes `filter`. The rows
+// were picked from live fields that circulation on any shard may change
+// meanwhile; the copies are what the caller gets, so a row never
+// contradicts the filter it was listed under. Returns the rows kept, or
+// -1 when out of memory.
+static long settleRows(LibResults* list, size_t count, StatusFilter filter, time_t now) {
+    LibBook* copies = (LibBook*)malloc((count + 1) * sizeof(LibBook));
+    size_t kept = 0;
+    if (copies == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        copyBook(&copies[kept], list->books[i]);
+        if (passesFilter(&copies[kept], filter, now)) {
+            list->books[kept++] = list->books[i];
+        }
+    }
+    list->copies = copies;
+    return (long)kept;
+}
+
+LibStatus libSearch(LibCatalog* cat, const char* query, LibResults** results) {
+    *results = NULL;
+    if (query[0] == '\0' || strlen(query) >= MAX_STR) {
+        return LIB_ERR_INVALID;
+    }
+
+    LibResults* found;
+    LibStatus status = resultsNew(cat, 0, &found);
+    if (status != LIB_OK) {
+        return status;
+    }
+    int count;
+    free(found->books);
+    found->books = searchCatalog(cat, query, &count);
+    found->count = (size_t)count;
+    *results = found;
+    return LIB_OK;
+}
+
+// Listings run without the catalog lock except for the first ordered
+// listing, which builds its skip list; the unordered overdue listing reads
+// each shard's due-date queue under that shard's lock. Rows are capped at
+// the book count read up front; books added while the listing runs may be
+// left out.
+LibStatus libList(LibCatalog* cat, StatusFilter filter, const char* order, LibResults** results) {
+    *results = NULL;
+    if (filter < FILTER_ALL || filter > FILTER_OVERDUE) {
+        return LIB_ERR_INVALID;
+    }
+
+    // Single title/author orders walk the ordered indexes; composite
+    // orders such as author,year,title go through the sort engine
+    SkipList* skip = NULL;
+    SortSpec spec;
+    int sorted = 0;
+    if (order != NULL) {
+        skip = strcmp(order, "title") == 0 ? &cat->title_order :
+               strcmp(order, "author") == 0 ? &cat->author_order : NULL;
+        sorted = skip == NULL;
+        if (sorted && !parseSortSpec(order, &spec)) {
+            return LIB_ERR_INVALID;
+        }
+    }
+
+    if (skip != NULL && !__atomic_load_n(&skip->built, __ATOMIC_ACQUIRE)) {
+        catalogLock(cat);
+        if (!skip->built) {
+            skipBuild(cat, skip);
+        }
+        catalogUnlock(cat);
+    }
+
+    size_t capacity = (size_t)libBookCount(cat);
+    size_t total = 0;
+    LibResults* list;
+    LibStatus status = resultsNew(cat, capacity, &list);
+    if (status != LIB_OK) {
+        return status;
+    }
+    SortItem* items = sorted ? sortCatalog(cat, &spec, &total) : NULL;
+    SkipNode* head = skip != NULL ? __atomic_load_n(&skip->head, __ATOMIC_ACQUIRE) : NULL;
+    if ((sorted && items == NULL) || (skip != NULL && head == NULL)) {
+        libResultsFree(list);
+        free(items);
+        log_message(LOG_ERROR, "Listing allocation failed");
+        return LIB_ERR_NO_MEMORY;
+    }
+
+    time_t now = time(NULL);
+    Book** rows = list->books;
+    size_t matched = 0;
+    if (order == NULL && filter == FILTER_OVERDUE) {
+        // Straight from the due-date queues, most overdue first
+        matched = shardDueBooks(cat, now, 0, now, capacity, rows);
+    } else if (order == NULL && filter != FILTER_ALL) {
+        // Status filters scan the hot status columns and only touch the
+        // cold record of books that match
+        Book** found = scanShards(cat, filter, NULL, 0, &matched);
+        if (found == NULL) {
+            libResultsFree(list);
+            log_message(LOG_ERROR, "Listing allocation failed");
+            return LIB_ERR_NO_MEMORY;
+        }
+        free(list->books);
+        list->books = found;
+    } else {
+        size_t next = 0;
+        SkipNode* node = skip != NULL ? __atomic_load_n(&head->forward[0], __ATOMIC_ACQUIRE) : NULL;
+        Book* b = sorted ? (total > 0 ? items[0].book : NULL) :
+                  skip != NULL ? (node != NULL ? node->book : NULL) : firstBook(cat);
+        while (b != NULL && matched < capacity) {
+            // A first cut on the live fields; settleRows has the final say
+            int issued = __atomic_load_n(&b->is_issued, __ATOMIC_RELAXED);
+            if (filter == FILTER_ALL ||
+                (filter == FILTER_AVAILABLE && !issued) ||
+                (filter == FILTER_ISSUED && issued) ||
+                (filter == FILTER_OVERDUE && issued && __atomic_load_n(&b->due_date, __ATOMIC_RELAXED) < now)) {
+                rows[matched++] = b;
+            }
+            if (sorted) {
+                b = ++next < total ? items[next].book : NULL;
+            } else if (skip != NULL) {
+                node = __atomic_load_n(&node->forward[0], __ATOMIC_ACQUIRE);
+                b = node != NULL ? node->book : NULL;
+            } else {
+                b = nextBook(b);
+            }
+        }
+    }
+    free(items);
+
+    if (filter != FILTER_ALL) {
+        long kept = settleRows(list, matched, filter, now);
+        if (kept < 0) {
+            libResultsFree(list);
+            log_message(LOG_ERROR, "Listing allocation failed");
+            return LIB_ERR_NO_MEMORY;
+        }
+        matched = (size_t)kept;
+    }
+    list->count = matched;
+    *results = list;
+    return LIB_OK;
+}
+
+static LibraryStats composeStatistics(int total, size_t loans, size_t overdue, int64_t due_sum, time_t now) {
+    LibraryStats stats = {0, 0, 0, 0.0, 0};
+
+    stats.total_books = total;
+    stats.issued_books = (int)loans;
+    stats.available_books = stats.total_books - stats.issued_books;
+    stats.overdue_books = (int)overdue;
+    if (overdue > 0) {
+        int64_t seconds = (int64_t)overdue * (int64_t)now - due_sum;
+        stats.total_fines = (double)seconds / (24 * 60 * 60) * FINE_PER_DAY;
+    }
+    return stats;
+}
+
+// Loan counters of one shard at `now`; the caller holds its lock
+static void gatherLoans(CatalogShard* shard, time_t now, LoanTotals* totals) {
+    // Everything comes from live counters; only loans that fell due since
+    // the last call are moved across, each of them once
+    dueAdvance(shard, now);
+    totals->loans = dueLoanCount(&shard->due_queue);
+    totals->overdue = shard->due_queue.overdue_count;
+    totals->due_sum = shard->due_queue.overdue_due_sum;
+
+    // The clock went back: loans between now and the watermark are not
+    // late yet
+    for (Book* book = shard->due_queue.overdue_tail; book != NULL && book->due_date >= now;
+         book = book->overdue_prev) {
+        totals->overdue--;
+        totals->due_sum -= (int64_t)book->due_date;
+    }
+}
+
+// Read a shard's counters under its stats_seq without locking. Fails when
+// a loan has fallen due since the last call, so it must be moved to the
+// overdue list, or when the clock went back.
+static int readLoans(CatalogShard* shard, time_t now, LoanTotals* totals) {
+    const DueQueue* due = &shard->due_queue;
+
+    for (;;) {
+        unsigned int seq = __atomic_load_n(&shard->stats_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+
+        size_t waiting = __atomic_load_n(&due->count, __ATOMIC_RELAXED);
+        size_t overdue = __atomic_load_n(&due->overdue_count, __ATOMIC_RELAXED);
+        int64_t due_sum = __atomic_load_n(&due->overdue_due_sum, __ATOMIC_RELAXED);
+        time_t watermark = __atomic_load_n(&due->watermark, __ATOMIC_RELAXED);
+        time_t next_due = __atomic_load_n(&due->next_due, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shard->stats_seq, __ATOMIC_RELAXED) != seq) continue;
+
+        if (watermark > now || next_due < now) return 0;
+        totals->loans = waiting + overdue;
+        totals->overdue = overdue;
+        totals->due_sum = due_sum;
+        return 1;
+    }
+}
+
+// Per-shard counters summed up. Only a shard that has to move loans to
+// its overdue list is locked, and only its own lock is taken.
+LibraryStats libStatistics(LibCatalog* cat, time_t now) {
+    LoanTotals sum = {0, 0, 0};
+
+    for (int i = 0; i < cat->shard_count; i++) {
+        CatalogShard* shard = &cat->shards[i];
+        LoanTotals totals;
+        if (!readLoans(shard, now, &totals)) {
+            shardLock(shard);
+            gatherLoans(shard, now, &totals);
+            shardUnlock(shard);
+        }
+        sum.loans += totals.loans;
+        sum.overdue += totals.overdue;
+        sum.due_sum += totals.due_sum;
+    }
+    return composeStatistics(libBookCount(cat), sum.loans, sum.overdue, sum.due_sum, now);
+}
+
+PoolStats libPoolStats(LibCatalog* cat) {
+    PoolStats stats = {0, 0, 0, 0};
+    catalogLock(cat);
+    for (int i = 0; i < cat->shard_count; i++) {
+        PoolStats shard = poolStats(&cat->shards[i].pool);
+        stats.slabs += shard.slabs;
+        stats.live += shard.live;
+        stats.free += shard.free;
+        stats.bytes += shard.bytes;
+    }
+    catalogUnlock(cat);
+    return stats;
+}
+
+static Book* createBook(LibCatalog* cat, int id, char* title, char* author, char* isbn, int year) {
+    Book* newBook = poolAlloc(cat, &shardFor(cat, id)->pool);
+    if (newBook == NULL) {
+        return NULL;
+    }
+
+    newBook->id = id;
+    safe_strcpy(newBook->title, title, MAX_STR);
+    safe_strcpy(newBook->author, author, MAX_STR);
+    safe_strcpy(newBook->isbn, isbn, 20);
+    newBook->year = year;
+    newBook->is_issued = 0;
+    newBook->issued_to[0] = '\0';
+    newBook->issue_date = 0;
+    newBook->due_date = 0;
+    newBook->order = cat->next_order++;
+    finishBook(cat, newBook);
+
+    return newBook;
+}
+
+// Complete a book whose fields are filled in, `order` included: clear its
+// links and build its search text and hot columns. Marking the slot live
+// comes last, as lock-free scans pick the book up from then on. Only touches
+// the book's own slot, so loaders may call it from several threads at once.
+static void finishBook(LibCatalog* cat, Book* book) {
+    book->next = NULL;
+    book->prev = NULL;
+    book->due_index = -1;
+    book->loan_prev = NULL;
+    book->loan_next = NULL;
+
+    // Case-folded shadow copy for substring search: title\0author\0isbn
+    BookSlab* slab = bookSlab(cat, book);
+    int slot = book->slot % SLAB_BOOKS;
+    char* text = slab->search_text[slot];
+    size_t len = foldSearchText(text, book->title, MAX_STR);
+    len += foldSearchText(text + len, book->author, MAX_STR);
+    len += foldSearchText(text + len, book->isbn, 20);
+    memset(text + len, 0, SEARCH_TEXT_LEN - len);
+    slab->search_len[slot] = (unsigned short)len;
+    slab->record_offset[slot] = 0;
+    syncHotColumns(cat, book);
+}
+
+static void insertBook(LibCatalog* cat, Book* newBook) {
+    if (!indexBook(cat, newBook)) {
+        log_message(LOG_WARNING, "Book index allocation failed");
+    }
+    cat->book_count++;
+    shardFor(cat, newBook->id)->book_count++;
+
+    // Readers walking the list see the book once it is linked in
+    newBook->next = NULL;
+    newBook->prev = cat->tail;
+    if (cat->tail == NULL) {
+        __atomic_store_n(&cat->head, newBook, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&cat->tail->next, newBook, __ATOMIC_RELEASE);
+    }
+    cat->tail = newBook;
+}
+
+// Catalog mutations shared by the menus and journal replay. They change
+// in-memory state only; callers journal the change themselves. Callers
+// hold the book's shard lock, and the catalog lock for adds and removes.
+static Book* catalogAddBook(LibCatalog* cat, int id, const char* title, const char* author, const char* isbn, int year) {
+    CatalogShard* shard = shardFor(cat, id);
+    Book* book = createBook(cat, id, (char*)title, (char*)author, (char*)isbn, year);
+    if (book == NULL) {
+        return NULL;
+    }
+
+    seqWriteBegin(&shard->stats_seq);
+    insertBook(cat, book);
+    seqWriteEnd(&shard->stats_seq);
+    if (id >= cat->next_id) {
+        cat->next_id = id + 1;
+    }
+    markBookDirty(cat, book);
+    return book;
+}
+
+static void releaseBook(LibCatalog* cat, void* book) {
+    poolFree(&shardFor(cat, ((Book*)book)->id)->pool, (Book*)book);
+}
+
+static void catalogRemoveBook(LibCatalog* cat, Book* book) {
+    CatalogShard* shard = shardFor(cat, book->id);
+    BookSlab* slab = bookSlab(cat, book);
+    uint64_t offset = slab->record_offset[book->slot % SLAB_BOOKS];
+    if (offset != 0) {
+        if (cat->changes.removed_count == cat->changes.removed_capacity) {
+            size_t capacity = cat->changes.removed_capacity ? cat->changes.removed_capacity * 2 : 64;
+            uint64_t* removed = (uint64_t*)realloc(cat->changes.removed, capacity * sizeof(uint64_t));
+            if (removed == NULL) {
+                cat->changes.base_valid = 0;     // cannot track it; rewrite in full
+            } else {
+                cat->changes.removed = removed;
+                cat->changes.removed_capacity = capacity;
+            }
+        }
+        if (cat->changes.removed_count < cat->changes.removed_capacity) {
+            cat->changes.removed[cat->changes.removed_count++] = offset;
+        }
+    }
+
+    // Readers may still hold the book, so its slot is only recycled once
+    // they are done; it leaves status scans at once
+    seqWriteBegin(&shard->stats_seq);
+    unlinkBook(cat, book);
+    unindexBook(cat, book);
+    __atomic_store_n(&slab->live[book->slot % SLAB_BOOKS], 0, __ATOMIC_RELEASE);
+    cat->book_count--;
+    shard->book_count--;
+    seqWriteEnd(&shard->stats_seq);
+    epochRetire(cat, book, releaseBook);
+}
+
+static void catalogIssueBook(LibCatalog* cat, Book* book, const char* borrower, time_t issue_date, time_t due_date) {
+    CatalogShard* shard = shardFor(cat, book->id);
+    seqWriteBegin(&shard->stats_seq);
+    if (book->is_issued) {
+        loanUnlink(cat, book);
+    }
+    seqWriteBegin(&book->seq);
+    book->is_issued = 1;
+    safe_strcpy(book->issued_to, borrower, MAX_BORROWER_NAME);
+    book->issue_date = issue_date;
+    book->due_date = due_date;
+    seqWriteEnd(&book->seq);
+    syncHotColumns(cat, book);
+    dueQueueUpdate(cat, book);
+    loanLink(cat, book);
+    seqWriteEnd(&shard->stats_seq);
+    markBookDirty(cat, book);
+}
+
+static void catalogReturnBook(LibCatalog* cat, Book* book) {
+    CatalogShard* shard = shardFor(cat, book->id);
+    seqWriteBegin(&shard->stats_seq);
+    if (book->is_issued) {
+        loanUnlink(cat, book);
+    }
+    seqWriteBegin(&book->seq);
+    book->is_issued = 0;
+    book->issued_to[0] = '\0';
+    book->issue_date = 0;
+    book->due_date = 0;
+    seqWriteEnd(&book->seq);
+    syncHotColumns(cat, book);
+    dueQueueRemove(cat, book);
+    seqWriteEnd(&shard->stats_seq);
+    markBookDirty(cat, book);
+}
+
+static void dueSet(DueQueue* due, size_t index, DueEntry entry) {
+    due->entries[index] = entry;
+    entry.book->due_index = (int)index;
+    if (index == 0) {
+        due->next_due = entry.due_date;
+    }
+}
+
+static void dueSiftUp(DueQueue* due, size_t index) {
+    DueEntry entry = due->entries[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (due->entries[parent].due_date <= entry.due_date) break;
+        dueSet(due, index, due->entries[parent]);
+        index = parent;
+    }
+    dueSet(due, index, entry);
+}
+
+static void dueSiftDown(DueQueue* due, size_t index) {
+    DueEntry entry = due->entries[index];
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= due->count) break;
+        if (child + 1 < due->count &&
+            due->entries[child + 1].due_date < due->entries[child].due_date) {
+            child++;
+        }
+        if (entry.due_date <= due->entries[child].due_date) break;
+        dueSet(due, index, due->entries[child]);
+        index = child;
+    }
+    dueSet(due, index, entry);
+}
+
+static void dueHeapRemove(DueQueue* due, size_t index) {
+    due->entries[index].book->due_index = -1;
+    if (--due->count == 0) {
+        due->next_due = DUE_NEVER;
+    }
+    if (due->count == index) return;
+
+    // Move the last entry into the hole; it may belong above or below it
+    Book* moved = due->entries[due->count].book;
+    dueSet(due, index, due->entries[due->count]);
+    dueSiftUp(due, index);
+    dueSiftDown(due, (size_t)moved->due_index);
+}
+
+// Link a book into the overdue list in due order. Searching from the tail
+// makes the usual case, a loan just crossing the watermark, O(1).
+static void overdueInsert(DueQueue* due, Book* book) {
+    Book* after = due->overdue_tail;
+    while (after != NULL && after->due_date > book->due_date) {
+        after = after->overdue_prev;
+    }
+
+    book->overdue_prev = after;
+    book->overdue_next = after != NULL ? after->overdue_next : due->overdue_head;
+    if (book->overdue_next != NULL) {
+        book->overdue_next->overdue_prev = book;
+    } else {
+        due->overdue_tail = book;
+    }
+    if (after != NULL) {
+        after->overdue_next = book;
+    } else {
+        due->overdue_head = book;
+    }
+
+    book->due_index = DUE_OVERDUE;
+    due->overdue_count++;
+    due->overdue_due_sum += (int64_t)book->due_date;
+}
+
+static void overdueRemove(DueQueue* due, Book* book) {
+    if (book->overdue_prev != NULL) {
+        book->overdue_prev->overdue_next = book->overdue_next;
+    } else {
+        due->overdue_head = book->overdue_next;
+    }
+    if (book->overdue_next != NULL) {
+        book->overdue_next->overdue_prev = book->overdue_prev;
+    } else {
+        due->overdue_tail = book->overdue_prev;
+    }
+    book->overdue_prev = NULL;
+    book->overdue_next = NULL;
+    book->due_index = -1;
+    due->overdue_count--;
+    due->overdue_due_sum -= (int64_t)book->due_date;
+}
+
+// Bring a book's queue entry in line with its loan: queue it when issued,
+// re-key it when the due date moved, drop it when returned
+static void dueQueueUpdate(LibCatalog* cat, Book* book) {
+    DueQueue* due = &shardFor(cat, book->id)->due_queue;
+    dueQueueRemove(cat, book);
+    if (!book->is_issued) return;
+
+    if (book->due_date < due->watermark) {
+        overdueInsert(due, book);
+        return;
+    }
+
+    if (due->count == due->capacity) {
+        size_t capacity = due->capacity ? due->capacity * 2 : 64;
+        DueEntry* entries = (DueEntry*)realloc(due->entries, capacity * sizeof(DueEntry));
+        if (entries == NULL) {
+            log_message(LOG_WARNING, "Due date queue allocation failed");
+            return;
+        }
+        due->entries = entries;
+        due->capacity = capacity;
+    }
+    DueEntry entry = {book->due_date, book};
+    due->entries[due->count] = entry;
+    dueSiftUp(due, due->count++);
+}
+
+static void dueQueueRemove(LibCatalog* cat, Book* book) {
+    DueQueue* due = &shardFor(cat, book->id)->due_queue;
+    if (book->due_index == DUE_OVERDUE) {
+        overdueRemove(due, book);
+    } else if (book->due_index >= 0) {
+        dueHeapRemove(due, (size_t)book->due_index);
+    }
+}
+
+// Move every loan due before `now` from the heap to the overdue list. Each
+// loan crosses once, so keeping the aggregates current is amortized
+// O(log n) per loan however often statistics are asked for.
+static void dueAdvance(CatalogShard* shard, time_t now) {
+    DueQueue* due = &shard->due_queue;
+    seqWriteBegin(&shard->stats_seq);
+    while (due->count > 0 && due->entries[0].due_date < now) {
+        Book* book = due->entries[0].book;
+        dueHeapRemove(due, 0);
+        overdueInsert(due, book);
+    }
+    if (now > due->watermark) {
+        due->watermark = now;
+    }
+    seqWriteEnd(&shard->stats_seq);
+}
+
+static size_t dueLoanCount(const DueQueue* due) {
+    return due->count + due->overdue_count;
+}
+
+static void dueQueueClear(DueQueue* due) {
+    free(due->entries);
+    DueQueue empty = {NULL, 0, 0, DUE_NEVER, NULL, NULL, 0, 0, 0};
+    *due = empty;
+}
+
+// Frontier for walking the queue in order: a min-heap of entry positions
+static void frontierPush(const DueQueue* due, size_t* frontier, size_t* size, size_t position) {
+    size_t at = (*size)++;
+    time_t when = due->entries[position].due_date;
+    while (at > 0 && due->entries[frontier[(at - 1) / 2]].due_date > when) {
+        frontier[at] = frontier[(at - 1) / 2];
+        at = (at - 1) / 2;
+    }
+    frontier[at] = position;
+}
+
+static size_t frontierPop(const DueQueue* due, size_t* frontier, size_t* size) {
+    size_t top = frontier[0];
+    size_t last = frontier[--(*size)];
+    time_t when = due->entries[last].due_date;
+    size_t at = 0;
+    for (;;) {
+        size_t child = 2 * at + 1;
+        if (child >= *size) break;
+        if (child + 1 < *size && due->entries[frontier[child + 1]].due_date <
+                                 due->entries[frontier[child]].due_date) {
+            child++;
+        }
+        if (when <= due->entries[frontier[child]].due_date) break;
+        frontier[at] = frontier[child];
+        at = child;
+    }
+    if (*size > 0) frontier[at] = last;
+    return top;
+}
+
+// Issued books due in [from, until), earliest first, at most `limit`.
+// The overdue list is already in order and holds every loan due before
+// the heap's; the heap is walked in order through a frontier of candidate
+// positions. The cost depends on the books returned plus any due before
+// `from`, never on the size of the catalog. Entries carry the due date
+// as it was, for merging with other shards after the lock is gone.
+static size_t dueBooks(const DueQueue* due, time_t from, time_t until, size_t limit, DueEntry* out) {
+    size_t found = 0;
+    for (Book* book = due->overdue_head; book != NULL && found < limit;
+         book = book->overdue_next) {
+        if (book->due_date >= until) return found;
+        if (book->due_date >= from) {
+            DueEntry entry = {book->due_date, book};
+            out[found++] = entry;
+        }
+    }
+    if (found == limit || due->count == 0) return found;
+
+    // Every step pops one position and pushes at most two
+    size_t* frontier = (size_t*)malloc((due->count + 1) * sizeof(size_t));
+    if (frontier == NULL) return found;
+
+    size_t size = 0;
+    frontierPush(due, frontier, &size, 0);
+    while (size > 0 && found < limit) {
+        size_t top = frontierPop(due, frontier, &size);
+        const DueEntry* entry = &due->entries[top];
+        if (entry->due_date >= until) break;
+        if (entry->due_date >= from) out[found++] = *entry;
+
+        if (2 * top + 1 < due->count) frontierPush(due, frontier, &size, 2 * top + 1);
+        if (2 * top + 2 < due->count) frontierPush(due, frontier, &size, 2 * top + 2);
+    }
+    free(frontier);
+    return found;
+}
+
+// Loans due in [from, until) across the catalog, earliest first, at most
+// `limit`. Each shard's queue is read under its own lock; the sorted runs
+// are then merged by due date, earlier shards first on ties.
+static size_t shardDueBooks(LibCatalog* cat, time_t now, time_t from, time_t until, size_t limit, Book** out) {
+    DueEntry* runs = NULL;
+    size_t bounds[MAX_SHARDS + 1];
+    size_t total = 0;
+
+    bounds[0] = 0;
+    for (int i = 0; i < cat->shard_count; i++) {
+        CatalogShard* shard = &cat->shards[i];
+        shardLock(shard);
+        dueAdvance(shard, now);
+        size_t loans = dueLoanCount(&shard->due_queue);
+        size_t wanted = loans < limit ? loans : limit;
+        DueEntry* grown = wanted > 0 ? (DueEntry*)realloc(runs, (total + wanted) * sizeof(DueEntry)) : runs;
+        if (grown != NULL) {
+            runs = grown;
+            total += dueBooks(&shard->due_queue, from, until, wanted, runs + total);
+        }
+        shardUnlock(shard);
+        bounds[i + 1] = total;
+    }
+
+    size_t at[MAX_SHARDS];
+    size_t found = 0;
+    memcpy(at, bounds, cat->shard_count * sizeof(size_t));
+    while (found < limit) {
+        int best = -1;
+        for (int i = 0; i < cat->shard_count; i++) {
+            if (at[i] < bounds[i + 1] && (best < 0 || runs[at[i]].due_date < runs[at[best]].due_date)) {
+                best = i;
+            }
+        }
+        if (best < 0) break;
+        out[found++] = runs[at[best]++].book;
+    }
+    free(runs);
+    return found;
+}
+
+// The next `limit` loans to fall due, soonest first
+LibStatus libDueSoon(LibCatalog* cat, size_t limit, LibResults** results) {
+    size_t books = (size_t)libBookCount(cat);
+    size_t capacity = limit < books ? limit : books;
+    LibStatus status = resultsNew(cat, capacity, results);
+    if (status != LIB_OK) {
+        return status;
+    }
+
+    time_t now = time(NULL);
+    (*results)->count = shardDueBooks(cat, now, now, DUE_NEVER, capacity, (*results)->books);
+    return LIB_OK;
+}
+
+// Borrower names are matched trimmed, with runs of whitespace collapsed
+// and case folded, so "Ann  Lee" and "ann lee " are the same patron
+static void normalizeBorrower(const char* name, char* out) {
+    size_t length = 0;
+    int space = 0;
+    for (; *name != '\0' && length < MAX_BORROWER_NAME - 1; name++) {
+        unsigned char c = (unsigned char)*name;
+        if (isspace(c)) {
+            space = length > 0;
+            continue;
+        }
+        if (space && length < MAX_BORROWER_NAME - 2) out[length++] = ' ';
+        space = 0;
+        out[length++] = (char)tolower(c);
+    }
+    out[length] = '\0';
+}
+
+static int matchBorrower(const Book* book, const char* normalized) {
+    char name[MAX_BORROWER_NAME];
+    normalizeBorrower(book->issued_to, name);
+    return strcmp(name, normalized) == 0;
+}
+
+static int borrowerKey(const char* name, char* normalized) {
+    normalizeBorrower(name, normalized);
+    return hashString(normalized);
+}
+
+// Put an issued book on its borrower's loan list. The index points at the
+// first loan; later loans go in right behind it so the entry stays put.
+static void loanLink(LibCatalog* cat, Book* book) {
+    BookIndex* index = &shardFor(cat, book->id)->borrower_index;
+    char name[MAX_BORROWER_NAME];
+    int key = borrowerKey(book->issued_to, name);
+    Book* first = indexFind(index, key, matchBorrower, name);
+
+    book->loan_prev = first;
+    book->loan_next = NULL;
+    if (first == NULL) {
+        if (!indexInsert(cat, index, key, book)) {
+            log_message(LOG_WARNING, "Borrower index allocation failed");
+        }
+        return;
+    }
+    book->loan_next = first->loan_next;
+    if (book->loan_next != NULL) {
+        book->loan_next->loan_prev = book;
+    }
+    first->loan_next = book;
+}
+
+// Take a book off its borrower's list; call before issued_to changes
+static void loanUnlink(LibCatalog* cat, Book* book) {
+    if (book->loan_prev != NULL) {
+        book->loan_prev->loan_next = book->loan_next;
+        if (book->loan_next != NULL) {
+            book->loan_next->loan_prev = book->loan_prev;
+        }
+    } else {
+        // First loan: hand the index entry to the next one
+        BookIndex* index = &shardFor(cat, book->id)->borrower_index;
+        char name[MAX_BORROWER_NAME];
+        int key = borrowerKey(book->issued_to, name);
+        indexRemove(index, key, book);
+        if (book->loan_next != NULL) {
+            book->loan_next->loan_prev = NULL;
+            if (!indexInsert(cat, index, key, book->loan_next)) {
+                log_message(LOG_WARNING, "Borrower index allocation failed");
+            }
+        }
+    }
+    book->loan_prev = NULL;
+    book->loan_next = NULL;
+}
+
+// First of a patron's loans in one shard, the rest follow on loan_next
+static Book* patronLoans(CatalogShard* shard, const char* borrower) {
+    char name[MAX_BORROWER_NAME];
+    int key = borrowerKey(borrower, name);
+    return indexFind(&shard->borrower_index, key, matchBorrower, name);
+}
+
+// Loan lists are relinked in place by circulation, so each shard's lists
+// are walked under that shard's lock. Loans come shard by shard.
+LibStatus libPatronLoans(LibCatalog* cat, const char* borrower, LibResults** results) {
+    LibStatus status = resultsNew(cat, 0, results);
+    if (status != LIB_OK) {
+        return status;
+    }
+
+    for (int i = 0; i < cat->shard_count; i++) {
+        CatalogShard* shard = &cat->shards[i];
+        size_t count = (*results)->count;
+        shardLock(shard);
+        for (Book* loan = patronLoans(shard, borrower); loan != NULL; loan = loan->loan_next) {
+            count++;
+        }
+
+        Book** books = count > (*results)->count ?
+                       (Book**)realloc((*results)->books, (count + 1) * sizeof(Book*)) : (*results)->books;
+        if (books == NULL) {
+            shardUnlock(shard);
+            libResultsFree(*results);
+            *results = NULL;
+            return LIB_ERR_NO_MEMORY;
+        }
+        (*results)->books = books;
+        for (Book* loan = patronLoans(shard, borrower); loan != NULL; loan = loan->loan_next) {
+            books[(*results)->count++] = loan;
+        }
+        shardUnlock(shard);
+    }
+    return LIB_OK;
+}
+
+// Record that a book differs from its copy in library.dat, on its shard's
+// dirty list (under the shard lock)
+static void markBookDirty(LibCatalog* cat, Book* book) {
+    CatalogShard* shard = shardFor(cat, book->id);
+    BookSlab* slab = shard->pool.slabs[book->slot / SLAB_BOOKS];
+    int i = book->slot % SLAB_BOOKS;
+    if (slab->dirty[i]) return;
+
+    if (shard->dirty_count == shard->dirty_capacity) {
+        size_t capacity = shard->dirty_capacity ? shard->dirty_capacity * 2 : 64;
+        int* slots = (int*)realloc(shard->dirty, capacity * sizeof(int));
+        if (slots == NULL) {
+            __atomic_store_n(&cat->changes.base_valid, 0, __ATOMIC_RELAXED);
+            return;
+        }
+        shard->dirty = slots;
+        shard->dirty_capacity = capacity;
+    }
+    slab->dirty[i] = 1;
+    shard->dirty[shard->dirty_count++] = book->slot;
+}
+
+static void clearChangeSet(LibCatalog* cat) {
+    for (int s = 0; s < cat->shard_count; s++) {
+        CatalogShard* shard = &cat->shards[s];
+        for (size_t i = 0; i < shard->dirty_count; i++) {
+            int slot = shard->dirty[i];
+            if ((size_t)(slot / SLAB_BOOKS) < shard->pool.slab_count) {
+                shard->pool.slabs[slot / SLAB_BOOKS]->dirty[slot % SLAB_BOOKS] = 0;
+            }
+        }
+        shard->dirty_count = 0;
+    }
+    cat->changes.removed_count = 0;
+}
+
+// Anything not yet durable: queued journal records (or, without the
+// journal, catalog changes) and users that have not been written
+static int hasUnsavedChanges(LibCatalog* cat) {
+    if (cat->users_first_dirty < cat->user_count) return 1;
+
+    if (!cat->journal.enabled) {
+        for (int i = 0; i < cat->shard_count; i++) {
+            if (cat->shards[i].dirty_count > 0) return 1;
+        }
+        return cat->changes.removed_count > 0;
+    }
+    pthread_mutex_lock(&cat->journal.lock);
+    int pending = cat->journal.pending.length > 0;
+    pthread_mutex_unlock(&cat->journal.lock);
+    return pending;
+}
+
+// Splice an already linked chain of books onto the end of the catalog.
+// Used by bulk loaders so the whole chain is indexed and attached in one pass.
+static void appendBooks(LibCatalog* cat, Book* first, Book* last, int count) {
+    if (first == NULL) return;
+
+    // Every shard's ID index is sized for its part of the chain
+    size_t shard_books[MAX_SHARDS];
+    memset(shard_books, 0, sizeof(shard_books));
+    for (Book* book = first; book != NULL; book = book->next) {
+        shard_books[shardIndex(cat, book->id)]++;
+    }
+    int ok = 1;
+    for (int i = 0; i < cat->shard_count; i++) {
+        CatalogShard* shard = &cat->shards[i];
+        ok &= indexReserve(cat, &shard->id_index, shard->id_index.count + shard_books[i]);
+        shard->book_count += (int)shard_books[i];
+    }
+
+    size_t expected = cat->title_index.count + (size_t)count;
+    if (!ok || !indexReserve(cat, &cat->title_index, expected) ||
+        !indexReserve(cat, &cat->isbn_index, expected)) {
+        log_message(LOG_WARNING, "Book index allocation failed");
+    }
+    for (Book* book = first; book != NULL; book = book->next) {
+        indexBook(cat, book);
+    }
+    cat->book_count += count;
+
+    first->prev = cat->tail;
+    if (cat->tail == NULL) {
+        __atomic_store_n(&cat->head, first, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&cat->tail->next, first, __ATOMIC_RELEASE);
+    }
+    cat->tail = last;
+}
+
+// The unlinked book keeps its `next`, so a reader standing on it can
+// still walk on to the rest of the list
+static void unlinkBook(LibCatalog* cat, Book* book) {
+    if (book->prev == NULL) {
+        __atomic_store_n(&cat->head, book->next, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&book->prev->next, book->next, __ATOMIC_RELEASE);
+    }
+
+    if (book->next == NULL) {
+        cat->tail = book->prev;
+    } else {
+        book->next->prev = book->prev;
+    }
+    book->prev = NULL;
+}
+
+// List walks for readers that do not hold the catalog lock
+static Book* firstBook(LibCatalog* cat) {
+    return __atomic_load_n(&cat->head, __ATOMIC_ACQUIRE);
+}
+
+static Book* nextBook(const Book* book) {
+    return __atomic_load_n(&book->next, __ATOMIC_ACQUIRE);
+}
+
+static Book* searchBook(LibCatalog* cat, int id) {
+    CatalogShard* shard = shardFor(cat, id);
+    Book* book = indexLookup(&shard->id_index, id);
+    if (book != NULL || __atomic_load_n(&shard->id_index.count, __ATOMIC_RELAXED) ==
+                        (size_t)__atomic_load_n(&shard->book_count, __ATOMIC_RELAXED)) {
+        return book;
+    }
+
+    // Index is incomplete (an earlier allocation failed), fall back to a
+    // scan of the shard's ID column
+    size_t slab_count = __atomic_load_n(&shard->pool.slab_count, __ATOMIC_ACQUIRE);
+    BookSlab** slabs = __atomic_load_n(&shard->pool.slabs, __ATOMIC_ACQUIRE);
+    for (size_t s = 0; s < slab_count; s++) {
+        for (size_t i = 0; i < SLAB_BOOKS; i++) {
+            if (__atomic_load_n(&slabs[s]->live[i], __ATOMIC_ACQUIRE) && slabs[s]->id[i] == id) {
+                return &slabs[s]->books[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+static size_t indexHash(int id) {
+    // Fibonacci hashing spreads sequential IDs across the table
+    return (size_t)((unsigned int)id * 2654435769u);
+}
+
+// Lookups may still be probing the old table, so it is retired unless the
+// index is only read under a lock
+static int indexRehash(LibCatalog* cat, BookIndex* index, size_t new_capacity) {
+    IndexSlot* slots = (IndexSlot*)calloc(new_capacity, sizeof(IndexSlot));
+    if (slots == NULL) {
+        return 0;
+    }
+
+    size_t mask = new_capacity - 1;
+    for (size_t i = 0; i < index->capacity; i++) {
+        Book* book = index->slots[i].book;
+        if (book == NULL || book == INDEX_TOMBSTONE) continue;
+
+        size_t pos = indexHash(index->slots[i].key) & mask;
+        while (slots[pos].book != NULL) {
+            pos = (pos + 1) & mask;
+        }
+        slots[pos] = index->slots[i];
+    }
+
+    IndexSlot* old = index->slots;
+    seqWriteBegin(&index->seq);
+    __atomic_store_n(&index->slots, slots, __ATOMIC_RELAXED);
+    __atomic_store_n(&index->capacity, new_capacity, __ATOMIC_RELAXED);
+    seqWriteEnd(&index->seq);
+    index->tombstones = 0;
+    if (index->locked) {
+        free(old);
+    } else {
+        epochRetire(cat, old, NULL);
+    }
+    return 1;
+}
+
+static int indexReserve(LibCatalog* cat, BookIndex* index, size_t expected) {
+    // Size for the live entries at a load factor under 3/4
+    size_t capacity = index->capacity ? index->capacity : INDEX_MIN_CAPACITY;
+    while (expected * 4 >= capacity * 3) {
+        capacity *= 2;
+    }
+
+    // Rebuild in place when tombstones alone push the table over the limit
+    if (capacity == index->capacity &&
+        (expected + index->tombstones) * 4 < capacity * 3) {
+        return 1;
+    }
+    return indexRehash(cat, index, capacity);
+}
+
+static int indexInsert(LibCatalog* cat, BookIndex* index, int key, Book* book) {
+    if (!indexReserve(cat, index, index->count + 1)) {
+        return 0;
+    }
+
+    size_t mask = index->capacity - 1;
+    size_t pos = indexHash(key) & mask;
+    while (index->slots[pos].book != NULL && index->slots[pos].book != INDEX_TOMBSTONE) {
+        pos = (pos + 1) & mask;
+    }
+
+    if (index->slots[pos].book == INDEX_TOMBSTONE) {
+        index->tombstones--;
+    }
+    index->slots[pos].key = key;
+    __atomic_store_n(&index->slots[pos].book, book, __ATOMIC_RELEASE);
+    index->count++;
+    return 1;
+}
+
+static void indexRemove(BookIndex* index, int key, Book* book) {
+    if (index->capacity == 0) return;
+
+    size_t mask = index->capacity - 1;
+    size_t pos = indexHash(key) & mask;
+    while (index->slots[pos].book != NULL) {
+        if (index->slots[pos].book == book) {
+            __atomic_store_n(&index->slots[pos].book, INDEX_TOMBSTONE, __ATOMIC_RELEASE);
+            index->count--;
+            index->tombstones++;
+            return;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+static Book* indexLookup(const BookIndex* index, int id) {
+    return indexFind(index, id, NULL, NULL);
+}
+
+// Probe for `key`; string indexes pass `match` to confirm the candidate
+// since different strings can share a hash, and the ID index checks the
+// book itself, as a slot can be reused while a lookup reads it. A miss
+// that overlapped a table replacement is probed again.
+static Book* indexFind(const BookIndex* index, int key,
+                       int (*match)(const Book*, const char*), const char* value) {
+    for (;;) {
+        unsigned int seq = __atomic_load_n(&index->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        IndexSlot* slots = __atomic_load_n(&index->slots, __ATOMIC_RELAXED);
+        size_t capacity = __atomic_load_n(&index->capacity, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&index->seq, __ATOMIC_RELAXED) != seq) continue;
+        if (capacity == 0) return NULL;
+
+        size_t mask = capacity - 1;
+        size_t pos = indexHash(key) & mask;
+        Book* book;
+        while ((book = __atomic_load_n(&slots[pos].book, __ATOMIC_ACQUIRE)) != NULL) {
+            if (book != INDEX_TOMBSTONE && slots[pos].key == key &&
+                (match != NULL ? match(book, value) : book->id == key)) {
+                return book;
+            }
+            pos = (pos + 1) & mask;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&index->seq, __ATOMIC_RELAXED) == seq) return NULL;
+    }
+}
+
+static void indexClear(BookIndex* index) {
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->tombstones = 0;
+}
+
+// FNV-1a over the raw bytes
+static int hashString(const char* str) {
+    unsigned int hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619u;
+    }
+    return (int)hash;
+}
+
+// FNV-1a over the lower-cased bytes, matching strcasecmp equality
+static int hashStringFolded(const char* str) {
+    unsigned int hash = 2166136261u;
+    while (*str) {
+        hash ^= (unsigned char)tolower((unsigned char)*str++);
+        hash *= 16777619u;
+    }
+    return (int)hash;
+}
+
+// Add a book to the ID, title and ISBN indexes
+static int indexBook(LibCatalog* cat, Book* book) {
+    int ok = indexInsert(cat, &shardFor(cat, book->id)->id_index, book->id, book);
+    ok &= indexInsert(cat, &cat->title_index, hashStringFolded(book->title), book);
+    ok &= indexInsert(cat, &cat->isbn_index, hashString(book->isbn), book);
+    if (cat->trigram_index.built && !trigramAdd(cat, &cat->trigram_index, book)) {
+        // Drop the index rather than serve incomplete results; the next
+        // search rebuilds it
+        trigramClear(cat, &cat->trigram_index);
+    }
+    if (cat->title_order.built && !skipInsert(&cat->title_order, book)) {
+        skipClear(cat, &cat->title_order);
+    }
+    if (cat->author_order.built && !skipInsert(&cat->author_order, book)) {
+        skipClear(cat, &cat->author_order);
+    }
+    dueQueueUpdate(cat, book);
+    if (book->is_issued) {
+        loanLink(cat, book);
+    }
+    return ok;
+}
+
+static void unindexBook(LibCatalog* cat, Book* book) {
+    indexRemove(&shardFor(cat, book->id)->id_index, book->id, book);
+    indexRemove(&cat->title_index, hashStringFolded(book->title), book);
+    indexRemove(&cat->isbn_index, hashString(book->isbn), book);
+    trigramRemove(cat, &cat->trigram_index, book);
+    skipRemove(cat, &cat->title_order, book);
+    skipRemove(cat, &cat->author_order, book);
+    dueQueueRemove(cat, book);
+    if (book->is_issued) {
+        loanUnlink(cat, book);
+    }
+}
+
+static int matchTitle(const Book* book, const char* title) {
+    return strcasecmp(book->title, title) == 0;
+}
+
+static int matchISBN(const Book* book, const char* isbn) {
+    return strcmp(book->isbn, isbn) == 0;
+}
+
+static Book* searchBookByTitle(LibCatalog* cat, char* title) {
+    Book* book = indexFind(&cat->title_index, hashStringFolded(title), matchTitle, title);
+    if (book != NULL || cat->title_index.count == (size_t)cat->book_count) {
+        return book;
+    }
+
+    Book* current = cat->head;
+    while (current != NULL) {
+        if (strcasecmp(current->title, title) == 0) {
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+static Book* searchBookByISBN(LibCatalog* cat, char* isbn) {
+    Book* book = indexFind(&cat->isbn_index, hashString(isbn), matchISBN, isbn);
+    if (book != NULL || cat->isbn_index.count == (size_t)cat->book_count) {
+        return book;
+    }
+
+    Book* current = cat->head;
+    while (current != NULL) {
+        if (strcmp(current->isbn, isbn) == 0) {
+            return current;
+        }
+        current = current->next;
+    }
+    return NULL;
+}
+
+// Map (or read) a whole file into memory. Returns NULL on failure.
+static char* mapFile(const char* path, size_t* size, int* mapped) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data != MAP_FAILED) {
+        *size = (size_t)st.st_size;
+        *mapped = 1;
+        return (char*)data;
+    }
+#endif
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+
+    char* buffer = length > 0 ? (char*)malloc((size_t)length) : NULL;
+    if (buffer == NULL || fread(buffer, 1, (size_t)length, file) != (size_t)length) {
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    *size = (size_t)length;
+    *mapped = 0;
+    return buffer;
+}
+
+static void unmapFile(char* data, size_t size, int mapped) {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(data, size);
+        return;
+    }
+#endif
+    (void)size;
+    (void)mapped;
+    free(data);
+}
+
+// With the journal running a save is a group commit of the pending
+// changes; the full catalog is only rewritten by compaction
+static int saveToFile(LibCatalog* cat) {
+    int ok;
+    if (cat->journal.enabled) {
+        ok = journalCommit(cat);
+    } else {
+        ok = saveCatalogFile(cat);
+    }
+
+    if (!ok) {
+        log_message(LOG_ERROR, "Cannot save to file");
+        return 0;
+    }
+    log_message(LOG_INFO, "Data saved to file");
+    return 1;
+}
+
+static int bufferReserve(ByteBuffer* buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) {
+        return 1;
+    }
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    char* data = (char*)realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+static int bufferAppend(ByteBuffer* buffer, const void* data, size_t length) {
+    if (!bufferReserve(buffer, length)) {
+        return 0;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return 1;
+}
+
+static void bufferFree(ByteBuffer* buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+static int writeAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        long written = (long)write(fd, data, length);
+        if (written <= 0) {
+            return 0;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    return 1;
+}
+
+// Replace `path` with `data` crash-safely: write a temp file, fsync it
+// and rename it over the original
+static int writeFileAtomic(const char* path, const char* data, size_t length) {
+    char temp_path[LIB_PATH_MAX + sizeof(".tmp")];
+    int temp_length = snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    if (temp_length < 0 || (size_t)temp_length >= sizeof(temp_path)) {
+        return 0;
+    }
+
+    int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return 0;
+    }
+    if (!writeAll(fd, data, length) || fsync(fd) != 0) {
+        close(fd);
+        remove(temp_path);
+        return 0;
+    }
+    close(fd);
+
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+// The catalog in the VERSION:2 pipe-delimited text format
+static int buildTextImage(LibCatalog* cat, ByteBuffer* out) {
+    char line[512];
+    int length = snprintf(line, sizeof(line), "VERSION:2\nNEXT_ID:%d\nBOOK_COUNT:%d\n---\n",
+                          cat->next_id, cat->book_count);
+    if (!bufferAppend(out, line, (size_t)length)) {
+        return 0;
+    }
+
+    for (Book* current = cat->head; current != NULL; current = current->next) {
+        length = snprintf(line, sizeof(line), "%d|%s|%s|%s|%d|%d|%s|%ld|%ld\n",
+                          current->id, current->title, current->author, current->isbn,
+                          current->year, current->is_issued, current->issued_to,
+                          (long)current->issue_date, (long)current->due_date);
+        if (!bufferAppend(out, line, (size_t)length)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The catalog as a VERSION:3 binary snapshot
+static int buildSnapshotImage(LibCatalog* cat, ByteBuffer* out) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.next_id = (uint32_t)cat->next_id;
+    header.book_count = (uint32_t)cat->book_count;
+    header.record_size = sizeof(SnapshotRecord);
+    header.records_offset = SNAPSHOT_MAGIC_LEN + sizeof(SnapshotHeader);
+    header.heap_offset = header.records_offset + (uint64_t)cat->book_count * sizeof(SnapshotRecord);
+
+    uint64_t heap_size = 0;
+    for (Book* current = cat->head; current != NULL; current = current->next) {
+        heap_size += strlen(current->title) + strlen(current->author) +
+                     strlen(current->isbn) + 3;
+    }
+    header.heap_size = heap_size;
+
+    if (!bufferReserve(out, (size_t)(header.heap_offset + heap_size))) {
+        return 0;
+    }
+    bufferAppend(out, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN);
+    bufferAppend(out, &header, sizeof(header));
+
+    // Records and heap are filled side by side in list order
+    char* records = out->data + header.records_offset;
+    char* heap = out->data + header.heap_offset;
+    uint32_t offset = 0;
+    for (Book* current = cat->head; current != NULL; current = current->next) {
+        SnapshotRecord record;
+        memset(&record, 0, sizeof(record));
+        record.id = current->id;
+        record.year = current->year;
+        record.is_issued = current->is_issued;
+        record.issue_date = (int64_t)current->issue_date;
+        record.due_date = (int64_t)current->due_date;
+        safe_strcpy(record.issued_to, current->issued_to, MAX_BORROWER_NAME);
+
+        size_t length = strlen(current->title) + 1;
+        record.title_off = offset;
+        memcpy(heap + offset, current->title, length);
+        offset += (uint32_t)length;
+
+        length = strlen(current->author) + 1;
+        record.author_off = offset;
+        memcpy(heap + offset, current->author, length);
+        offset += (uint32_t)length;
+
+        length = strlen(current->isbn) + 1;
+        record.isbn_off = offset;
+        memcpy(heap + offset, current->isbn, length);
+        offset += (uint32_t)length;
+
+        memcpy(records, &record, sizeof(record));
+        records += sizeof(record);
+    }
+
+    out->length = (size_t)(header.heap_offset + heap_size);
+    return 1;
+}
+
+static int buildCatalogImage(LibCatalog* cat, ByteBuffer* out) {
+    return DATA_FORMAT_VERSION >= 3 ? buildSnapshotImage(cat, out) : buildTextImage(cat, out);
+}
+
+// A full image was just built from the list: snapshot records now follow
+// list order, so the change set starts over from there
+static void rebaseChangeSet(LibCatalog* cat, size_t image_length) {
+    clearChangeSet(cat);
+    cat->changes.segments = 0;
+    cat->changes.dead_records = 0;
+    cat->changes.base_valid = DATA_FORMAT_VERSION >= 3;
+    cat->changes.snapshot_end = image_length;
+    if (!cat->changes.base_valid) return;
+
+    uint64_t offset = SNAPSHOT_MAGIC_LEN + sizeof(SnapshotHeader);
+    for (Book* current = cat->head; current != NULL; current = current->next) {
+        bookSlab(cat, current)->record_offset[current->slot % SLAB_BOOKS] = offset;
+        offset += sizeof(SnapshotRecord);
+    }
+}
+
+// Too many tombstones or segments force a rewrite, which compacts them
+static int snapshotPatchable(LibCatalog* cat) {
+    return DATA_FORMAT_VERSION >= 3 && cat->changes.base_valid &&
+           cat->changes.segments < SNAPSHOT_MAX_SEGMENTS &&
+           (cat->changes.dead_records + cat->changes.removed_count) * 4 <= (size_t)cat->book_count;
+}
+
+static int writeAt(int fd, const void* data, size_t length, uint64_t offset) {
+    const char* p = (const char*)data;
+    while (length > 0) {
+        long written = (long)pwrite(fd, p, length, (off_t)offset);
+        if (written <= 0) {
+            return 0;
+        }
+        p += written;
+        offset += (uint64_t)written;
+        length -= (size_t)written;
+    }
+    return 1;
+}
+
+static void fillSnapshotRecord(SnapshotRecord* record, const Book* book) {
+    record->id = book->id;
+    record->year = book->year;
+    record->is_issued = book->is_issued;
+    record->issue_date = (int64_t)book->issue_date;
+    record->due_date = (int64_t)book->due_date;
+    memset(record->issued_to, 0, MAX_BORROWER_NAME);
+    safe_strcpy(record->issued_to, book->issued_to, MAX_BORROWER_NAME);
+}
+
+// Walk the dirty lists of every shard in turn: returns the slab of the
+// next changed slot and its index in *slot, NULL once all are visited
+typedef struct {
+    int shard;
+    size_t next;
+} DirtyCursor;
+
+static BookSlab* nextDirtySlot(LibCatalog* cat, DirtyCursor* cursor, int* slot) {
+    while (cursor->shard < cat->shard_count) {
+        CatalogShard* shard = &cat->shards[cursor->shard];
+        if (cursor->next < shard->dirty_count) {
+            int dirty = shard->dirty[cursor->next++];
+            *slot = dirty % SLAB_BOOKS;
+            return shard->pool.slabs[dirty / SLAB_BOOKS];
+        }
+        cursor->shard++;
+        cursor->next = 0;
+    }
+    return NULL;
+}
+
+// Bring library.dat up to date by touching only what changed: rewrite
+// dirty records in place, tombstone removed ones and append new books as
+// one segment. Segment data is synced before the header that commits it.
+static int patchSnapshot(LibCatalog* cat) {
+    int fd = open(cat->data_path, O_RDWR);
+    if (fd < 0) {
+        return 0;
+    }
+
+    SnapshotHeader header;
+    if (pread(fd, &header, sizeof(header), SNAPSHOT_MAGIC_LEN) != (long)sizeof(header) ||
+        header.segments != cat->changes.segments) {
+        close(fd);
+        return 0;
+    }
+
+    int ok = 1;
+    unsigned char removed = 1;
+    for (size_t i = 0; ok && i < cat->changes.removed_count; i++) {
+        ok = writeAt(fd, &removed, 1, cat->changes.removed[i] + offsetof(SnapshotRecord, removed));
+    }
+
+    // Existing records: only the circulation fields can change. New books
+    // are gathered from the shards' dirty lists and put back in catalog
+    // order, which is the order a reload sees them in.
+    ByteBuffer segment = {NULL, 0, 0};
+    Book** added_books = NULL;
+    size_t added_capacity = 0;
+    size_t added = 0;
+    uint64_t heap_size = 0;
+    DirtyCursor cursor = {0, 0};
+    BookSlab* slab;
+    int s;
+    while (ok && (slab = nextDirtySlot(cat, &cursor, &s)) != NULL) {
+        if (!slab->live[s] || !slab->dirty[s]) continue;
+
+        Book* book = &slab->books[s];
+        if (slab->record_offset[s] == 0) {
+            if (added == added_capacity) {
+                size_t capacity = added_capacity ? added_capacity * 2 : 64;
+                Book** grown = (Book**)realloc(added_books, capacity * sizeof(Book*));
+                if (grown == NULL) {
+                    ok = 0;
+                    break;
+                }
+                added_books = grown;
+                added_capacity = capacity;
+            }
+            added_books[added++] = book;
+            heap_size += strlen(book->title) + strlen(book->author) + strlen(book->isbn) + 3;
+            continue;
+        }
+
+        SnapshotRecord record;
+        if (pread(fd, &record, sizeof(record), (off_t)slab->record_offset[s]) != (long)sizeof(record)) {
+            ok = 0;
+            break;
+        }
+        fillSnapshotRecord(&record, book);
+        ok = writeAt(fd, &record, sizeof(record), slab->record_offset[s]);
+    }
+
+    // New books go into one segment: header, records, then their strings
+    if (ok && added > 0) {
+        qsort(added_books, added, sizeof(Book*), compareCatalogOrder);
+        SnapshotSegment info = {(uint32_t)added, 0, heap_size};
+        uint64_t records_at = cat->changes.snapshot_end + sizeof(info);
+        size_t records_size = added * sizeof(SnapshotRecord);
+
+        ok = bufferReserve(&segment, sizeof(info) + records_size + (size_t)heap_size);
+        if (ok) {
+            bufferAppend(&segment, &info, sizeof(info));
+            memset(segment.data + segment.length, 0, records_size);
+            segment.length += records_size;
+
+            char* records = segment.data + sizeof(info);
+            uint32_t offset = 0;
+            for (size_t i = 0; i < added; i++) {
+                const Book* book = added_books[i];
+                SnapshotRecord record;
+                memset(&record, 0, sizeof(record));
+                fillSnapshotRecord(&record, book);
+                record.title_off = offset;
+                offset += (uint32_t)strlen(book->title) + 1;
+                record.author_off = offset;
+                offset += (uint32_t)strlen(book->author) + 1;
+                record.isbn_off = offset;
+                offset += (uint32_t)strlen(book->isbn) + 1;
+                bufferAppend(&segment, book->title, strlen(book->title) + 1);
+                bufferAppend(&segment, book->author, strlen(book->author) + 1);
+                bufferAppend(&segment, book->isbn, strlen(book->isbn) + 1);
+
+                memcpy(records, &record, sizeof(record));
+                records += sizeof(record);
+            }
+            ok = writeAt(fd, segment.data, segment.length, cat->changes.snapshot_end);
+        }
+
+        if (ok) {
+            uint64_t at = records_at;
+            for (size_t i = 0; i < added; i++) {
+                bookSlab(cat, added_books[i])->record_offset[added_books[i]->slot % SLAB_BOOKS] = at;
+                at += sizeof(SnapshotRecord);
+            }
+        }
+    }
+
+    if (ok && fsync(fd) == 0) {
+        header.next_id = (uint32_t)cat->next_id;
+        header.segments = cat->changes.segments + (added > 0);
+        ok = writeAt(fd, &header, sizeof(header), SNAPSHOT_MAGIC_LEN) && fsync(fd) == 0;
+    } else {
+        ok = 0;
+    }
+    close(fd);
+
+    if (ok) {
+        if (added > 0) {
+            cat->changes.segments++;
+            cat->changes.snapshot_end += segment.length;
+        }
+        cat->changes.dead_records += cat->changes.removed_count;
+        clearChangeSet(cat);
+    }
+    free(added_books);
+    bufferFree(&segment);
+    return ok;
+}
+
+// Write library.dat without the journal: patch it when the change set
+// allows, otherwise replace it with a full image
+static int saveCatalogFile(LibCatalog* cat) {
+    if (!cat->persistent) {
+        return 1;
+    }
+    if (snapshotPatchable(cat) && patchSnapshot(cat)) {
+        return 1;
+    }
+
+    ByteBuffer image = {NULL, 0, 0};
+    int ok = buildCatalogImage(cat, &image) && writeFileAtomic(cat->data_path, image.data, image.length);
+    if (ok) {
+        rebaseChangeSet(cat, image.length);
+    }
+    bufferFree(&image);
+    return ok;
+}
+
+static unsigned int journalChecksum(const char* data, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Queue one record for the next group commit
+static void journalAppend(LibCatalog* cat, JournalOp op, const char* payload, size_t length) {
+    if (!cat->journal.enabled) return;
+
+    char header[JOURNAL_RECORD_HEADER + 1];
+    uint32_t size = (uint32_t)(length + 1);
+    header[JOURNAL_RECORD_HEADER] = (char)op;
+
+    pthread_mutex_lock(&cat->journal.lock);
+    if (bufferReserve(&cat->journal.pending, JOURNAL_RECORD_HEADER + size)) {
+        size_t start = cat->journal.pending.length;
+        memcpy(header, &size, 4);
+        bufferAppend(&cat->journal.pending, header, sizeof(header));
+        bufferAppend(&cat->journal.pending, payload, length);
+
+        // Checksum covers the op byte and payload
+        uint32_t checksum = journalChecksum(cat->journal.pending.data + start + JOURNAL_RECORD_HEADER, size);
+        memcpy(cat->journal.pending.data + start + 4, &checksum, 4);
+    }
+    if (cat->journal.pending.length >= JOURNAL_BUFFER_LIMIT) {
+        pthread_cond_signal(&cat->journal.wake);
+    }
+    pthread_mutex_unlock(&cat->journal.lock);
+}
+
+static void journalAddBook(LibCatalog* cat, const Book* book) {
+    char payload[8 + 2 * MAX_STR + 20];
+    size_t length = 8;
+    int32_t id = book->id, year = book->year;
+
+    memcpy(payload, &id, 4);
+    memcpy(payload + 4, &year, 4);
+    memcpy(payload + length, book->title, strlen(book->title) + 1);
+    length += strlen(book->title) + 1;
+    memcpy(payload + length, book->author, strlen(book->author) + 1);
+    length += strlen(book->author) + 1;
+    memcpy(payload + length, book->isbn, strlen(book->isbn) + 1);
+    length += strlen(book->isbn) + 1;
+    journalAppend(cat, JOURNAL_ADD, payload, length);
+}
+
+static void journalRemoveBook(LibCatalog* cat, int id) {
+    int32_t value = id;
+    journalAppend(cat, JOURNAL_REMOVE, (const char*)&value, 4);
+}
+
+static void journalIssueBook(LibCatalog* cat, const Book* book) {
+    char payload[20 + MAX_BORROWER_NAME];
+    int32_t id = book->id;
+    int64_t issue_date = (int64_t)book->issue_date, due_date = (int64_t)book->due_date;
+    size_t borrower = strlen(book->issued_to) + 1;
+
+    memcpy(payload, &id, 4);
+    memcpy(payload + 4, &issue_date, 8);
+    memcpy(payload + 12, &due_date, 8);
+    memcpy(payload + 20, book->issued_to, borrower);
+    journalAppend(cat, JOURNAL_ISSUE, payload, 20 + borrower);
+}
+
+static void journalReturnBook(LibCatalog* cat, int id) {
+    int32_t value = id;
+    journalAppend(cat, JOURNAL_RETURN, (const char*)&value, 4);
+}
+
+// Write everything queued so far with one write and one fsync
+static int journalFlush(LibCatalog* cat) {
+    int ok = 1;
+
+    pthread_mutex_lock(&cat->journal.io_lock);
+    pthread_mutex_lock(&cat->journal.lock);
+    ByteBuffer batch = cat->journal.pending;
+    cat->journal.pending = cat->journal.writing;
+    cat->journal.pending.length = 0;
+    pthread_mutex_unlock(&cat->journal.lock);
+
+    if (batch.length > 0 && cat->journal.fd >= 0) {
+        ok = writeAll(cat->journal.fd, batch.data, batch.length) && fsync(cat->journal.fd) == 0;
+        if (ok) {
+            cat->journal.file_size += batch.length;
+        }
+    }
+    batch.length = 0;
+    cat->journal.writing = batch;
+    pthread_mutex_unlock(&cat->journal.io_lock);
+    return ok;
+}
+
+static void* journalFlusherThread(void* arg) {
+    LibCatalog* cat = (LibCatalog*)arg;
+    pthread_mutex_lock(&cat->journal.lock);
+    while (cat->journal.running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)JOURNAL_FLUSH_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&cat->journal.wake, &cat->journal.lock, &deadline);
+
+        if (cat->journal.pending.length > 0) {
+            pthread_mutex_unlock(&cat->journal.lock);
+            journalFlush(cat);
+            pthread_mutex_lock(&cat->journal.lock);
+        }
+    }
+    pthread_mutex_unlock(&cat->journal.lock);
+    return NULL;
+}
+
+// Apply journal records on top of the loaded snapshot. Returns the number
+// of bytes that held complete, valid records (a torn tail is ignored).
+static size_t journalReplay(LibCatalog* cat, const char* data, size_t size, int* applied) {
+    size_t pos = JOURNAL_MAGIC_LEN;
+
+    *applied = 0;
+    if (size < JOURNAL_MAGIC_LEN || memcmp(data, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0) {
+        return 0;
+    }
+
+    while (pos + JOURNAL_RECORD_HEADER < size) {
+        uint32_t length, checksum;
+        memcpy(&length, data + pos, 4);
+        memcpy(&checksum, data + pos + 4, 4);
+        if (length == 0 || pos + JOURNAL_RECORD_HEADER + length > size ||
+            journalChecksum(data + pos + JOURNAL_RECORD_HEADER, length) != checksum) {
+            break;
+        }
+
+        const char* record = data + pos + JOURNAL_RECORD_HEADER;
+        const char* payload = record + 1;
+        int32_t id = 0;
+        if (length >= 5) {
+            memcpy(&id, payload, 4);
+        }
+        Book* book = searchBook(cat, id);
+
+        switch ((JournalOp)record[0]) {
+            case JOURNAL_ADD:
+                if (book == NULL && length >= 9) {
+                    int32_t year;
+                    const char* end = record + length;
+                    const char* title = payload + 8;
+                    const char* author = title + strnlen(title, end - title) + 1;
+                    const char* isbn = author < end ? author + strnlen(author, end - author) + 1 : end;
+                    if (isbn < end && memchr(isbn, '\0', end - isbn) != NULL) {
+                        memcpy(&year, payload + 4, 4);
+                        catalogAddBook(cat, id, title, author, isbn, year);
+                    }
+                }
+                break;
+            case JOURNAL_REMOVE:
+                if (book != NULL) {
+                    catalogRemoveBook(cat, book);
+                }
+                break;
+            case JOURNAL_ISSUE:
+                if (book != NULL && length > 21 && record[length - 1] == '\0') {
+                    int64_t issue_date, due_date;
+                    memcpy(&issue_date, payload + 4, 8);
+                    memcpy(&due_date, payload + 12, 8);
+                    catalogIssueBook(cat, book, payload + 20, (time_t)issue_date, (time_t)due_date);
+                }
+                break;
+            case JOURNAL_RETURN:
+                if (book != NULL) {
+                    catalogReturnBook(cat, book);
+                }
+                break;
+        }
+
+        (*applied)++;
+        pos += JOURNAL_RECORD_HEADER + length;
+    }
+    return pos;
+}
+
+static int journalReplayFile(LibCatalog* cat, const char* path, int* applied, size_t* valid, size_t* size) {
+    int mapped;
+    char* data = mapFile(path, size, &mapped);
+
+    *applied = 0;
+    *valid = 0;
+    if (data == NULL) {
+        *size = 0;
+        return 0;
+    }
+    *valid = journalReplay(cat, data, *size, applied);
+    unmapFile(data, *size, mapped);
+    return 1;
+}
+
+// Writes always append, so records land after the magic again once a
+// checkpoint has truncated the file
+static int journalCreateFile(LibCatalog* cat) {
+    cat->journal.fd = open(cat->journal_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (cat->journal.fd < 0) {
+        return 0;
+    }
+    cat->journal.file_size = JOURNAL_MAGIC_LEN;
+    return writeAll(cat->journal.fd, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) && fsync(cat->journal.fd) == 0;
+}
+
+// Replay any journal left by the previous run and start journaling
+static int journalOpen(LibCatalog* cat, int* replayed) {
+    int applied, old_applied;
+    size_t valid, size, old_valid, old_size;
+    int have_old = journalReplayFile(cat, cat->journal_old_path, &old_applied, &old_valid, &old_size);
+    int have_current = journalReplayFile(cat, cat->journal_path, &applied, &valid, &size);
+
+    *replayed = -1;
+    if (have_old || applied > 0) {
+        *replayed = old_applied + applied;
+        log_message(LOG_INFO, "Journal replayed");
+    }
+
+    if (have_current && valid >= JOURNAL_MAGIC_LEN) {
+        cat->journal.fd = open(cat->journal_path, O_WRONLY | O_APPEND);
+        if (cat->journal.fd >= 0 && valid < size && ftruncate(cat->journal.fd, (off_t)valid) != 0) {
+            close(cat->journal.fd);
+            cat->journal.fd = -1;
+        }
+        cat->journal.file_size = valid;
+    }
+    if (cat->journal.fd < 0 && !journalCreateFile(cat)) {
+        log_message(LOG_ERROR, "Cannot open journal, saving full snapshots instead");
+        return 0;
+    }
+
+    cat->journal.enabled = 1;
+    cat->journal.running = 1;
+    if (pthread_create(&cat->journal.flusher, NULL, journalFlusherThread, cat) != 0) {
+        cat->journal.running = 0;
+    }
+
+    // A rotated journal means the last compaction never finished
+    if (have_old) {
+        journalCheckpoint(cat, 1);
+    }
+    return 1;
+}
+
+static void* journalCompactorThread(void* arg) {
+    LibCatalog* cat = (LibCatalog*)arg;
+    int ok = writeFileAtomic(cat->data_path, cat->journal.image.data, cat->journal.image.length);
+    bufferFree(&cat->journal.image);
+
+    if (ok) {
+        remove(cat->journal_old_path);
+        log_message(LOG_INFO, "Journal compacted into snapshot");
+    } else {
+        cat->journal.compact_failed = 1;
+        log_message(LOG_ERROR, "Journal compaction failed");
+    }
+    return NULL;
+}
+
+// Move the current journal aside so new records go to a fresh file while
+// the snapshot that covers the old one is written. If an earlier rotated
+// journal is still around (failed compaction) the current one is appended
+// to it instead of replacing it.
+static int journalRotate(LibCatalog* cat) {
+    close(cat->journal.fd);
+    cat->journal.fd = -1;
+
+    FILE* old = fopen(cat->journal_old_path, "rb");
+    if (old == NULL) {
+        if (rename(cat->journal_path, cat->journal_old_path) != 0) {
+            cat->journal.fd = open(cat->journal_path, O_WRONLY | O_APPEND);
+            return 0;
+        }
+    } else {
+        fclose(old);
+        size_t size;
+        int mapped;
+        char* data = mapFile(cat->journal_path, &size, &mapped);
+        if (data != NULL) {
+            int fd = open(cat->journal_old_path, O_WRONLY | O_APPEND);
+            int ok = fd >= 0 && size > JOURNAL_MAGIC_LEN &&
+                     writeAll(fd, data + JOURNAL_MAGIC_LEN, size - JOURNAL_MAGIC_LEN) &&
+                     fsync(fd) == 0;
+            if (fd >= 0) close(fd);
+            unmapFile(data, size, mapped);
+            if (!ok && size > JOURNAL_MAGIC_LEN) {
+                cat->journal.fd = open(cat->journal_path, O_WRONLY | O_APPEND);
+                return 0;
+            }
+        }
+    }
+    return journalCreateFile(cat);
+}
+
+// Fold the journal into a new snapshot. The catalog image is captured on
+// the calling thread; writing it happens in the background unless `wait`.
+// Small change sets are patched into library.dat directly, after which
+// the journal is simply emptied.
+static int journalCheckpoint(LibCatalog* cat, int wait) {
+    if (!cat->journal.enabled) {
+        return saveCatalogFile(cat);
+    }
+
+    if (cat->journal.compacting) {
+        pthread_join(cat->journal.compactor, NULL);
+        cat->journal.compacting = 0;
+    }
+    if (cat->journal.compact_failed) {
+        cat->changes.base_valid = 0;
+        cat->journal.compact_failed = 0;
+    }
+    if (!journalFlush(cat)) {
+        return 0;
+    }
+
+    if (snapshotPatchable(cat)) {
+        if (patchSnapshot(cat)) {
+            pthread_mutex_lock(&cat->journal.io_lock);
+            int reset = ftruncate(cat->journal.fd, JOURNAL_MAGIC_LEN) == 0 && fsync(cat->journal.fd) == 0;
+            if (reset) {
+                cat->journal.file_size = JOURNAL_MAGIC_LEN;
+            }
+            pthread_mutex_unlock(&cat->journal.io_lock);
+            remove(cat->journal_old_path);
+            return 1;
+        }
+        cat->changes.base_valid = 0;     // file may be half patched; rewrite it
+    }
+
+    if (!buildCatalogImage(cat, &cat->journal.image)) {
+        bufferFree(&cat->journal.image);
+        return 0;
+    }
+    rebaseChangeSet(cat, cat->journal.image.length);
+
+    pthread_mutex_lock(&cat->journal.io_lock);
+    int rotated = journalRotate(cat);
+    pthread_mutex_unlock(&cat->journal.io_lock);
+    if (!rotated) {
+        bufferFree(&cat->journal.image);
+        return 0;
+    }
+    if (!wait && pthread_create(&cat->journal.compactor, NULL, journalCompactorThread, cat) == 0) {
+        cat->journal.compacting = 1;
+        return 1;
+    }
+    journalCompactorThread(cat);
+    return 1;
+}
+
+// Group-commit pending records now; start a compaction once the journal
+// has grown large enough
+static int journalCommit(LibCatalog* cat) {
+    if (!journalFlush(cat)) {
+        return 0;
+    }
+    if (cat->journal.file_size > JOURNAL_COMPACT_BYTES && !cat->journal.compacting) {
+        journalCheckpoint(cat, 0);
+    }
+    return 1;
+}
+
+static void journalClose(LibCatalog* cat) {
+    if (!cat->journal.enabled) return;
+
+    pthread_mutex_lock(&cat->journal.lock);
+    cat->journal.running = 0;
+    pthread_cond_signal(&cat->journal.wake);
+    pthread_mutex_unlock(&cat->journal.lock);
+    pthread_join(cat->journal.flusher, NULL);
+
+    journalFlush(cat);
+    if (cat->journal.compacting) {
+        pthread_join(cat->journal.compactor, NULL);
+        cat->journal.compacting = 0;
+    }
+    close(cat->journal.fd);
+    cat->journal.fd = -1;
+    cat->journal.enabled = 0;
+    bufferFree(&cat->journal.pending);
+    bufferFree(&cat->journal.writing);
+}
+
+// Resolve a heap string, rejecting offsets that would run off the heap
+static const char* snapshotString(const char* heap, uint64_t heap_size, uint32_t offset) {
+    if (offset >= heap_size || memchr(heap + offset, '\0', heap_size - offset) == NULL) {
+        return NULL;
+    }
+    return heap + offset;
+}
+
+// Build books from `count` snapshot records starting at `records` and
+// chain them onto first/last. Tombstoned records are counted in `dead`.
+static int loadSnapshotRecords(LibCatalog* cat, const char* data, uint64_t records, uint32_t count,
+                               const char* heap, uint64_t heap_size,
+                               Book** first, Book** last, int* loaded, int* max_id, size_t* dead) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t offset = records + (uint64_t)i * sizeof(SnapshotRecord);
+        SnapshotRecord record;
+        memcpy(&record, data + offset, sizeof(record));
+
+        if (record.id >= *max_id) {
+            *max_id = record.id + 1;
+        }
+        if (record.removed) {
+            (*dead)++;
+            continue;
+        }
+
+        const char* title = snapshotString(heap, heap_size, record.title_off);
+        const char* author = snapshotString(heap, heap_size, record.author_off);
+        const char* isbn = snapshotString(heap, heap_size, record.isbn_off);
+        if (title == NULL || author == NULL || isbn == NULL) {
+            continue;
+        }
+
+        Book* newBook = createBook(cat, record.id, (char*)title, (char*)author, (char*)isbn, record.year);
+        if (newBook == NULL) {
+            return 0;
+        }
+        newBook->is_issued = record.is_issued;
+        record.issued_to[MAX_BORROWER_NAME - 1] = '\0';
+        safe_strcpy(newBook->issued_to, record.issued_to, MAX_BORROWER_NAME);
+        newBook->issue_date = (time_t)record.issue_date;
+        newBook->due_date = (time_t)record.due_date;
+        syncHotColumns(cat, newBook);
+        bookSlab(cat, newBook)->record_offset[newBook->slot % SLAB_BOOKS] = offset;
+
+        newBook->prev = *last;
+        if (*last == NULL) {
+            *first = newBook;
+        } else {
+            (*last)->next = newBook;
+        }
+        *last = newBook;
+        (*loaded)++;
+    }
+    return 1;
+}
+
+// Load a VERSION:3 binary snapshot, including appended segments, from the
+// mapped file. Returns 0 if a record or segment runs past the end of the
+// file; whatever was read before that is still loaded.
+static int loadSnapshotData(LibCatalog* cat, const char* data, size_t size) {
+    SnapshotHeader header;
+    if (size < SNAPSHOT_MAGIC_LEN + sizeof(header) ||
+        memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) != 0) {
+        return 0;
+    }
+    memcpy(&header, data + SNAPSHOT_MAGIC_LEN, sizeof(header));
+
+    // Offsets come from the file: compare against what is left after them
+    // so that no sum can wrap
+    if (header.record_size != sizeof(SnapshotRecord) ||
+        header.records_offset > size ||
+        (uint64_t)header.book_count * sizeof(SnapshotRecord) > size - header.records_offset ||
+        header.heap_offset > size || header.heap_size > size - header.heap_offset) {
+        return 0;
+    }
+
+    Book* first = NULL;
+    Book* last = NULL;
+    int loaded = 0;
+    int max_id = 0;
+    size_t dead = 0;
+
+    indexReserve(cat, &cat->title_index, header.book_count);
+    indexReserve(cat, &cat->isbn_index, header.book_count);
+
+    int ok = loadSnapshotRecords(cat, data, header.records_offset, header.book_count,
+                                 data + header.heap_offset, header.heap_size,
+                                 &first, &last, &loaded, &max_id, &dead);
+
+    uint64_t end = header.heap_offset + header.heap_size;
+    uint32_t segments = 0;
+    while (ok && segments < header.segments) {
+        SnapshotSegment segment;
+        if (sizeof(segment) > size - end) break;
+        memcpy(&segment, data + end, sizeof(segment));
+
+        uint64_t records = end + sizeof(segment);
+        uint64_t records_size = (uint64_t)segment.book_count * sizeof(SnapshotRecord);
+        if (records_size > size - records) break;
+        uint64_t heap = records + records_size;
+        if (segment.heap_size > size - heap) break;
+
+        ok = loadSnapshotRecords(cat, data, records, segment.book_count, data + heap, segment.heap_size,
+                                 &first, &last, &loaded, &max_id, &dead);
+        end = heap + segment.heap_size;
+        segments++;
+    }
+
+    appendBooks(cat, first, last, loaded);
+    cat->next_id = (int)header.next_id > max_id ? (int)header.next_id : max_id;
+
+    ok = ok && segments == header.segments;
+    cat->changes.base_valid = ok;
+    cat->changes.segments = segments;
+    cat->changes.snapshot_end = end;
+    cat->changes.dead_records = dead;
+    return ok;
+}
+
+static LibStatus loadFromFile(LibCatalog* cat) {
+    size_t size;
+    int mapped;
+    char* data = mapFile(cat->data_path, &size, &mapped);
+    if (data == NULL) {
+        return LIB_ERR_NOT_FOUND;
+    }
+
+    int ok;
+    if (size >= SNAPSHOT_MAGIC_LEN && memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) == 0) {
+        ok = loadSnapshotData(cat, data, size);
+    } else {
+        ok = loadTextData(cat, data, size);
+    }
+    unmapFile(data, size, mapped);
+
+    if (!ok) {
+        log_message(LOG_ERROR, "Cannot load data file");
+        return LIB_ERR_CORRUPT;
+    }
+
+    log_message(LOG_INFO, "Data loaded from file");
+    return LIB_OK;
+}
+
+// Path of one of the catalog's files; 0 if it does not fit
+static int catalogPath(const LibCatalog* cat, char* out, const char* name) {
+    int length;
+    if (cat->dir[0] == '\0') {
+        length = snprintf(out, LIB_PATH_MAX, "%s", name);
+    } else {
+        length = snprintf(out, LIB_PATH_MAX, "%s/%s", cat->dir, name);
+    }
+    return length >= 0 && length < LIB_PATH_MAX;
+}
+
+static LibCatalog* catalogNew() {
+    LibCatalog* cat = (LibCatalog*)calloc(1, sizeof(LibCatalog));
+    if (cat == NULL) {
+        return NULL;
+    }
+    initSearchKernel();
+
+    cat->next_id = 1;
+    SkipList title_order = {NULL, 0, 0, 0x9e3779b9u, 0, compareByTitle};
+    SkipList author_order = {NULL, 0, 0, 0x85ebca6bu, 0, compareByAuthor};
+    cat->title_order = title_order;
+    cat->author_order = author_order;
+    cat->journal.fd = -1;
+    pthread_mutex_init(&cat->journal.lock, NULL);
+    pthread_mutex_init(&cat->journal.io_lock, NULL);
+    pthread_cond_init(&cat->journal.wake, NULL);
+    pthread_mutex_init(&cat->write_lock, NULL);
+
+    // Shard count rounded up to a power of two
+    int shards = threadCount(shard_setting, 1, 0);
+    int bits = 0;
+    while ((1 << bits) < shards && (1 << bits) < MAX_SHARDS) {
+        bits++;
+    }
+    cat->shards = (CatalogShard*)alignedAlloc(sizeof(CatalogShard) << bits);
+    if (cat->shards == NULL) {
+        libClose(cat);
+        return NULL;
+    }
+    memset(cat->shards, 0, sizeof(CatalogShard) << bits);
+    for (int i = 0; i < (1 << bits); i++) {
+        pthread_mutex_init(&cat->shards[i].lock, NULL);
+        cat->shards[i].due_queue.next_due = DUE_NEVER;
+        cat->shards[i].borrower_index.locked = 1;
+    }
+    cat->shard_count = 1 << bits;
+    cat->shard_bits = bits;
+
+    cat->epoch.slots = (EpochSlot*)alignedAlloc(EPOCH_SLOTS * sizeof(EpochSlot));
+    if (cat->epoch.slots == NULL) {
+        libClose(cat);
+        return NULL;
+    }
+    memset(cat->epoch.slots, 0, EPOCH_SLOTS * sizeof(EpochSlot));
+
+    initializeDefaultAdmin(cat);
+    if (cat->user_count == 0) {
+        libClose(cat);
+        return NULL;
+    }
+    return cat;
+}
+
+LibCatalog* libCreate() {
+    return catalogNew();
+}
+
+LibCatalog* libOpen(const char* dir, LibOpenReport* report) {
+    LibCatalog* cat = catalogNew();
+    if (cat == NULL) {
+        return NULL;
+    }
+
+    safe_strcpy(cat->dir, dir != NULL ? dir : "", LIB_PATH_MAX);
+    if (!catalogPath(cat, cat->data_path, FILENAME) ||
+        !catalogPath(cat, cat->user_path, USERFILE) ||
+        !catalogPath(cat, cat->journal_path, JOURNALFILE) ||
+        !catalogPath(cat, cat->journal_old_path, JOURNAL_OLD_FILE)) {
+        libClose(cat);
+        return NULL;
+    }
+    cat->persistent = 1;
+
+    // Users first (the default admin stays when there are none), then the
+    // library data, then the changes journaled since that snapshot
+    loadUsersFromFile(cat, report);
+    report->data = loadFromFile(cat);
+    journalOpen(cat, &report->journal_records);
+    report->books = cat->book_count;
+
+    // Nobody can be reading yet; release what loading retired
+    epochCollect(cat);
+    return cat;
+}
+
+void libClose(LibCatalog* cat) {
+    if (cat == NULL) return;
+
+    if (cat->journal.enabled && cat->journal.file_size > JOURNAL_COMPACT_BYTES) {
+        journalCheckpoint(cat, 1);
+    }
+    journalClose(cat);
+    freeList(cat);
+    userClear(cat);
+    free(cat->changes.removed);
+    epochDrain(cat);
+    free(cat->epoch.retired);
+    alignedFree(cat->epoch.slots);
+    for (int i = 0; i < cat->shard_count; i++) {
+        free(cat->shards[i].dirty);
+        pthread_mutex_destroy(&cat->shards[i].lock);
+    }
+    alignedFree(cat->shards);
+    pthread_mutex_destroy(&cat->journal.lock);
+    pthread_mutex_destroy(&cat->journal.io_lock);
+    pthread_cond_destroy(&cat->journal.wake);
+    pthread_mutex_destroy(&cat->write_lock);
+    free(cat);
+}
+
+// Commit the catalog (a journal group commit when journaling) and any
+// new or changed users
+LibStatus libSave(LibCatalog* cat) {
+    if (!cat->persistent) {
+        return LIB_OK;
+    }
+    catalogLockAll(cat);
+    int ok = saveToFile(cat);
+    ok &= saveUsersToFile(cat);
+    catalogUnlockAll(cat);
+    return ok ? LIB_OK : LIB_ERR_IO;
+}
+
+int libHasUnsavedChanges(LibCatalog* cat) {
+    if (!cat->persistent) return 0;
+    catalogLockAll(cat);
+    int unsaved = hasUnsavedChanges(cat);
+    catalogUnlockAll(cat);
+    return unsaved;
+}
+
+static const char* findLineEnd(const char* p, const char* end) {
+    const char* nl = (const char*)memchr(p, '\n', end - p);
+    return nl ? nl : end;
+}
+
+// Parse a decimal integer from a field that is not NUL-terminated
+static long parseLong(const char* p, size_t len) {
+    const char* end = p + len;
+    long value = 0;
+    int negative = 0;
+
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    return negative ? -value : value;
+}
+
+// Reentrant '|' tokenizer over [p, line_end). Unlike strtok it keeps
+// empty fields, so a book with no borrower does not shift later columns.
+static const char* nextField(const char* p, const char* line_end,
+                             const char** field, size_t* length) {
+    const char* sep = (const char*)memchr(p, '|', line_end - p);
+    const char* stop = sep ? sep : line_end;
+
+    *field = p;
+    *length = (size_t)(stop - p);
+    return sep ? sep + 1 : line_end;
+}
+
+// Copy a non-terminated field, truncating like safe_strcpy
+static void copyField(char* dest, size_t dest_size, const char* src, size_t length) {
+    if (length >= dest_size) {
+        length = dest_size - 1;
+    }
+    memcpy(dest, src, length);
+    dest[length] = '\0';
+}
+
+static int parseLine(const char* p, const char* line_end, ParsedLine* out) {
+    const char* field;
+    size_t length;
+
+    if (line_end > p && line_end[-1] == '\r') {
+        line_end--;
+    }
+    if (line_end == p) {
+        return 0;
+    }
+
+    memset(out, 0, sizeof(*out));
+    p = nextField(p, line_end, &field, &length);
+    out->id = (int)parseLong(field, length);
+
+    for (int i = 0; i < 3; i++) {
+        p = nextField(p, line_end, &out->field[i], &out->length[i]);
+    }
+
+    p = nextField(p, line_end, &field, &length);
+    out->year = (int)parseLong(field, length);
+    p = nextField(p, line_end, &field, &length);
+    out->is_issued = (int)parseLong(field, length);
+    p = nextField(p, line_end, &out->field[3], &out->length[3]);
+    p = nextField(p, line_end, &field, &length);
+    out->issue_date = (time_t)parseLong(field, length);
+    nextField(p, line_end, &field, &length);
+    out->due_date = (time_t)parseLong(field, length);
+    return 1;
+}
+
+// Pool body: parse every line of chunks [begin, end)
+static void parseChunkLines(void* arg, size_t begin, size_t end) {
+    for (ParseChunk* chunk = (ParseChunk*)arg + begin; chunk < (ParseChunk*)arg + end; chunk++) {
+        const char* p = chunk->begin;
+
+        while (p < chunk->end) {
+            const char* line_end = findLineEnd(p, chunk->end);
+
+            if (chunk->count == chunk->capacity) {
+                int capacity = chunk->capacity ? chunk->capacity * 2 : 1024;
+                ParsedLine* lines = (ParsedLine*)realloc(chunk->lines, capacity * sizeof(ParsedLine));
+                if (lines == NULL) {
+                    chunk->failed = 1;
+                    break;
+                }
+                chunk->lines = lines;
+                chunk->capacity = capacity;
+            }
+
+            if (parseLine(p, line_end, &chunk->lines[chunk->count])) {
+                chunk->count++;
+            }
+            p = line_end + 1;
+        }
+    }
+}
+
+// Pool body: fill the pre-allocated books of chunks [begin, end)
+static void buildChunkBooks(void* arg, size_t begin, size_t end) {
+    for (ParseChunk* chunk = (ParseChunk*)arg + begin; chunk < (ParseChunk*)arg + end; chunk++) {
+        for (int i = 0; i < chunk->count; i++) {
+            ParsedLine* line = &chunk->lines[i];
+            Book* book = line->book;
+
+            book->id = line->id;
+            copyField(book->title, MAX_STR, line->field[0], line->length[0]);
+            copyField(book->author, MAX_STR, line->field[1], line->length[1]);
+            copyField(book->isbn, 20, line->field[2], line->length[2]);
+            copyField(book->issued_to, MAX_BORROWER_NAME, line->field[3], line->length[3]);
+            book->year = line->year;
+            book->is_issued = line->is_issued;
+            book->issue_date = line->issue_date;
+            book->due_date = line->due_date;
+            finishBook(chunk->cat, book);
+        }
+    }
+}
+
+// Worker threads for `size` units of work: `configured`, or one per CPU
+// when that is 0, and a single thread below `minimum`
+static int threadCount(int configured, size_t size, size_t minimum) {
+    int threads = configured;
+
+    if (size < minimum) {
+        return 1;
+    }
+    if (threads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+        threads = 4;
+#endif
+    }
+    if (threads < 1) threads = 1;
+    if (threads > 64) threads = 64;
+    return threads;
+}
+
+// Run `body` over `count` tasks of `stride` bytes each, one thread per
+// task (the first runs on the calling thread). Only for the benchmarks,
+// whose tasks must really run side by side; data-parallel work goes
+// through the pool below.
+static void runChunks(void* (*body)(void*), void* tasks, size_t stride, int count) {
+    pthread_t threads[64];
+    int started[64];
+    char* task = (char*)tasks;
+
+    for (int i = 1; i < count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, body, task + i * stride) == 0;
+        if (!started[i]) {
+            body(task + i * stride);
+        }
+    }
+    body(task);
+    for (int i = 1; i < count; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+static void* poolWorker(void* arg);
+
+static void poolStart() {
+    int threads = threadCount(POOL_THREADS, 1, 0);
+    pool.deques = (PoolDeque*)calloc((size_t)threads, sizeof(PoolDeque));
+    if (pool.deques == NULL) {
+        return;
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_mutex_init(&pool.deques[i].lock, NULL);
+    }
+    pool.threads = threads;
+
+    // Workers never exit; they sleep on `work` while there is nothing to
+    // run. A worker that fails to start leaves an empty deque behind.
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (intptr_t i = 1; i < threads; i++) {
+        pthread_t worker;
+        if (pthread_create(&worker, &attr, poolWorker, (void*)i) != 0) {
+            log_message(LOG_WARNING, "Cannot start pool worker thread");
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+// Threads that share data-parallel work, the caller included
+static int poolThreads() {
+    pthread_once(&pool.once, poolStart);
+    return pool.threads;
+}
+
+// Put a range on the bottom of this thread's deque; 0 when it is full
+static int poolPush(PoolRange range) {
+    PoolDeque* deque = &pool.deques[pool_self];
+
+    pthread_mutex_lock(&deque->lock);
+    size_t bottom = deque->bottom;
+    int pushed = bottom - deque->top < POOL_DEQUE_SIZE;
+    if (pushed) {
+        deque->ranges[bottom % POOL_DEQUE_SIZE] = range;
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    if (pushed) {
+        __atomic_add_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pool.idle, __ATOMIC_SEQ_CST) > 0) {
+            pthread_mutex_lock(&pool.lock);
+            pthread_cond_signal(&pool.work);
+            pthread_mutex_unlock(&pool.lock);
+        }
+    }
+    return pushed;
+}
+
+// Pop the newest range of this thread's deque or, failing that, steal the
+// oldest of another's
+static int poolTake(PoolRange* range) {
+    for (int i = 0; i < pool.threads; i++) {
+        PoolDeque* deque = &pool.deques[(pool_self + i) % pool.threads];
+        if (__atomic_load_n(&deque->top, __ATOMIC_ACQUIRE) ==
+            __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        pthread_mutex_lock(&deque->lock);
+        int found = deque->top != deque->bottom;
+        if (found && i == 0) {
+            *range = deque->ranges[(deque->bottom - 1) % POOL_DEQUE_SIZE];
+            __atomic_store_n(&deque->bottom, deque->bottom - 1, __ATOMIC_RELEASE);
+        } else if (found) {
+            *range = deque->ranges[deque->top % POOL_DEQUE_SIZE];
+            __atomic_store_n(&deque->top, deque->top + 1, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        if (found) {
+            __atomic_sub_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Split a range down to its job's grain, leaving the upper halves for
+// others to steal, run what is left and account for it
+static void poolRun(PoolRange range) {
+    PoolJob* job = range.job;
+
+    while (range.end - range.begin > job->grain) {
+        size_t mid = range.begin + (range.end - range.begin) / 2;
+        PoolRange upper = {job, mid, range.end};
+        if (!poolPush(upper)) break;
+        range.end = mid;
+    }
+    job->body(job->ctx, range.begin, range.end);
+
+    // The job lives on its caller's stack and may be gone once the count
+    // reaches zero
+    if (__atomic_sub_fetch(&job->remaining, range.end - range.begin, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&pool.lock);
+        pthread_cond_broadcast(&pool.done);
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
+
+static void* poolWorker(void* arg) {
+    pool_self = (int)(intptr_t)arg;
+
+    for (;;) {
+        PoolRange range;
+        if (poolTake(&range)) {
+            poolRun(range);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        __atomic_add_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool.queued, __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&pool.work, &pool.lock);
+        }
+        __atomic_sub_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    return NULL;
+}
+
+// Run body(ctx, begin, end) over disjoint ranges covering [0, count), no
+// longer than `grain` each unless the deques fill up, on the pool and
+// the calling thread. Returns once every range has run.
+static void parallelFor(size_t count, size_t grain, PoolBody body, void* ctx) {
+    if (grain < 1) grain = 1;
+    if (count <= grain || poolThreads() < 2) {
+        if (count > 0) body(ctx, 0, count);
+        return;
+    }
+
+    PoolJob job = {body, ctx, grain, count};
+    PoolRange all = {&job, 0, count};
+    poolRun(all);
+
+    // Help with whatever is queued, ours or not, until our ranges are done
+    while (__atomic_load_n(&job.remaining, __ATOMIC_ACQUIRE) > 0) {
+        PoolRange range;
+        if (poolTake(&range)) {
+            poolRun(range);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+        while (__atomic_load_n(&job.remaining, __ATOMIC_ACQUIRE) > 0 &&
+               __atomic_load_n(&pool.queued, __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&pool.done, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+    }
+}
+
+typedef struct {
+    PoolPart body;
+    void* ctx;
+    char* partials;
+    size_t partial_size;
+    size_t count;
+    size_t grain;
+} ReduceJob;
+
+static void reduceParts(void* arg, size_t begin, size_t end) {
+    ReduceJob* job = (ReduceJob*)arg;
+
+    for (size_t part = begin; part < end; part++) {
+        size_t last = (part + 1) * job->grain;
+        job->body(job->ctx, part * job->grain, last < job->count ? last : job->count,
+                  job->partials + part * job->partial_size);
+    }
+}
+
+// Fold [0, count) into `result` in parts of `grain` indices: each part is
+// folded by body(ctx, begin, end, partial) into its own zeroed partial of
+// `partial_size` bytes on the pool, then merge(ctx, result, partial) takes
+// them in index order on the calling thread, so ordered output such as a
+// list of matches comes out as a serial run would produce it. Small inputs
+// are folded straight into `result`.
+static void parallelReduce(size_t count, size_t grain, size_t partial_size, PoolPart body, PoolMerge merge,
+                           void* ctx, void* result) {
+    if (grain < 1) grain = 1;
+    size_t parts = (count + grain - 1) / grain;
+    char* partials = NULL;
+
+    if (parts > 1 && poolThreads() > 1) {
+        partials = (char*)calloc(parts, partial_size);
+    }
+    if (partials == NULL) {
+        if (count > 0) body(ctx, 0, count, result);
+        return;
+    }
+
+    ReduceJob job = {body, ctx, partials, partial_size, count, grain};
+    parallelFor(parts, 1, reduceParts, &job);
+    for (size_t part = 0; part < parts; part++) {
+        merge(ctx, result, partials + part * partial_size);
+    }
+    free(partials);
+}
+
+// Load the pipe-delimited text formats (VERSION:2 and the unversioned
+// original). The body is split into newline-aligned chunks that are parsed
+// in parallel, books are allocated in file order, filled in parallel and
+// finally stitched onto the catalog in order.
+static int loadTextData(LibCatalog* cat, const char* data, size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    int version = 1;
+    int file_next_id = 0;
+
+    if (size >= 8 && strncmp(p, "VERSION:", 8) == 0) {
+        version = (int)parseLong(p + 8, findLineEnd(p, end) - (p + 8));
+        if (version > 2) {
+            return 0;
+        }
+        p = findLineEnd(p, end) + 1;
+
+        // NEXT_ID, BOOK_COUNT and the separator line
+        for (int i = 0; i < 3 && p < end; i++) {
+            const char* line_end = findLineEnd(p, end);
+            if (strncmp(p, "NEXT_ID:", 8) == 0) {
+                file_next_id = (int)parseLong(p + 8, line_end - (p + 8));
+            } else if (strncmp(p, "BOOK_COUNT:", 11) == 0) {
+                long expected = parseLong(p + 11, line_end - (p + 11));
+                if (expected > 0) {
+                    indexReserve(cat, &cat->title_index, (size_t)expected);
+                    indexReserve(cat, &cat->isbn_index, (size_t)expected);
+                }
+            }
+            p = line_end + 1;
+        }
+    }
+    if (p > end) p = end;
+
+    // A few chunks per pool thread, so a thread that finishes early can
+    // steal from one that drew dense lines
+    int chunk_count = (size_t)(end - p) < PARALLEL_LOAD_MIN ? 1 : poolThreads() * 4;
+    if (chunk_count > 64) chunk_count = 64;
+    ParseChunk chunks[64];
+    memset(chunks, 0, sizeof(chunks));
+
+    // Split on newline boundaries so no line straddles two chunks
+    const char* begin = p;
+    for (int i = 0; i < chunk_count; i++) {
+        const char* stop = end;
+        if (i < chunk_count - 1) {
+            stop = p + (size_t)(end - p) / chunk_count * (i + 1);
+            if (stop < begin) stop = begin;
+            stop = findLineEnd(stop, end);
+            if (stop < end) stop++;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = stop;
+        chunks[i].cat = cat;
+        begin = stop;
+    }
+
+    parallelFor((size_t)chunk_count, 1, parseChunkLines, chunks);
+
+    // Allocation stays on this thread; the pools are not thread-safe.
+    // Each book comes from the pool of the shard its ID belongs to. After
+    // a failure the remaining chunks are dropped.
+    int ok = 1;
+    for (int i = 0; i < chunk_count; i++) {
+        if (!ok || chunks[i].failed) {
+            ok = 0;
+            chunks[i].count = 0;
+            continue;
+        }
+        for (int j = 0; j < chunks[i].count; j++) {
+            chunks[i].lines[j].book = poolAlloc(cat, &shardFor(cat, chunks[i].lines[j].id)->pool);
+            if (chunks[i].lines[j].book == NULL) {
+                chunks[i].count = j;
+                ok = 0;
+                break;
+            }
+            chunks[i].lines[j].book->order = cat->next_order++;
+        }
+    }
+
+    parallelFor((size_t)chunk_count, 1, buildChunkBooks, chunks);
+
+    Book* first = NULL;
+    Book* last = NULL;
+    int loaded = 0;
+    int max_id = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        for (int j = 0; j < chunks[i].count; j++) {
+            Book* book = chunks[i].lines[j].book;
+
+            book->prev = last;
+            if (last == NULL) {
+                first = book;
+            } else {
+                last->next = book;
+            }
+            last = book;
+            loaded++;
+
+            if (book->id >= max_id) {
+                max_id = book->id + 1;
+            }
+        }
+        free(chunks[i].lines);
+    }
+
+    appendBooks(cat, first, last, loaded);
+
+    // If we didn't get next_id from file, calculate it
+    cat->next_id = file_next_id;
+    if (version == 1 || cat->next_id <= max_id) {
+        cat->next_id = max_id;
+    }
+    return ok;
+}
+
+// Export text of a run of books, formatted on a pool thread
+#define EXPORT_BOOK_MAX 1024    // more than one book's text can take
+
+typedef struct {
+    char* text;
+    size_t length;
+    size_t capacity;
+    int failed;
+} ExportText;
+
+typedef struct {
+    Book** books;
+    time_t now;
+} ExportJob;
+
+static int reserveText(ExportText* out, size_t extra) {
+    if (out->capacity - out->length >= extra) return 1;
+
+    size_t capacity = out->capacity ? out->capacity * 2 : 64 * 1024;
+    while (capacity - out->length < extra) capacity *= 2;
+    char* text = (char*)realloc(out->text, capacity);
+    if (text == NULL) {
+        out->failed = 1;
+        return 0;
+    }
+    out->text = text;
+    out->capacity = capacity;
+    return 1;
+}
+
+static void formatBooks(void* arg, size_t begin, size_t end, void* partial) {
+    ExportJob* job = (ExportJob*)arg;
+    ExportText* out = (ExportText*)partial;
+
+    for (size_t i = begin; i < end && reserveText(out, EXPORT_BOOK_MAX); i++) {
+        // Each book is copied consistently before it is printed
+        LibBook book;
+        copyBook(&book, job->books[i]);
+        char* p = out->text + out->length;
+        p += sprintf(p, "ID: %d\nTitle: %s\nAuthor: %s\nISBN: %s\nYear: %d\nStatus: %s\n",
+                     book.id, book.title, book.author, book.isbn, book.year,
+                     book.is_issued ? "Issued" : "Available");
+        if (book.is_issued) {
+            // ctime() shares one buffer between threads; ctime_r does not
+            char issued[32], due[32];
+            p += sprintf(p, "Issued to: %s\nIssue date: %sDue date: %s", book.issued_to,
+                         ctime_r(&book.issue_date, issued) ? issued : "?\n",
+                         ctime_r(&book.due_date, due) ? due : "?\n");
+            double fine = calculateFineAt(book.due_date, job->now);
+            if (fine > 0) {
+                p += sprintf(p, "Fine: %.2f currency units\n", fine);
+            }
+        }
+        p += sprintf(p, "---------------------------\n");
+        out->length = (size_t)(p - out->text);
+    }
+}
+
+// Append one part's text to the batch, in catalog order
+static void mergeText(void* arg, void* result, void* partial) {
+    ExportText* all = (ExportText*)result;
+    ExportText* part = (ExportText*)partial;
+    (void)arg;
+
+    all->failed |= part->failed;
+    if (!all->failed && part->length > 0 && reserveText(all, part->length)) {
+        memcpy(all->text + all->length, part->text, part->length);
+        all->length += part->length;
+    }
+    free(part->text);
+}
+
+LibStatus libExportText(LibCatalog* cat, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        log_message(LOG_ERROR, "Cannot create export file");
+        return LIB_ERR_IO;
+    }
+
+    // A reader like any other: writers carry on while the file is written.
+    // Books are taken in batches and formatted in parts on the worker pool.
+    int pin = readBegin(cat);
+    time_t now = time(NULL);
+    char generated[64] = "?";
+    struct tm local;
+    if (localtime_r(&now, &local) != NULL) {
+        // ctime's layout, without its buffer shared between threads
+        strftime(generated, sizeof(generated), "%a %b %e %H:%M:%S %Y", &local);
+    }
+    fprintf(file, "=== Library Catalog Export ===\n");
+    fprintf(file, "Generated on: %s\n", generated);
+    fprintf(file, "Total books: %d\n\n", libBookCount(cat));
+
+    Book** batch = (Book**)malloc(EXPORT_BATCH * sizeof(Book*));
+    ExportJob job = {batch, now};
+    ExportText text = {NULL, 0, 0, batch == NULL};
+    int written = 1;
+    Book* current = firstBook(cat);
+    while (!text.failed && written && current != NULL) {
+        size_t count = 0;
+        for (; current != NULL && count < EXPORT_BATCH; current = nextBook(current)) {
+            batch[count++] = current;
+        }
+        text.length = 0;
+        parallelReduce(count, EXPORT_GRAIN, sizeof(ExportText), formatBooks, mergeText, &job, &text);
+        written = text.failed || fwrite(text.text, 1, text.length, file) == text.length;
+    }
+    readEnd(cat, pin);
+    free(batch);
+    free(text.text);
+
+    if (text.failed) {
+        fclose(file);
+        log_message(LOG_ERROR, "Export allocation failed");
+        return LIB_ERR_NO_MEMORY;
+    }
+    if (fclose(file) != 0 || !written) {
+        log_message(LOG_ERROR, "Cannot write export file");
+        return LIB_ERR_IO;
+    }
+    log_message(LOG_INFO, "Catalog exported to text file");
+    return LIB_OK;
+}
+
+LibStatus libImport(LibCatalog* cat, const char* path, ImportReport* report) {
+    catalogLockAll(cat);
+    int ok = importCatalog(cat, path, report);
+    catalogUnlockAll(cat);
+    return ok ? LIB_OK : LIB_ERR_IO;
+}
+
+// One field of an import record, pointing into the mapped file. Quoted
+// CSV fields keep their quotes' contents; `escaped` means "" pairs inside
+// still need collapsing when the field is copied.
+typedef struct {
+    const char* text;
+    size_t length;
+    int escaped;
+} ImportField;
+
+#define IMPORT_MAX_FIELDS 16
+
+// Split the record at *pos into fields without copying and move *pos to
+// the start of the next record. Quoted fields may contain delimiters and
+// newlines. Returns the number of fields (0 for a blank line).
+static int importNextRecord(const char** pos, const char* end, char delimiter,
+                            ImportField* fields) {
+    const char* p = *pos;
+    int count = 0;
+
+    if (p < end && (*p == '\n' || *p == '\r')) {
+        while (p < end && (*p == '\r' || *p == '\n')) {
+            if (*p++ == '\n') break;
+        }
+        *pos = p;
+        return 0;
+    }
+
+    for (;;) {
+        ImportField field = {p, 0, 0};
+
+        if (p < end && *p == '"') {
+            field.text = ++p;
+            while (p < end) {
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        field.escaped = 1;
+                        p += 2;
+                        continue;
+                    }
+                    break;
+                }
+                p++;
+            }
+            field.length = (size_t)(p - field.text);
+            if (p < end) p++;   // closing quote
+            while (p < end && *p != delimiter && *p != '\n') p++;
+        } else {
+            while (p < end && *p != delimiter && *p != '\n') p++;
+            field.length = (size_t)(p - field.text);
+            if (field.length > 0 && field.text[field.length - 1] == '\r') field.length--;
+        }
+
+        if (count < IMPORT_MAX_FIELDS) {
+            fields[count] = field;
+        }
+        count++;
+
+        if (p >= end || *p == '\n') {
+            *pos = p < end ? p + 1 : end;
+            return count < IMPORT_MAX_FIELDS ? count : IMPORT_MAX_FIELDS;
+        }
+        p++;    // delimiter
+    }
+}
+
+// Copy a field into a NUL-terminated buffer, trimming blanks around it.
+// Returns 0 if it does not fit.
+static int importCopyField(char* dest, size_t size, const ImportField* field) {
+    const char* text = field->text;
+    size_t length = field->length;
+    while (length > 0 && (*text == ' ' || *text == '\t')) { text++; length--; }
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t')) length--;
+
+    size_t out = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (out + 1 >= size) {
+            return 0;
+        }
+        dest[out++] = text[i];
+        if (field->escaped && text[i] == '"' && i + 1 < length && text[i + 1] == '"') {
+            i++;
+        }
+    }
+    dest[out] = '\0';
+    return 1;
+}
+
+static void importReject(ImportReport* report, int row, const char* reason, int duplicate) {
+    if (duplicate) {
+        report->duplicates++;
+    } else {
+        report->invalid++;
+    }
+    if (report->error_count < IMPORT_MAX_ERRORS) {
+        report->errors[report->error_count].row = row;
+        report->errors[report->error_count].reason = reason;
+        report->error_count++;
+    }
+}
+
+// Stream a CSV (comma) or TSV (tab) file into the catalog. Rows are
+// checked against the title and ISBN indexes, which also catch duplicates
+// inside the file since every accepted row is indexed at once. Nothing is
+// journaled per row: the whole import is committed by one checkpoint.
+static int importCatalog(LibCatalog* cat, const char* path, ImportReport* report) {
+    size_t size;
+    int mapped;
+    char* data = mapFile(path, &size, &mapped);
+
+    memset(report, 0, sizeof(*report));
+    if (data == NULL) {
+        // mapFile refuses empty files; those import as zero rows
+        FILE* file = fopen(path, "rb");
+        int empty = file != NULL && fgetc(file) == EOF && !ferror(file);
+        if (file != NULL) fclose(file);
+        report->saved = empty;
+        return empty;
+    }
+
+    const char* end = data + size;
+    const char* first_line_end = memchr(data, '\n', size);
+    if (first_line_end == NULL) first_line_end = end;
+    char delimiter = memchr(data, '\t', (size_t)(first_line_end - data)) ? '\t' : ',';
+
+    // Size the indexes for the whole file up front
+    size_t lines = 0;
+    for (const char* p = data; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++) {
+        lines++;
+    }
+    for (int i = 0; i < cat->shard_count; i++) {
+        CatalogShard* shard = &cat->shards[i];
+        indexReserve(cat, &shard->id_index, (size_t)shard->book_count + (lines + 1) / cat->shard_count + 1);
+    }
+    indexReserve(cat, &cat->title_index, (size_t)cat->book_count + lines + 1);
+    indexReserve(cat, &cat->isbn_index, (size_t)cat->book_count + lines + 1);
+
+    // Column order comes from the header row when there is one
+    int column[4] = {0, 1, 2, 3};   // title, author, isbn, year
+    const char* names[4] = {"title", "author", "isbn", "year"};
+    ImportField fields[IMPORT_MAX_FIELDS];
+    const char* pos = data;
+    int row = 1;
+
+    int count = importNextRecord(&pos, end, delimiter, fields);
+    char name[MAX_STR];
+    int is_header = 0;
+    for (int f = 0; f < count; f++) {
+        if (!importCopyField(name, sizeof(name), &fields[f])) continue;
+        for (int c = 0; c < 4; c++) {
+            if (strcasecmp(name, names[c]) == 0) {
+                if (!is_header) {
+                    column[0] = column[1] = column[2] = column[3] = -1;
+                    is_header = 1;
+                }
+                column[c] = f;
+            }
+        }
+    }
+    if (!is_header) {
+        pos = data;
+        row = 0;
+    }
+
+    char title[MAX_STR], author[MAX_STR], isbn[20], year_text[16];
+    while (pos < end) {
+        count = importNextRecord(&pos, end, delimiter, fields);
+        row++;
+        if (count == 0) continue;
+        report->rows++;
+
+        int missing = 0;
+        for (int c = 0; c < 4; c++) {
+            if (column[c] < 0 || column[c] >= count) missing = 1;
+        }
+        if (missing) {
+            importReject(report, row, "missing column", 0);
+            continue;
+        }
+
+        if (!importCopyField(title, sizeof(title), &fields[column[0]]) ||
+            !importCopyField(author, sizeof(author), &fields[column[1]]) ||
+            !importCopyField(isbn, sizeof(isbn), &fields[column[2]]) ||
+            !importCopyField(year_text, sizeof(year_text), &fields[column[3]])) {
+            importReject(report, row, "field too long", 0);
+            continue;
+        }
+        if (title[0] == '\0' || author[0] == '\0' || isbn[0] == '\0') {
+            importReject(report, row, "empty title, author or ISBN", 0);
+            continue;
+        }
+
+        char* year_end;
+        long year = strtol(year_text, &year_end, 10);
+        if (year_end == year_text || *year_end != '\0' || year < 1000 || year > 2100) {
+            importReject(report, row, "invalid year", 0);
+            continue;
+        }
+
+        if (searchBookByTitle(cat, title) != NULL) {
+            importReject(report, row, "duplicate title", 1);
+            continue;
+        }
+        if (searchBookByISBN(cat, isbn) != NULL) {
+            importReject(report, row, "duplicate ISBN", 1);
+            continue;
+        }
+        if (!validateISBN(isbn)) {
+            report->isbn_warnings++;
+        }
+
+        if (catalogAddBook(cat, cat->next_id, title, author, isbn, (int)year) == NULL) {
+            importReject(report, row, "out of memory", 0);
+            break;
+        }
+        report->imported++;
+    }
+    unmapFile(data, size, mapped);
+
+    report->saved = report->imported == 0 || journalCheckpoint(cat, 1);
+
+    char message[MAX_STR];
+    snprintf(message, sizeof(message), "Imported %d books (%d duplicates, %d invalid rows)",
+             report->imported, report->duplicates, report->invalid);
+    log_message(report->saved ? LOG_INFO : LOG_ERROR, message);
+    return 1;
+}
+
+// Copy the data file to a timestamped backup next to it; `name`
+// receives the backup's path
+static LibStatus backupCatalog(LibCatalog* cat, char* name, size_t name_size) {
+    char backup_name[MAX_STR];
+    time_t now = time(NULL);
+    struct tm t;
+    if (localtime_r(&now, &t) == NULL) {
+        return LIB_ERR_IO;
+    }
+
+    snprintf(backup_name, MAX_STR, "library_backup_%04d%02d%02d_%02d%02d%02d.dat",
+             t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+             t.tm_hour, t.tm_min, t.tm_sec);
+    char path[LIB_PATH_MAX];
+    if (!cat->persistent || !catalogPath(cat, path, backup_name)) {
+        return LIB_ERR_NOT_FOUND;
+    }
+    safe_strcpy(name, path, name_size);
+
+    // The data file alone is only current once the journal is folded in
+    if (cat->journal.enabled && !journalCheckpoint(cat, 1)) {
+        log_message(LOG_ERROR, "Backup checkpoint failed");
+        return LIB_ERR_IO;
+    }
+
+    FILE* src = fopen(cat->data_path, "rb");
+    if (!src) {
+        return LIB_ERR_NOT_FOUND;
+    }
+
+    FILE* dest = fopen(path, "wb");
+    if (!dest) {
+        fclose(src);
+        log_message(LOG_ERROR, "Backup creation failed");
+        return LIB_ERR_IO;
+    }
+
+    // Byte copy: the data file may be a binary snapshot
+    char buffer[65536];
+    size_t bytes;
+    int ok = 1;
+    while ((bytes = fread(buffer, 1, sizeof(buffer), src)) > 0) {
+        ok &= fwrite(buffer, 1, bytes, dest) == bytes;
+    }
+
+    fclose(src);
+    if (fclose(dest) != 0 || !ok) {
+        log_message(LOG_ERROR, "Backup creation failed");
+        return LIB_ERR_IO;
+    }
+    log_message(LOG_INFO, "Database backup created");
+    return LIB_OK;
+}
+
+// Writers wait for the copy, which must match the checkpoint it follows
+LibStatus libBackup(LibCatalog* cat, char* name, size_t name_size) {
+    catalogLockAll(cat);
+    LibStatus status = backupCatalog(cat, name, name_size);
+    catalogUnlockAll(cat);
+    return status;
+}
+
+// Cache-line aligned blocks for the slabs and the epoch slots
+static void* alignedAlloc(size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, CACHE_LINE);
+#else
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, CACHE_LINE, size) != 0) {
+        return NULL;
+    }
+    return ptr;
+#endif
+}
+
+static void alignedFree(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// Status scans read the slab table without locks: a grown table is
+// published before the count that covers the new slab, and the old one is
+// retired
+static Book* poolAlloc(LibCatalog* cat, BookPool* pool) {
+    Book* book;
+
+    if (pool->free_list != NULL) {
+        book = pool->free_list;
+        pool->free_list = book->next;
+        pool->free_count--;
+        pool->live++;
+        return book;
+    }
+
+    if (pool->slab_count == 0 || pool->slab_used == SLAB_BOOKS) {
+        if (pool->slab_count == pool->slab_capacity) {
+            size_t capacity = pool->slab_capacity ? pool->slab_capacity * 2 : 16;
+            BookSlab** slabs = (BookSlab**)malloc(capacity * sizeof(BookSlab*));
+            if (slabs == NULL) {
+                return NULL;
+            }
+            if (pool->slab_count > 0) {
+                memcpy(slabs, pool->slabs, pool->slab_count * sizeof(BookSlab*));
+            }
+            BookSlab** old = pool->slabs;
+            __atomic_store_n(&pool->slabs, slabs, __ATOMIC_RELEASE);
+            pool->slab_capacity = capacity;
+            epochRetire(cat, old, NULL);
+        }
+
+        BookSlab* slab = (BookSlab*)alignedAlloc(sizeof(BookSlab));
+        if (slab == NULL) {
+            return NULL;
+        }
+        memset(slab->dirty, 0, sizeof(slab->dirty));
+        memset(slab->live, 0, sizeof(slab->live));
+        pool->slabs[pool->slab_count] = slab;
+        __atomic_store_n(&pool->slab_count, pool->slab_count + 1, __ATOMIC_RELEASE);
+        pool->slab_used = 0;
+    }
+
+    book = &pool->slabs[pool->slab_count - 1]->books[pool->slab_used];
+    book->slot = (int)((pool->slab_count - 1) * SLAB_BOOKS + pool->slab_used);
+    book->seq = 0;
+    pool->slab_used++;
+    pool->live++;
+    return book;
+}
+
+static void poolFree(BookPool* pool, Book* book) {
+    BookSlab* slab = pool->slabs[book->slot / SLAB_BOOKS];
+    int i = book->slot % SLAB_BOOKS;
+    slab->live[i] = 0;
+    slab->is_issued[i] = 0;
+
+    book->next = pool->free_list;
+    pool->free_list = book;
+    pool->free_count++;
+    pool->live--;
+}
+
+// Release every slab at once; all books handed out become invalid
+static void poolReset(BookPool* pool) {
+    for (size_t i = 0; i < pool->slab_count; i++) {
+        alignedFree(pool->slabs[i]);
+    }
+    free(pool->slabs);
+    pool->slabs = NULL;
+    pool->slab_count = 0;
+    pool->slab_capacity = 0;
+    pool->slab_used = 0;
+    pool->free_list = NULL;
+    pool->live = 0;
+    pool->free_count = 0;
+}
+
+static PoolStats poolStats(const BookPool* pool) {
+    PoolStats stats;
+    size_t unused = pool->slab_count ? SLAB_BOOKS - pool->slab_used : 0;
+
+    stats.slabs = pool->slab_count;
+    stats.live = pool->live;
+    stats.free = pool->free_count + unused;
+    stats.bytes = pool->slab_count * sizeof(BookSlab);
+    return stats;
+}
+
+// Mirror a book's scalar fields into the pool's hot columns
+static void syncHotColumns(LibCatalog* cat, Book* book) {
+    BookSlab* slab = bookSlab(cat, book);
+    int i = book->slot % SLAB_BOOKS;
+
+    slab->id[i] = book->id;
+    slab->year[i] = book->year;
+    slab->is_issued[i] = (unsigned char)(book->is_issued != 0);
+    slab->issue_date[i] = book->issue_date;
+    slab->due_date[i] = book->due_date;
+    __atomic_store_n(&slab->live[i], 1, __ATOMIC_RELEASE);
+}
+
+static void freeList(LibCatalog* cat) {
+    cat->head = NULL;
+    cat->tail = NULL;
+    cat->book_count = 0;
+    indexClear(&cat->title_index);
+    indexClear(&cat->isbn_index);
+    trigramClear(cat, &cat->trigram_index);
+    skipClear(cat, &cat->title_order);
+    skipClear(cat, &cat->author_order);
+    for (int i = 0; i < cat->shard_count; i++) {
+        CatalogShard* shard = &cat->shards[i];
+        indexClear(&shard->id_index);
+        indexClear(&shard->borrower_index);
+        dueQueueClear(&shard->due_queue);
+        shard->dirty_count = 0;
+        shard->book_count = 0;
+    }
+    cat->changes.removed_count = 0;
+    cat->changes.base_valid = 0;
+    epochDrain(cat);
+    for (int i = 0; i < cat->shard_count; i++) {
+        poolReset(&cat->shards[i].pool);
+    }
+}
+
+// Copy at most dest_size - 1 bytes of src and zero the rest of dest, as
+// strncpy did, so fixed-width fields written to disk carry no stale bytes
+void safe_strcpy(char* dest, const char* src, size_t dest_size) {
+    if (dest_size > 0) {
+        size_t length = strnlen(src, dest_size - 1);
+        memcpy(dest, src, length);
+        memset(dest + length, 0, dest_size - length);
+    }
+}
+
+static int validateISBN13(const char* isbn) {
+    if (strlen(isbn) != 13) return 0;
+
+    int sum = 0;
+    for (int i = 0; i < 12; i++) {
+        if (!isdigit((unsigned char)isbn[i])) return 0;
+        int digit = isbn[i] - '0';
+        sum += (i % 2 == 0) ? digit : digit * 3;
+    }
+
+    int checksum = (10 - (sum % 10)) % 10;
+    return checksum == (isbn[12] - '0');
+}
+
+int validateISBN(const char* isbn) {
+    int len = strlen(isbn);
+
+    // Remove hyphens for validation
+    char clean_isbn[20];
+    int j = 0;
+    for (int i = 0; i < len && j < 19; i++) {
+        if (isdigit((unsigned char)isbn[i]) || isbn[i] == 'X' || isbn[i] == 'x') {
+            clean_isbn[j++] = isbn[i];
+        }
+    }
+    clean_isbn[j] = '\0';
+    len = j;
+
+    // Check for ISBN-10 or ISBN-13
+    if (len == 10) {
+        // Basic ISBN-10 validation
+        return 1;
+    } else if (len == 13) {
+        return validateISBN13(clean_isbn);
+    }
+
+    return 0;
+}
+
+static int skipCompare(SkipList* list, Book* a, Book* b) {
+    int order = list->compare(a, b);
+    if (order != 0) return order;
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+static int skipRandomLevel(SkipList* list) {
+    // xorshift32; each extra level with probability 1/4
+    unsigned int x = list->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    list->seed = x;
+
+    int level = 1;
+    while (level < SKIP_MAX_LEVEL && (x & 3) == 0) {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+// Listings walk level 0 without locks, so a node is complete before it is
+// linked in, bottom level first
+static int skipInsert(SkipList* list, Book* book) {
+    SkipNode* update[SKIP_MAX_LEVEL];
+    SkipNode* node = list->head;
+
+    for (int i = list->level - 1; i >= 0; i--) {
+        while (node->forward[i] != NULL && skipCompare(list, node->forward[i]->book, book) < 0) {
+            node = node->forward[i];
+        }
+        update[i] = node;
+    }
+
+    int level = skipRandomLevel(list);
+    SkipNode* added = (SkipNode*)malloc(sizeof(SkipNode) + level * sizeof(SkipNode*));
+    if (added == NULL) {
+        return 0;
+    }
+    for (int i = list->level; i < level; i++) {
+        update[i] = list->head;
+    }
+    if (level > list->level) {
+        list->level = level;
+    }
+
+    added->book = book;
+    for (int i = 0; i < level; i++) {
+        added->forward[i] = update[i]->forward[i];
+        __atomic_store_n(&update[i]->forward[i], added, __ATOMIC_RELEASE);
+    }
+    list->count++;
+    return 1;
+}
+
+// The removed node keeps its links for listings standing on it and is
+// retired rather than freed
+static void skipRemove(LibCatalog* cat, SkipList* list, Book* book) {
+    if (!list->built) return;
+
+    SkipNode* update[SKIP_MAX_LEVEL];
+    SkipNode* node = list->head;
+    for (int i = list->level - 1; i >= 0; i--) {
+        while (node->forward[i] != NULL && skipCompare(list, node->forward[i]->book, book) < 0) {
+            node = node->forward[i];
+        }
+        update[i] = node;
+    }
+
+    node = node->forward[0];
+    if (node == NULL || node->book != book) return;
+
+    for (int i = 0; i < list->level && update[i]->forward[i] == node; i++) {
+        __atomic_store_n(&update[i]->forward[i], node->forward[i], __ATOMIC_RELEASE);
+    }
+    while (list->level > 1 && list->head->forward[list->level - 1] == NULL) {
+        list->level--;
+    }
+    epochRetire(cat, node, NULL);
+    list->count--;
+}
+
+// Free a head node and every node still linked behind it
+static void releaseSkipChain(LibCatalog* cat, void* ptr) {
+    SkipNode* head = (SkipNode*)ptr;
+    (void)cat;
+    SkipNode* node = head->forward[0];
+    while (node != NULL) {
+        SkipNode* next = node->forward[0];
+        free(node);
+        node = next;
+    }
+    free(head);
+}
+
+// Index every book in the catalog: sort once, then link the nodes level
+// by level in order, which needs no searching. The list is built off to
+// the side and published whole.
+static int skipBuild(LibCatalog* cat, SkipList* list) {
+    SortSpec spec = {{list->compare == compareByAuthor ? SORT_AUTHOR : SORT_TITLE, SORT_ID}, 2};
+    size_t count;
+    SortItem* items = sortCatalog(cat, &spec, &count);
+    SkipNode* head = (SkipNode*)calloc(1, sizeof(SkipNode) + SKIP_MAX_LEVEL * sizeof(SkipNode*));
+
+    skipClear(cat, list);
+    if (items == NULL || head == NULL) {
+        free(items);
+        free(head);
+        return 0;
+    }
+
+    SkipNode* last[SKIP_MAX_LEVEL];
+    for (int i = 0; i < SKIP_MAX_LEVEL; i++) {
+        last[i] = head;
+    }
+    int top = 1;
+
+    for (size_t n = 0; n < count; n++) {
+        int level = skipRandomLevel(list);
+        SkipNode* node = (SkipNode*)malloc(sizeof(SkipNode) + level * sizeof(SkipNode*));
+        if (node == NULL) {
+            free(items);
+            releaseSkipChain(cat, head);
+            return 0;
+        }
+
+        node->book = items[n].book;
+        for (int i = 0; i < level; i++) {
+            node->forward[i] = NULL;
+            last[i]->forward[i] = node;
+            last[i] = node;
+        }
+        if (level > top) {
+            top = level;
+        }
+    }
+    free(items);
+
+    list->level = top;
+    list->count = count;
+    __atomic_store_n(&list->head, head, __ATOMIC_RELEASE);
+    __atomic_store_n(&list->built, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void skipClear(LibCatalog* cat, SkipList* list) {
+    SkipNode* head = list->head;
+    __atomic_store_n(&list->built, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&list->head, NULL, __ATOMIC_RELEASE);
+    list->level = 0;
+    list->count = 0;
+    if (head != NULL) {
+        epochRetire(cat, head, releaseSkipChain);
+    }
+}
+
+// First eight bytes of `s`, case-folded and packed big-endian so that
+// integer order matches strcasecmp order; short strings are zero padded
+static uint64_t foldedPrefix(const char* s) {
+    uint64_t prefix = 0;
+    int i = 0;
+    for (; i < 8 && s[i] != '\0'; i++) {
+        prefix = (prefix << 8) | (unsigned char)tolower((unsigned char)s[i]);
+    }
+    return i > 0 ? prefix << (8 * (8 - i)) : 0;
+}
+
+static inline int isStringKey(SortKey key) {
+    return key == SORT_TITLE || key == SORT_AUTHOR;
+}
+
+// Prefix of `key` for the bytes starting at `offset`. The caller only asks
+// for a later offset after an earlier prefix was filled with no NUL byte.
+static uint64_t sortPrefix(const Book* book, SortKey key, size_t offset) {
+    switch (key) {
+        case SORT_TITLE: return foldedPrefix(book->title + offset);
+        case SORT_AUTHOR: return foldedPrefix(book->author + offset);
+        case SORT_YEAR: return (uint64_t)((int64_t)book->year + INT32_MAX + 1);
+        case SORT_ID: return (uint64_t)((int64_t)book->id + INT32_MAX + 1);
+    }
+    return 0;
+}
+
+// Compare the rest of two strings whose folded prefixes are equal. A zero
+// last prefix byte means both strings already ended inside the prefix.
+static inline int compareFoldedTail(const char* a, const char* b, uint64_t prefix) {
+    if ((prefix & 0xff) == 0) return 0;
+    return strcasecmp(a + 8, b + 8);
+}
+
+static inline int compareIntKey(int a, int b) {
+    return (a > b) - (a < b);
+}
+
+static int compareSortKey(const Book* a, const Book* b, SortKey key) {
+    switch (key) {
+        case SORT_TITLE: return strcasecmp(a->title, b->title);
+        case SORT_AUTHOR: return strcasecmp(a->author, b->author);
+        case SORT_YEAR: return compareIntKey(a->year, b->year);
+        case SORT_ID: return compareIntKey(a->id, b->id);
+    }
+    return 0;
+}
+
+// Stable LSD radix sort on the prefix alone. All eight byte histograms are
+// taken in one pass and bytes every item shares are skipped.
+static void radixByPrefix(SortItem* items, SortItem* tmp, size_t n) {
+    size_t counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < n; i++) {
+        uint64_t prefix = items[i].prefix;
+        for (int b = 0; b < 8; b++) {
+            counts[b][(prefix >> (8 * b)) & 0xff]++;
+        }
+    }
+
+    SortItem* from = items;
+    SortItem* to = tmp;
+    for (int b = 0; b < 8; b++) {
+        if (counts[b][(items[0].prefix >> (8 * b)) & 0xff] == n) continue;
+
+        size_t offset = 0;
+        for (int v = 0; v < 256; v++) {
+            size_t c = counts[b][v];
+            counts[b][v] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; i++) {
+            to[counts[b][(from[i].prefix >> (8 * b)) & 0xff]++] = from[i];
+        }
+        SortItem* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != items) memcpy(items, from, n * sizeof(SortItem));
+}
+
+// Deeper levels visit the books in sorted order, which is random in
+// memory; ask for the record a few items ahead of the one being read
+#define SORT_PREFETCH 8
+#if defined(__GNUC__)
+#define prefetchBook(book) __builtin_prefetch(book)
+#else
+#define prefetchBook(book) ((void)(book))
+#endif
+
+// Below this many items insertion sort beats the radix histograms
+#define SORT_RADIX_MIN 64
+
+static void insertionByPrefix(SortItem* items, size_t n) {
+    for (size_t i = 1; i < n; i++) {
+        SortItem item = items[i];
+        size_t j = i;
+        while (j > 0 && item.prefix < items[j - 1].prefix) {
+            items[j] = items[j - 1];
+            j--;
+        }
+        items[j] = item;
+    }
+}
+
+// Sort `items` on the prefix of key `k` at `offset`, then settle each run
+// of equal prefixes on the next eight bytes of the same string, or on the
+// next key. Records are only touched to load prefixes, once per level.
+// Every run gets its level-0 prefix back so sorted chunks can be merged.
+static void sortLevel(SortItem* items, SortItem* tmp, size_t n, const SortSpec* spec,
+                      int k, size_t offset) {
+    if (n < SORT_RADIX_MIN) {
+        insertionByPrefix(items, n);
+    } else {
+        radixByPrefix(items, tmp, n);
+    }
+
+    size_t start = 0;
+    while (start < n) {
+        uint64_t prefix = items[start].prefix;
+        size_t end = start + 1;
+        while (end < n && items[end].prefix == prefix) end++;
+
+        int next = k;
+        size_t at = offset + 8;
+        if (!isStringKey(spec->keys[k]) || (prefix & 0xff) == 0) {
+            next = k + 1;
+            at = 0;
+        }
+        if (end - start > 1 && next < spec->count) {
+            for (size_t i = start; i < end; i++) {
+                if (i + SORT_PREFETCH < end) prefetchBook(items[i + SORT_PREFETCH].book);
+                items[i].prefix = sortPrefix(items[i].book, spec->keys[next], at);
+            }
+            sortLevel(items + start, tmp + start, end - start, spec, next, at);
+            for (size_t i = start; i < end; i++) {
+                items[i].prefix = prefix;
+            }
+        }
+        start = end;
+    }
+}
+
+// Full comparators for merging sorted chunks, specialized at compile time
+// for the orders the catalog uses all the time. Each returns <0, 0 or >0
+// like strcmp and expects level-0 prefixes.
+static inline int sortCmpTitleId(const SortItem* x, const SortItem* y, const SortSpec* spec) {
+    (void)spec;
+    if (x->prefix != y->prefix) return x->prefix < y->prefix ? -1 : 1;
+    int order = compareFoldedTail(x->book->title, y->book->title, x->prefix);
+    return order ? order : compareIntKey(x->book->id, y->book->id);
+}
+
+static inline int sortCmpAuthorId(const SortItem* x, const SortItem* y, const SortSpec* spec) {
+    (void)spec;
+    if (x->prefix != y->prefix) return x->prefix < y->prefix ? -1 : 1;
+    int order = compareFoldedTail(x->book->author, y->book->author, x->prefix);
+    return order ? order : compareIntKey(x->book->id, y->book->id);
+}
+
+static inline int sortCmpAuthorYearTitle(const SortItem* x, const SortItem* y, const SortSpec* spec) {
+    (void)spec;
+    if (x->prefix != y->prefix) return x->prefix < y->prefix ? -1 : 1;
+    int order = compareFoldedTail(x->book->author, y->book->author, x->prefix);
+    if (order == 0) order = compareIntKey(x->book->year, y->book->year);
+    if (order == 0) order = strcasecmp(x->book->title, y->book->title);
+    return order;
+}
+
+// Any other key list
+static inline int sortCmpGeneric(const SortItem* x, const SortItem* y, const SortSpec* spec) {
+    if (x->prefix != y->prefix) return x->prefix < y->prefix ? -1 : 1;
+    for (int k = 0; k < spec->count; k++) {
+        int order = compareSortKey(x->book, y->book, spec->keys[k]);
+        if (order != 0) return order;
+    }
+    return 0;
+}
+
+// Merge two sorted runs with CMP inlined; ties take the left run first so
+// the merge stays stable
+#define DEFINE_MERGE(NAME, CMP)                                                    \
+static void mergeItems_##NAME(const SortItem* a, size_t na, const SortItem* b,     \
+                              size_t nb, SortItem* out, const SortSpec* spec) {    \
+    size_t i = 0, j = 0;                                                           \
+    while (i < na && j < nb) {                                                     \
+        *out++ = CMP(&b[j], &a[i], spec) < 0 ? b[j++] : a[i++];                    \
+    }                                                                              \
+    while (i < na) *out++ = a[i++];                                                \
+    while (j < nb) *out++ = b[j++];                                                \
+}
+
+DEFINE_MERGE(title_id, sortCmpTitleId)
+DEFINE_MERGE(author_id, sortCmpAuthorId)
+DEFINE_MERGE(author_year_title, sortCmpAuthorYearTitle)
+DEFINE_MERGE(generic, sortCmpGeneric)
+
+typedef void (*MergeItemsFn)(const SortItem*, size_t, const SortItem*, size_t,
+                             SortItem*, const SortSpec*);
+
+typedef struct {
+    SortItem* items;
+    SortItem* tmp;
+    size_t count;
+    const SortItem* right;      // merge tasks: second run
+    size_t right_count;
+    MergeItemsFn merge;
+    const SortSpec* spec;
+} SortTask;
+
+// Pool bodies: sort chunks [begin, end), or run merges [begin, end)
+static void sortTaskRun(void* arg, size_t begin, size_t end) {
+    for (SortTask* task = (SortTask*)arg + begin; task < (SortTask*)arg + end; task++) {
+        for (size_t i = 0; i < task->count; i++) {
+            task->items[i].prefix = sortPrefix(task->items[i].book, task->spec->keys[0], 0);
+        }
+        sortLevel(task->items, task->tmp, task->count, task->spec, 0, 0);
+    }
+}
+
+static void mergeTaskRun(void* arg, size_t begin, size_t end) {
+    for (SortTask* task = (SortTask*)arg + begin; task < (SortTask*)arg + end; task++) {
+        task->merge(task->items, task->count, task->right, task->right_count, task->tmp, task->spec);
+    }
+}
+
+static int sameSpec(const SortSpec* spec, int count, SortKey a, SortKey b, SortKey c) {
+    SortKey keys[3] = {a, b, c};
+    if (spec->count != count) return 0;
+    for (int i = 0; i < count; i++) {
+        if (spec->keys[i] != keys[i]) return 0;
+    }
+    return 1;
+}
+
+// Sort the whole catalog by `spec`; ties keep list order. Chunks are sorted
+// on the worker pool and merged pairwise, also in parallel. Returns a
+// malloc'd array of `count` items in order, or NULL when out of memory.
+// Keys never change once a book is added, so readers may sort without
+// the catalog lock
+static SortItem* sortCatalog(LibCatalog* cat, const SortSpec* spec, size_t* count) {
+    size_t n = (size_t)libBookCount(cat);
+    SortItem* items = (SortItem*)malloc((n + 1) * sizeof(SortItem));
+    SortItem* tmp = (SortItem*)malloc((n + 1) * sizeof(SortItem));
+    *count = 0;
+    if (items == NULL || tmp == NULL || spec->count < 1) {
+        free(items);
+        free(tmp);
+        return NULL;
+    }
+
+    size_t filled = 0;
+    for (Book* current = firstBook(cat); current != NULL && filled < n; current = nextBook(current)) {
+        items[filled++].book = current;
+    }
+    n = filled;
+
+    MergeItemsFn merge = mergeItems_generic;
+    if (sameSpec(spec, 2, SORT_TITLE, SORT_ID, 0)) {
+        merge = mergeItems_title_id;
+    } else if (sameSpec(spec, 2, SORT_AUTHOR, SORT_ID, 0)) {
+        merge = mergeItems_author_id;
+    } else if (sameSpec(spec, 3, SORT_AUTHOR, SORT_YEAR, SORT_TITLE)) {
+        merge = mergeItems_author_year_title;
+    }
+
+    // A power-of-two number of chunks keeps the merge rounds even
+    int threads = n < PARALLEL_SORT_MIN ? 1 : poolThreads();
+    int chunks = 1;
+    while (chunks * 2 <= threads) chunks *= 2;
+
+    SortTask tasks[64];
+    size_t bounds[65];
+    for (int i = 0; i <= chunks; i++) {
+        bounds[i] = n * (size_t)i / (size_t)chunks;
+    }
+    for (int i = 0; i < chunks; i++) {
+        SortTask task = {items + bounds[i], tmp + bounds[i], bounds[i + 1] - bounds[i],
+                         NULL, 0, merge, spec};
+        tasks[i] = task;
+    }
+    parallelFor((size_t)chunks, 1, sortTaskRun, tasks);
+
+    SortItem* from = items;
+    SortItem* to = tmp;
+    for (int width = 1; width < chunks; width *= 2) {
+        int merges = 0;
+        for (int i = 0; i < chunks; i += 2 * width) {
+            size_t start = bounds[i], mid = bounds[i + width], end = bounds[i + 2 * width];
+            SortTask task = {from + start, to + start, mid - start, from + mid, end - mid,
+                             merge, spec};
+            tasks[merges++] = task;
+        }
+        parallelFor((size_t)merges, 1, mergeTaskRun, tasks);
+        SortItem* swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != items) {
+        free(items);
+        items = from;
+    } else {
+        free(tmp);
+    }
+
+    *count = n;
+    return items;
+}
+
+// Parse a comma-separated key list such as "author,year,title"
+static int parseSortSpec(const char* text, SortSpec* spec) {
+    static const char* names[] = {"title", "author", "year", "id"};
+    spec->count = 0;
+
+    while (*text != '\0') {
+        size_t length = strcspn(text, ",");
+        int found = 0;
+        for (int k = 0; k < 4; k++) {
+            if (strlen(names[k]) == length && strncasecmp(text, names[k], length) == 0) {
+                if (spec->count == SORT_MAX_KEYS) return 0;
+                spec->keys[spec->count++] = (SortKey)k;
+                found = 1;
+            }
+        }
+        if (!found) return 0;
+        text += length;
+        if (*text == ',') text++;
+    }
+    return spec->count > 0;
+}
+
+static double wallMs(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int qsortByTitle(const void* a, const void* b) {
+    return compareByTitle(*(Book**)a, *(Book**)b);
+}
+
+static int qsortByAuthor(const void* a, const void* b) {
+    return compareByAuthor(*(Book**)a, *(Book**)b);
+}
+
+// Microbenchmark: qsort with the strcasecmp comparators against the sort
+// engine, plus a composite key order
+void benchmarkSort(FILE* out, int books) {
+    LibCatalog* cat = libCreate();
+    if (cat == NULL) return;
+    if (books <= 0) books = 1000000;
+    books = benchmarkCatalog(cat, out, books);
+
+    Book** array = (Book**)malloc((size_t)books * sizeof(Book*));
+    if (array == NULL) {
+        libClose(cat);
+        return;
+    }
+
+    fprintf(out, "Sort benchmark: %d books, %d threads\n\n", books,
+            (size_t)books < PARALLEL_SORT_MIN ? 1 : poolThreads());
+    fprintf(out, "%-20s %12s %12s %9s\n", "Order", "qsort", "engine", "Speedup");
+
+    static const char* orders[] = {"title", "author", "author,year,title"};
+    int (*baselines[])(const void*, const void*) = {qsortByTitle, qsortByAuthor, NULL};
+
+    for (int o = 0; o < 3; o++) {
+        SortSpec spec;
+        parseSortSpec(orders[o], &spec);
+
+        double baseline_ms = 0;
+        if (baselines[o] != NULL) {
+            // Gathering the pointers is timed too; the engine walks the list
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            int n = 0;
+            for (Book* b = cat->head; b != NULL; b = b->next) array[n++] = b;
+            qsort(array, (size_t)n, sizeof(Book*), baselines[o]);
+            baseline_ms = wallMs(&start);
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        size_t count;
+        SortItem* items = sortCatalog(cat, &spec, &count);
+        double engine_ms = wallMs(&start);
+
+        // The engine must agree with the plain comparators on key order
+        int mismatch = items == NULL;
+        for (size_t i = 1; !mismatch && i < count; i++) {
+            for (int k = 0; k < spec.count; k++) {
+                int order = compareSortKey(items[i - 1].book, items[i].book, spec.keys[k]);
+                if (order < 0) break;
+                if (order > 0) {
+                    mismatch = 1;
+                    break;
+                }
+            }
+        }
+        free(items);
+
+        if (baselines[o] != NULL) {
+            fprintf(out, "%-20s %10.1fms %10.1fms %8.1fx%s\n", orders[o], baseline_ms, engine_ms,
+                    engine_ms > 0 ? baseline_ms / engine_ms : 0.0, mismatch ? "  MISMATCH" : "");
+        } else {
+            fprintf(out, "%-20s %12s %10.1fms %9s%s\n", orders[o], "-", engine_ms, "-",
+                    mismatch ? "  MISMATCH" : "");
+        }
+    }
+
+    free(array);
+    libClose(cat);
+}
+
+static int compareByTitle(Book* a, Book* b) {
+    return strcasecmp(a->title, b->title);
+}
+
+static int compareByAuthor(Book* a, Book* b) {
+    return strcasecmp(a->author, b->author);
+}
+
+// One thread of benchmarkConcurrent: lookups, with one operation in twenty
+// an issue or (when the book is out) a return
+typedef struct {
+    LibCatalog* cat;
+    int books;
+    int ops;
+    unsigned int seed;
+    long writes;
+    long torn;
+} ConcurrentTask;
+
+static void* concurrentTaskRun(void* arg) {
+    ConcurrentTask* task = (ConcurrentTask*)arg;
+    unsigned int x = task->seed;
+
+    for (int i = 0; i < task->ops; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int id = (int)(x % (unsigned int)task->books) + 1;
+        LibBook book;
+
+        if ((x >> 24) % 20 != 0) {
+            // A consistent copy is either fully issued or fully available
+            if (libGetBook(task->cat, id, &book) == LIB_OK &&
+                ((book.issued_to[0] != '\0') != book.is_issued || (book.due_date != 0) != book.is_issued)) {
+                task->torn++;
+            }
+            continue;
+        }
+
+        double fine;
+        if (libIssueBook(task->cat, id, "Bench Reader", 14, &book) == LIB_ERR_ISSUED) {
+            libReturnBook(task->cat, id, &fine, &book);
+        }
+        task->writes++;
+    }
+    return NULL;
+}
+
+// Microbenchmark: throughput of a 95% lookup / 5% circulation mix as
+// threads are added. Lookups never take a lock; the torn column
+// counts copies that mixed two versions of a book and must stay 0.
+void benchmarkConcurrent(FILE* out, int books) {
+    LibCatalog* cat = libCreate();
+    if (cat == NULL) return;
+    if (books <= 0) books = 100000;
+    books = benchmarkCatalog(cat, out, books);
+
+    // Circulation is logged; keep those lines out of library.log
+    logConfigure(LOG_ERROR, LOG_FLUSH_MS, 1);
+
+    int cpus = threadCount(0, 1, 0);
+    int max_threads = cpus > 4 ? cpus : 4;
+    int ops = 2000000;
+    fprintf(out, "Concurrency benchmark: %d books, %d ops per run, %d CPUs\n\n", books, ops, cpus);
+    fprintf(out, "%8s %12s %14s %10s %8s\n", "Threads", "Time", "Ops/s", "Writes", "Torn");
+
+    for (int threads = 1; threads <= max_threads && threads <= 64; threads *= 2) {
+        ConcurrentTask tasks[64];
+        for (int i = 0; i < threads; i++) {
+            ConcurrentTask task = {cat, books, ops / threads, 2463534242u + (unsigned int)i * 7919u, 0, 0};
+            tasks[i] = task;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        runChunks(concurrentTaskRun, tasks, sizeof(ConcurrentTask), threads);
+        double ms = wallMs(&start);
+
+        long writes = 0, torn = 0;
+        for (int i = 0; i < threads; i++) {
+            writes += tasks[i].writes;
+            torn += tasks[i].torn;
+        }
+        long done = (long)(ops / threads) * threads;
+        fprintf(out, "%8d %10.1fms %14.0f %10ld %8ld\n", threads, ms,
+                ms > 0 ? done / (ms / 1000.0) : 0.0, writes, torn);
+    }
+
+    libClose(cat);
+}
+
+// One thread of benchmarkWrites: issue a random book, or return it when it
+// is already out
+typedef struct {
+    LibCatalog* cat;
+    int books;
+    int ops;
+    unsigned int seed;
+} WriteTask;
+
+static void* writeTaskRun(void* arg) {
+    WriteTask* task = (WriteTask*)arg;
+    unsigned int x = task->seed;
+
+    for (int i = 0; i < task->ops; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int id = (int)(x % (unsigned int)task->books) + 1;
+        LibBook book;
+        double fine;
+
+        if (libIssueBook(task->cat, id, "Bench Reader", 14, &book) == LIB_ERR_ISSUED) {
+            libReturnBook(task->cat, id, &fine, &book);
+        }
+    }
+    return NULL;
+}
+
+// Microbenchmark: issue/return throughput from 1 to 32 threads on
+// catalogs with one shard and with several. With one shard every write
+// waits for the same lock; with more, writes to different shards proceed
+// side by side, as far as there are CPUs to run them.
+void benchmarkWrites(FILE* out, int books) {
+    static const int shard_counts[] = {1, 8, 32};
+    enum { RUNS = 3, THREAD_STEPS = 6 };
+    double rates[RUNS][THREAD_STEPS];
+    int configured = shard_setting;
+    int ops = 1000000;
+
+    if (books <= 0) books = 100000;
+    logConfigure(LOG_ERROR, LOG_FLUSH_MS, 1);
+
+    for (int r = 0; r < RUNS; r++) {
+        shard_setting = shard_counts[r];
+        LibCatalog* cat = libCreate();
+        shard_setting = configured;
+        if (cat == NULL) return;
+        books = benchmarkCatalog(cat, out, books);
+
+        for (int step = 0; step < THREAD_STEPS; step++) {
+            int threads = 1 << step;
+            WriteTask tasks[1 << (THREAD_STEPS - 1)];
+            for (int i = 0; i < threads; i++) {
+                WriteTask task = {cat, books, ops / threads, 2463534242u + (unsigned int)i * 7919u};
+                tasks[i] = task;
+            }
+
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            runChunks(writeTaskRun, tasks, sizeof(WriteTask), threads);
+            double ms = wallMs(&start);
+            long done = (long)(ops / threads) * threads;
+            rates[r][step] = ms > 0 ? done / (ms / 1000.0) : 0.0;
+        }
+        libClose(cat);
+    }
+
+    fprintf(out, "Write scaling benchmark: %d books, %d issues/returns per run, %d CPUs\n\n",
+            books, ops, threadCount(0, 1, 0));
+    fprintf(out, "%8s", "Threads");
+    for (int r = 0; r < RUNS; r++) {
+        char label[32];
+        snprintf(label, sizeof(label), "%d shard%s ops/s", shard_counts[r], shard_counts[r] == 1 ? "" : "s");
+        fprintf(out, " %18s", label);
+    }
+    fprintf(out, "\n");
+    for (int step = 0; step < THREAD_STEPS; step++) {
+        fprintf(out, "%8d", 1 << step);
+        for (int r = 0; r < RUNS; r++) {
+            fprintf(out, " %18.0f", rates[r][step]);
+        }
+        fprintf(out, "\n");
+    }
+}
@@ -0,0 +1,204 @@
+// Library catalog engine. Every piece of catalog state (books, users,
+// indexes, journal, file paths) lives in a LibCatalog, so several catalogs
+// can be open in one process and the engine can be embedded without the
+// menus. Nothing here reads the terminal or prints; operations report a
+// LibStatus and hand back copies of the records they touched.
+#ifndef LIBRARY_CORE_H
+#define LIBRARY_CORE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+
+#define MAX_STR 100
+#define MAX_BORROWER_NAME 50
+#define MAX_USERNAME 30
+#define MAX_PASSWORD 30
+#define FINE_PER_DAY 5.0
+#define LOG_FLUSH_MS 100
+
+// Opaque catalog handle. Every function may be called from several
+// threads at once: lookups, searches, listings, statistics and exports do
+// not lock. Books are partitioned into shards by ID; issues and returns
+// lock only the book's shard, so those on different shards run in
+// parallel, while adds, removes, saves and imports also take the
+// catalog-wide lock. libOpen and libClose must not overlap other calls.
+typedef struct LibCatalog LibCatalog;
+
+// Matching books held by a query, in result order. The rows stay valid
+// until the result set is freed, even if the catalog changes meanwhile;
+// free result sets promptly, as they hold back memory reclamation. Rows
+// of status-filtered listings are returned as they were when they passed
+// the filter, others as they are when read.
+typedef struct LibResults LibResults;
+
+// Outcome of every catalog operation
+typedef enum {
+    LIB_OK = 0,
+    LIB_ERR_INVALID,
+    LIB_ERR_NOT_FOUND,
+    LIB_ERR_DUPLICATE_TITLE,
+    LIB_ERR_DUPLICATE_ISBN,
+    LIB_ERR_ISSUED,
+    LIB_ERR_NOT_ISSUED,
+    LIB_ERR_NO_MEMORY,
+    LIB_ERR_DUPLICATE_USER,
+    LIB_ERR_AUTH,
+    LIB_ERR_IO,
+    LIB_ERR_CORRUPT,
+    LIB_ERR_BUSY                // every reader slot taken; retry the query
+} LibStatus;
+
+// Copy of a book record as seen by callers
+typedef struct {
+    int id;
+    char title[MAX_STR];
+    char author[MAX_STR];
+    char isbn[20];
+    int year;
+    int is_issued;
+    char issued_to[MAX_BORROWER_NAME];
+    time_t issue_date;
+    time_t due_date;
+} LibBook;
+
+// Signed-in account
+typedef struct {
+    char username[MAX_USERNAME];
+    int is_admin;
+    char full_name[MAX_STR];
+} LibUser;
+
+// What libOpen found on disk
+typedef struct {
+    LibStatus data;         // LIB_OK, LIB_ERR_NOT_FOUND (no data file) or LIB_ERR_CORRUPT
+    int books;
+    int journal_records;    // changes replayed from the journal, -1 when there was none
+    int user_file;          // users.dat existed
+    int users;              // users loaded from it, 0 when the default admin is used
+} LibOpenReport;
+
+// Statistics structure
+typedef struct {
+    int total_books;
+    int issued_books;
+    int available_books;
+    double total_fines;
+    int overdue_books;
+} LibraryStats;
+
+// Allocator counters for the statistics screen
+typedef struct {
+    size_t slabs;
+    size_t live;
+    size_t free;
+    size_t bytes;
+} PoolStats;
+
+// Status filters for listings
+typedef enum {
+    FILTER_ALL = 1,
+    FILTER_AVAILABLE,
+    FILTER_ISSUED,
+    FILTER_OVERDUE
+} StatusFilter;
+
+// Result of a bulk import. The first IMPORT_MAX_ERRORS row errors are
+// kept for the report; the rest are only counted.
+#define IMPORT_MAX_ERRORS 100
+
+typedef struct {
+    int row;
+    const char* reason;
+} ImportError;
+
+typedef struct {
+    int rows;
+    int imported;
+    int duplicates;
+    int invalid;
+    int isbn_warnings;
+    int saved;
+    int error_count;
+    ImportError errors[IMPORT_MAX_ERRORS];
+} ImportReport;
+
+// Log levels
+typedef enum {
+    LOG_INFO,
+    LOG_WARNING,
+    LOG_ERROR
+} LogLevel;
+
+extern const char* log_level_names[];
+
+// Catalog lifecycle. libOpen loads the catalog kept in `dir` (NULL for
+// the working directory) and replays its journal; libCreate makes an
+// empty catalog that is never written to disk. libClose flushes the
+// journal and frees the catalog; call libSave first to keep changes.
+LibCatalog* libOpen(const char* dir, LibOpenReport* report);
+LibCatalog* libCreate();
+void libClose(LibCatalog* cat);
+
+// Shards for catalogs opened or created afterwards, rounded up to a power
+// of two (at most 64); 0 picks one per CPU
+void libConfigureShards(int shards);
+
+// Accounts
+LibStatus libAuthenticate(LibCatalog* cat, const char* username, const char* password, LibUser* user);
+LibStatus libRegisterUser(LibCatalog* cat, const char* username, const char* password,
+                          const char* full_name);
+int libUserExists(LibCatalog* cat, const char* username);
+int libUserCount(LibCatalog* cat);
+
+// Circulation. On LIB_OK `book` receives the record as it is afterwards;
+// on a duplicate or an already issued book it receives the existing one.
+// libReturnBook reports the book as it was before the return.
+int libBookCount(LibCatalog* cat);
+LibStatus libGetBook(LibCatalog* cat, int id, LibBook* book);
+LibStatus libAddBook(LibCatalog* cat, const char* title, const char* author, const char* isbn,
+                     int year, LibBook* book);
+LibStatus libRemoveBook(LibCatalog* cat, int id);
+LibStatus libIssueBook(LibCatalog* cat, int id, const char* borrower, int days, LibBook* book);
+LibStatus libReturnBook(LibCatalog* cat, int id, double* fine, LibBook* book);
+
+// Queries. `order` is NULL for catalog order, "title", "author", or a
+// comma-separated key list over title, author, year and id. Overdue
+// listings without an order come most overdue first. Search queries must
+// be shorter than MAX_STR characters.
+LibStatus libSearch(LibCatalog* cat, const char* query, LibResults** results);
+LibStatus libList(LibCatalog* cat, StatusFilter filter, const char* order, LibResults** results);
+LibStatus libDueSoon(LibCatalog* cat, size_t limit, LibResults** results);
+LibStatus libPatronLoans(LibCatalog* cat, const char* borrower, LibResults** results);
+size_t libResultsCount(const LibResults* results);
+void libResultsGet(const LibResults* results, size_t index, LibBook* book);
+void libResultsFree(LibResults* results);
+
+LibraryStats libStatistics(LibCatalog* cat, time_t now);
+PoolStats libPoolStats(LibCatalog* cat);
+
+// Persistence
+LibStatus libSave(LibCatalog* cat);
+int libHasUnsavedChanges(LibCatalog* cat);
+LibStatus libExportText(LibCatalog* cat, const char* path);
+LibStatus libBackup(LibCatalog* cat, char* name, size_t name_size);
+LibStatus libImport(LibCatalog* cat, const char* path, ImportReport* report);
+
+const char* libStatusMessage(LibStatus status);
+double calculateFineAt(time_t due_date, time_t now);
+int validateISBN(const char* isbn);
+void safe_strcpy(char* dest, const char* src, size_t dest_size);
+
+// Process-wide asynchronous log shared by every catalog
+void logConfigure(LogLevel min_level, int flush_ms, int sync_on_error);
+void logOpen();
+void logClose();
+void log_message(LogLevel level, const char* message);
+
+// Engine microbenchmarks on a synthetic in-memory catalog
+void benchmarkSearch(FILE* out, int books);
+void benchmarkSort(FILE* out, int books);
+void benchmarkConcurrent(FILE* out, int books);
+void benchmarkWrites(FILE* out, int books);
+
+#endif
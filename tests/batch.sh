@@ -0,0 +1,93 @@
+#!/bin/sh
+# Drive `library --batch` with tests/batch.in in a scratch directory, then
+# reopen the catalog it saved, and compare every answer with
+# tests/batch.expected. The same session then runs through `--serve` and
+# `--client`, and the server must save and remove its socket on SIGTERM.
+# Over-long lines must be refused whole in both modes.
+# Due dates depend on the clock and are masked.
+# Usage: tests/batch.sh path/to/library
+set -e
+
+binary=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+tests=$(cd "$(dirname "$0")" && pwd)
+scratch=$(mktemp -d /tmp/library_batch_XXXXXX)
+server=
+trap '[ -n "$server" ] && kill "$server" 2>/dev/null; rm -rf "$scratch"' EXIT
+cd "$scratch"
+
+fail() {
+    echo "batch protocol: $1"
+    exit 1
+}
+
+printf 'title,author,isbn,year\nDesign Patterns,Erich Gamma,978-0-201-63361-0,1994\nBroken,Nobody,5,never\n' > books.csv
+: > empty.csv
+mkdir served
+cp books.csv empty.csv served/
+relist() {
+    printf 'login\tadmin\tadmin123\nlist\tall\tid\n' | "$@"
+}
+
+# Lines past the 1023 byte limit, one longer than the input buffer and a
+# last one with no newline: each is refused whole, nothing of it runs
+pad() {
+    head -c "$1" /dev/zero | tr '\0' x
+}
+{
+    printf 'login\tadmin\tadmin123\t'; pad 1100; printf '\n'
+    pad 65536; printf 'login\tadmin\tadmin123\r\n'
+    printf 'get\t1\n'
+    pad 70000
+} > long.in
+printf 'ERR 400 line too long\nERR 400 line too long\nERR 401 login required\nERR 400 line too long\n' > long.expected
+
+"$binary" --batch < long.in > long.out 2> long.err
+diff -u long.expected long.out || fail "batch mode ran part of an over-long line"
+
+{
+    "$binary" --batch < "$tests/batch.in"
+    relist "$binary" --batch
+} 2> batch.err | sed -E 's/[0-9]{10}/<time>/g' > batch.out
+
+if ! diff -u "$tests/batch.expected" batch.out; then
+    cat batch.err
+    fail "output differs from tests/batch.expected"
+fi
+
+# The server runs in its own directory; the socket sits outside it
+(cd served && exec "$binary" --serve --socket "$scratch/s") > serve.out 2>&1 &
+server=$!
+tries=0
+until [ -S "$scratch/s" ]; do
+    tries=$((tries + 1))
+    [ $tries -le 100 ] || fail "server did not start"
+    sleep 0.1
+done
+
+"$binary" --client --socket "$scratch/s" < "$tests/batch.in" > client.out 2> client.err
+relist "$binary" --client --socket "$scratch/s" > relist.out 2>> client.err
+"$binary" --client --socket "$scratch/s" < long.in > long.out 2>> client.err
+diff -u long.expected long.out || fail "server ran part of an over-long line"
+cat client.out relist.out | sed -E 's/[0-9]{10}/<time>/g' > served.out
+if ! diff -u "$tests/batch.expected" served.out; then
+    cat client.err serve.out
+    fail "server output differs from tests/batch.expected"
+fi
+
+# A book nobody saved, then SIGTERM straight away: the server must save
+# it on the way out and remove its socket
+printf 'login\tadmin\tadmin123\nadd\tLast Words\tTerm Author\t978-0-00-000000-2\t2024\n' |
+    "$binary" --client --socket "$scratch/s" > /dev/null 2>> client.err
+relist "$binary" --client --socket "$scratch/s" > unsaved.out 2>> client.err
+kill -TERM "$server"
+wait "$server" || fail "server exited with status $?"
+server=
+[ ! -e "$scratch/s" ] || fail "server left its socket behind"
+grep -q 'Last Words' unsaved.out || fail "server did not add the unsaved book"
+
+(cd served && relist "$binary" --batch) > saved.out 2> saved.err
+if ! diff -u unsaved.out saved.out; then
+    cat saved.err
+    fail "server did not save its catalog on SIGTERM"
+fi
+echo "batch protocol: ok"
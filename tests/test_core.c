@@ -0,0 +1,1495 @@
+// Behavior tests for the catalog engine. The engine is compiled into this
+// file so the tests can reach its internals (indexes, search kernels,
+// epochs) as well as the library_core.h API. Each test works in a fresh
+// scratch directory; run with `make test`.
+#define POOL_THREADS 4      // a real pool even on a single CPU
+#include "../library_core.c"
+
+#include <stdarg.h>
+#include <math.h>
+
+int checks = 0;
+int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+static void check(int ok, const char* text, const char* file, int line) {
+    checks++;
+    if (!ok) {
+        failures++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+    }
+}
+
+// Scratch directory the tests run in, removed at exit
+char scratch[] = "/tmp/library_test_XXXXXX";
+
+static void removeScratch() {
+    char command[64];
+    snprintf(command, sizeof(command), "rm -rf %s", scratch);
+    if (system(command) != 0) {
+        fprintf(stderr, "cannot remove %s\n", scratch);
+    }
+}
+
+static int writeFile(const char* path, const char* text) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return 0;
+    int ok = fputs(text, file) >= 0;
+    return (fclose(file) == 0) & ok;
+}
+
+// Fill `text` from a format and return it, for building synthetic records
+static char* format(char* text, size_t size, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(text, size, fmt, args);
+    va_end(args);
+    return text;
+}
+
+// Add `books` synthetic books; book n gets "Title n", "Author n%50" and
+// ISBN 978-n
+static void addBooks(LibCatalog* cat, int books) {
+    char title[MAX_STR], author[MAX_STR], isbn[20];
+    LibBook book;
+    for (int n = 1; n <= books; n++) {
+        LibStatus status = libAddBook(cat, format(title, sizeof(title), "Title %d", n),
+                                      format(author, sizeof(author), "Author %d", n % 50),
+                                      format(isbn, sizeof(isbn), "978-%d", n), 1900 + n % 100, &book);
+        CHECK(status == LIB_OK);
+    }
+}
+
+// ID, title and ISBN indexes across growth, removal and reuse of slots
+static void testIndexes() {
+    LibCatalog* cat = libCreate();
+    LibBook book;
+    char text[MAX_STR];
+
+    addBooks(cat, 5000);
+    CHECK(libBookCount(cat) == 5000);
+    for (int id = 1; id <= 5000; id++) {
+        if (libGetBook(cat, id, &book) != LIB_OK || book.id != id) {
+            CHECK(!"book missing from the ID index");
+            break;
+        }
+    }
+    CHECK(libGetBook(cat, 0, &book) == LIB_ERR_NOT_FOUND);
+    CHECK(libGetBook(cat, 5001, &book) == LIB_ERR_NOT_FOUND);
+
+    // Title and ISBN lookups are case-insensitive and report the holder
+    CHECK(libAddBook(cat, "TITLE 42", "Someone", "1", 2000, &book) == LIB_ERR_DUPLICATE_TITLE);
+    CHECK(book.id == 42);
+    CHECK(libAddBook(cat, "Fresh", "Someone", "978-77", 2000, &book) == LIB_ERR_DUPLICATE_ISBN);
+    CHECK(book.id == 77);
+    CHECK(libAddBook(cat, "", "Someone", "1", 2000, &book) == LIB_ERR_INVALID);
+    CHECK(libAddBook(cat, "Fresh", "Someone", "1", 999, &book) == LIB_ERR_INVALID);
+
+    // Removing every other book leaves tombstones the lookups must skip
+    for (int id = 2; id <= 5000; id += 2) {
+        CHECK(libRemoveBook(cat, id) == LIB_OK);
+    }
+    CHECK(libRemoveBook(cat, 2) == LIB_ERR_NOT_FOUND);
+    CHECK(libBookCount(cat) == 2500);
+    int found = 0;
+    for (int id = 1; id <= 5000; id++) {
+        found += libGetBook(cat, id, &book) == LIB_OK && book.id == id;
+    }
+    CHECK(found == 2500);
+    CHECK(searchBookByTitle(cat, format(text, sizeof(text), "title %d", 100)) == NULL);
+    CHECK(searchBookByTitle(cat, format(text, sizeof(text), "title %d", 101)) != NULL);
+    CHECK(searchBookByISBN(cat, format(text, sizeof(text), "978-%d", 200)) == NULL);
+    CHECK(searchBookByISBN(cat, format(text, sizeof(text), "978-%d", 201)) != NULL);
+
+    // Titles and ISBNs of removed books are free again; IDs are not reused
+    CHECK(libAddBook(cat, "Title 100", "Someone", "978-200", 2000, &book) == LIB_OK);
+    CHECK(book.id == 5001);
+    CHECK(libGetBook(cat, 5001, &book) == LIB_OK && strcmp(book.title, "Title 100") == 0);
+    libClose(cat);
+}
+
+// Deterministic pseudo-random numbers for synthetic data
+unsigned int seed = 12345;
+
+static unsigned int nextRandom() {
+    seed = seed * 1103515245u + 12345u;
+    return (seed >> 8) & 0xFFFFFF;
+}
+
+// A few words drawn from a small vocabulary, mixed case
+static char* randomText(char* text, size_t size) {
+    static const char* words[] = {"Ocean", "river", "ALGORITHM", "data", "Stone", "light",
+                                  "night", "garden", "Mirror", "of", "the", "and", "x"};
+    size_t length = 0;
+    int count = 1 + (int)(nextRandom() % 4);
+    text[0] = '\0';
+    for (int i = 0; i < count && length + 12 < size; i++) {
+        length += (size_t)snprintf(text + length, size - length, "%s%s", i ? " " : "",
+                                   words[nextRandom() % (sizeof(words) / sizeof(words[0]))]);
+    }
+    return text;
+}
+
+// IDs matched by libSearch, ascending, or -1 on error
+static int searchIds(LibCatalog* cat, const char* query, int* ids, int max) {
+    LibResults* results;
+    if (libSearch(cat, query, &results) != LIB_OK) return -1;
+    int count = (int)libResultsCount(results);
+    for (int i = 0; i < count && i < max; i++) {
+        LibBook book;
+        libResultsGet(results, i, &book);
+        ids[i] = book.id;
+    }
+    libResultsFree(results);
+    qsort(ids, (size_t)(count < max ? count : max), sizeof(int), compareInts);
+    return count;
+}
+
+// IDs a plain case-insensitive scan of every field matches, ascending
+static int scanIds(LibCatalog* cat, const char* query, int* ids, int max) {
+    int count = 0;
+    for (Book* book = cat->head; book != NULL; book = book->next) {
+        if (strcasestr_custom(book->title, query) || strcasestr_custom(book->author, query) ||
+            strcasestr_custom(book->isbn, query)) {
+            if (count < max) ids[count] = book->id;
+            count++;
+        }
+    }
+    qsort(ids, (size_t)(count < max ? count : max), sizeof(int), compareInts);
+    return count;
+}
+
+// Searches answered from the trigram index (and, for short queries, by a
+// scan) match a brute-force scan, before and after the catalog changes
+static void testSearch() {
+    enum { BOOKS = 3000, QUERIES = 400 };
+    static int expected[BOOKS + 100], actual[BOOKS + 100];
+    LibCatalog* cat = libCreate();
+    char title[MAX_STR], author[MAX_STR], isbn[20], query[MAX_STR];
+    LibBook book;
+
+    seed = 1;
+    for (int n = 0; n < BOOKS; n++) {
+        size_t length = strlen(randomText(title, 60));
+        snprintf(title + length, sizeof(title) - length, " %d", n);
+        libAddBook(cat, title, randomText(author, 40), format(isbn, sizeof(isbn), "978-%d", n), 2000, &book);
+    }
+
+    for (int round = 0; round < 2; round++) {
+        int mismatches = 0;
+        for (int q = 0; q < QUERIES; q++) {
+            // Slices of real titles of every length, plus made-up strings
+            Book* source = searchBook(cat, 1 + (int)(nextRandom() % BOOKS));
+            if (source != NULL && q % 4 != 0) {
+                size_t length = strlen(source->title);
+                size_t start = nextRandom() % length;
+                size_t take = 1 + nextRandom() % (length - start);
+                memcpy(query, source->title + start, take);
+                query[take] = '\0';
+                if (q % 3 == 0) query[0] = (char)toupper((unsigned char)query[0]);
+            } else {
+                randomText(query, 30);
+            }
+            int want = scanIds(cat, query, expected, BOOKS + 100);
+            int got = searchIds(cat, query, actual, BOOKS + 100);
+            if (got != want || memcmp(expected, actual, (size_t)want * sizeof(int)) != 0) {
+                if (mismatches++ == 0) fprintf(stderr, "search \"%s\": %d results, scan %d\n", query, got, want);
+            }
+        }
+        CHECK(mismatches == 0);
+
+        // Remove and add books so the second round runs on an index kept
+        // up to date incrementally
+        for (int id = 1 + round; id <= BOOKS; id += 7) libRemoveBook(cat, id);
+        for (int n = 0; n < 100; n++) {
+            libAddBook(cat, format(title, sizeof(title), "Lighthouse %d %d", round, n), "Nightingale",
+                       format(isbn, sizeof(isbn), "979-%d-%d", round, n), 2000, &book);
+        }
+    }
+
+    // Queries must fit MAX_STR with their terminator
+    LibResults* results;
+    memset(query, 'a', MAX_STR - 1);
+    query[MAX_STR - 1] = '\0';
+    CHECK(libSearch(cat, query, &results) == LIB_OK && libResultsCount(results) == 0);
+    libResultsFree(results);
+    char long_query[4 * MAX_STR];
+    memset(long_query, 'a', sizeof(long_query) - 1);
+    long_query[sizeof(long_query) - 1] = '\0';
+    CHECK(libSearch(cat, long_query, &results) == LIB_ERR_INVALID && results == NULL);
+    CHECK(libSearch(cat, "", &results) == LIB_ERR_INVALID);
+    libClose(cat);
+
+    // Results come in catalog order, which a data file may give out of ID
+    // order, whether the trigram index or a scan answers the query
+    LibOpenReport report;
+    mkdir("order", 0755);
+    CHECK(writeFile("order/library.dat", "VERSION:2\nNEXT_ID:4\nBOOK_COUNT:3\n---\n"
+                    "3|Foo three|A|978-3|2001|0||0|0\n"
+                    "1|Foo one|B|978-1|2002|0||0|0\n"
+                    "2|Foo two|C|978-2|2003|0||0|0\n"));
+    cat = libOpen("order", &report);
+    CHECK(report.data == LIB_OK && libBookCount(cat) == 3);
+    static const char* queries[] = {"Fo", "Foo", "foo t", "978"};
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        char ids[16] = "";
+        CHECK(libSearch(cat, queries[q], &results) == LIB_OK);
+        for (size_t i = 0; i < libResultsCount(results) && i < 3; i++) {
+            libResultsGet(results, i, &book);
+            ids[i] = (char)('0' + book.id);
+        }
+        libResultsFree(results);
+        CHECK(strcmp(ids, q == 2 ? "32" : "312") == 0);
+    }
+    libClose(cat);
+}
+
+// The SSE2 and AVX2 substring kernels agree with the scalar one on
+// search text laid out as the slabs hold it: folded fields separated by
+// NULs and zero padding up to SEARCH_TEXT_LEN
+static void testSearchKernels() {
+#ifdef HAVE_SIMD_SEARCH
+    __builtin_cpu_init();
+    int sse2 = __builtin_cpu_supports("sse2");
+    int avx2 = __builtin_cpu_supports("avx2");
+    int mismatches = 0;
+    int matches = 0;
+
+    seed = 7;
+    for (int round = 0; round < 20000; round++) {
+        char text[SEARCH_TEXT_LEN], needle[32];
+        memset(text, 0, sizeof(text));
+
+        // A small alphabet makes partial matches of the first and last
+        // byte common, which is where the vector kernels can go wrong
+        size_t text_len = nextRandom() % (2 * MAX_STR + 20);
+        for (size_t i = 0; i < text_len; i++) {
+            text[i] = nextRandom() % 16 == 0 ? '\0' : "abc "[nextRandom() % 4];
+        }
+        size_t needle_len = 1 + nextRandom() % 12;
+        if (text_len > needle_len && round % 2 == 0) {
+            memcpy(needle, text + nextRandom() % (text_len - needle_len + 1), needle_len);
+            needle[0] = needle[0] == '\0' ? 'a' : needle[0];
+        } else {
+            for (size_t i = 0; i < needle_len; i++) needle[i] = "abc"[nextRandom() % 3];
+        }
+        needle[needle_len] = '\0';
+
+        int want = searchKernelScalar(text, text_len, needle, needle_len);
+        matches += want;
+        if (sse2 && searchKernelSSE2(text, text_len, needle, needle_len) != want) mismatches++;
+        if (avx2 && searchKernelAVX2(text, text_len, needle, needle_len) != want) mismatches++;
+    }
+    CHECK(mismatches == 0);
+    CHECK(matches > 1000);      // both outcomes were exercised
+    CHECK(matches < 19000);
+#endif
+
+    // Whatever kernel was selected, a match at the very end of the text
+    // and a needle longer than the text behave
+    char text[SEARCH_TEXT_LEN] = "ab\0cd\0" "9";
+    initSearchKernel();
+    CHECK(search_kernel(text, 7, "9", 1) == 1);
+    CHECK(search_kernel(text, 7, "d\0" "9", 3) == 1);
+    CHECK(search_kernel(text, 7, "ab\0cd\0" "9x", 8) == 0);
+}
+
+// Every book of a catalog in catalog order; the caller frees the array
+static size_t captureBooks(LibCatalog* cat, LibBook** books) {
+    LibResults* results;
+    *books = NULL;
+    if (libList(cat, FILTER_ALL, NULL, &results) != LIB_OK) return 0;
+    size_t count = libResultsCount(results);
+    *books = (LibBook*)malloc((count + 1) * sizeof(LibBook));
+    for (size_t i = 0; i < count; i++) {
+        libResultsGet(results, i, &(*books)[i]);
+    }
+    libResultsFree(results);
+    return count;
+}
+
+static int sameBook(const LibBook* a, const LibBook* b) {
+    return a->id == b->id && strcmp(a->title, b->title) == 0 && strcmp(a->author, b->author) == 0 &&
+           strcmp(a->isbn, b->isbn) == 0 && a->year == b->year && a->is_issued == b->is_issued &&
+           (!a->is_issued || (strcmp(a->issued_to, b->issued_to) == 0 &&
+                              a->issue_date == b->issue_date && a->due_date == b->due_date));
+}
+
+// The catalog in `dir` holds exactly `books`, in the same order
+static int catalogMatches(const char* dir, const LibBook* books, size_t count, LibOpenReport* report) {
+    LibCatalog* cat = libOpen(dir, report);
+    LibBook* loaded;
+    size_t loaded_count = captureBooks(cat, &loaded);
+    int same = loaded_count == count;
+    for (size_t i = 0; same && i < count; i++) {
+        same = sameBook(&books[i], &loaded[i]);
+    }
+    free(loaded);
+    libClose(cat);
+    return same;
+}
+
+// Issue, return, remove and add a spread of books
+static void churn(LibCatalog* cat, int round) {
+    char title[MAX_STR], isbn[20];
+    LibBook book;
+    double fine;
+    int books = libBookCount(cat);
+    for (int id = 1 + round; id <= books; id += 11) {
+        libIssueBook(cat, id, format(title, sizeof(title), "Reader %d", id % 13), 1 + id % 30, &book);
+    }
+    for (int id = 1 + round; id <= books; id += 33) libReturnBook(cat, id, &fine, &book);
+    for (int id = 5 + round; id <= books; id += 97) libRemoveBook(cat, id);
+    for (int n = 0; n < 50; n++) {
+        libAddBook(cat, format(title, sizeof(title), "Round %d book %d", round, n), "Churn",
+                   format(isbn, sizeof(isbn), "5-%d-%d", round, n), 2001, &book);
+    }
+}
+
+static long fileSize(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+// Sort keys built to trip up the prefix sort: stems that share more than
+// the eight prefix bytes in different cases, one that fills the prefix
+// exactly, and tails with bytes above 0x7f. Many keys tie.
+static char* randomSortKey(char* text, size_t size) {
+    static const char* stems[] = {"", "x", "Collected Works ", "COLLECTED works ", "collected WORKS of ",
+                                  "\xc3\x89tudes compl\xc3\xa8tes ", "\xc3\xa9tudes ",
+                                  "\xff\xfe\xfd\xfc\xfb\xfa\xf9\xf8"};
+    static const char tails[] = "aAbBzZ \x80\xc3\xa9\xff";
+    size_t length = (size_t)snprintf(text, size, "%s", stems[nextRandom() % (sizeof(stems) / sizeof(stems[0]))]);
+    int count = (int)(nextRandom() % 4);
+    for (int i = 0; i < count && length + 1 < size; i++) {
+        text[length++] = tails[nextRandom() % (sizeof(tails) - 1)];
+    }
+    text[length] = '\0';
+    return text;
+}
+
+typedef struct {
+    Book* book;
+    size_t position;    // in list order, which breaks ties
+} SortReference;
+
+const SortSpec* reference_spec;
+
+// Plain qsort comparator over the whole key list, for checking the engine
+static int compareSortReference(const void* a, const void* b) {
+    const SortReference* x = (const SortReference*)a;
+    const SortReference* y = (const SortReference*)b;
+    for (int k = 0; k < reference_spec->count; k++) {
+        int order = 0;
+        switch (reference_spec->keys[k]) {
+            case SORT_TITLE: order = strcasecmp(x->book->title, y->book->title); break;
+            case SORT_AUTHOR: order = strcasecmp(x->book->author, y->book->author); break;
+            case SORT_YEAR: order = (x->book->year > y->book->year) - (x->book->year < y->book->year); break;
+            case SORT_ID: order = (x->book->id > y->book->id) - (x->book->id < y->book->id); break;
+        }
+        if (order != 0) return order;
+    }
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+// The parallel sort engine against qsort on a catalog above
+// PARALLEL_SORT_MIN, for the specialized orders and generic key lists
+static void testSortOrders() {
+    enum { BOOKS = PARALLEL_SORT_MIN + 4567 };
+    static const char* orders[] = {"title,id", "author,id", "author,year,title", "title",
+                                   "author,title,year", "year,author", "id"};
+    LibCatalog* cat = libCreate();
+    char title[MAX_STR], author[MAX_STR], isbn[20];
+
+    seed = 16;
+    int added = 0;
+    for (int n = 0; n < BOOKS; n++) {
+        int id = (int)(((long)n * 7919) % BOOKS) + 1;      // IDs out of list order
+        added += catalogAddBook(cat, id, randomSortKey(title, sizeof(title)), randomSortKey(author, sizeof(author)),
+                                format(isbn, sizeof(isbn), "978-%d", id), 1990 + (int)(nextRandom() % 4)) != NULL;
+    }
+    CHECK(added == BOOKS);
+    CHECK(poolThreads() > 1);
+
+    SortReference* reference = (SortReference*)malloc(BOOKS * sizeof(SortReference));
+    CHECK(reference != NULL);
+    for (size_t o = 0; reference != NULL && o < sizeof(orders) / sizeof(orders[0]); o++) {
+        SortSpec spec;
+        CHECK(parseSortSpec(orders[o], &spec));
+        size_t count = 0;
+        for (Book* book = firstBook(cat); book != NULL && count < BOOKS; book = nextBook(book)) {
+            SortReference entry = {book, count};
+            reference[count++] = entry;
+        }
+        CHECK(count == BOOKS);
+        reference_spec = &spec;
+        qsort(reference, count, sizeof(SortReference), compareSortReference);
+
+        size_t sorted;
+        SortItem* items = sortCatalog(cat, &spec, &sorted);
+        CHECK(items != NULL && sorted == count);
+        size_t misplaced = 0;
+        for (size_t i = 0; items != NULL && i < sorted && i < count; i++) {
+            if (items[i].book != reference[i].book) misplaced++;
+        }
+        if (misplaced != 0) fprintf(stderr, "order %s: %zu books misplaced\n", orders[o], misplaced);
+        CHECK(misplaced == 0);
+        free(items);
+    }
+    free(reference);
+    libClose(cat);
+}
+
+// Copy the snapshot at `from` into damaged/library.dat with `header`
+// written over its own and cut to `keep` bytes (all of it when negative),
+// then open it. Returns the data status; *books gets the books loaded.
+static LibStatus openDamagedSnapshot(const char* from, const SnapshotHeader* header, long keep, int* books) {
+    FILE* file = fopen(from, "rb");
+    char* data = NULL;
+    long size = -1;
+    if (file != NULL && fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0) {
+        rewind(file);
+        data = (char*)malloc((size_t)size);
+        if (data != NULL && fread(data, 1, (size_t)size, file) != (size_t)size) size = -1;
+    }
+    if (file != NULL) fclose(file);
+    if (data == NULL || size < 0) {
+        free(data);
+        return LIB_ERR_IO;
+    }
+
+    if (header != NULL) memcpy(data + SNAPSHOT_MAGIC_LEN, header, sizeof(*header));
+    if (keep >= 0 && keep < size) size = keep;
+    mkdir("damaged", 0755);
+    remove("damaged/library.journal");
+    file = fopen("damaged/library.dat", "wb");
+    int written = file != NULL && fwrite(data, 1, (size_t)size, file) == (size_t)size;
+    if (file != NULL) written &= fclose(file) == 0;
+    free(data);
+    if (!written) return LIB_ERR_IO;
+
+    LibOpenReport report;
+    LibCatalog* cat = libOpen("damaged", &report);
+    *books = report.books;
+    libClose(cat);
+    return report.data;
+}
+
+// VERSION:3 snapshots, full and patched in place, and VERSION:2 text files
+// (large enough to be parsed on several threads) load back what was saved.
+// Saves only commit the journal, so each round checkpoints it into
+// library.dat and deletes it before reloading: the data file alone counts.
+static void testSnapshotRoundTrip() {
+    LibOpenReport report;
+    LibBook* books;
+    size_t count;
+
+    mkdir("snapshot", 0755);
+    LibCatalog* cat = libOpen("snapshot", &report);
+    CHECK(report.data == LIB_ERR_NOT_FOUND);
+    addBooks(cat, 20000);
+    churn(cat, 0);
+    CHECK(journalCheckpoint(cat, 1));
+    count = captureBooks(cat, &books);
+    libClose(cat);
+
+    FILE* file = fopen("snapshot/library.dat", "rb");
+    char magic[SNAPSHOT_MAGIC_LEN] = "";
+    CHECK(file != NULL && fread(magic, 1, SNAPSHOT_MAGIC_LEN, file) == SNAPSHOT_MAGIC_LEN);
+    CHECK(memcmp(magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LEN) == 0);
+    if (file != NULL) fclose(file);
+
+    remove("snapshot/library.journal");
+    CHECK(catalogMatches("snapshot", books, count, &report));
+    CHECK(report.data == LIB_OK && report.books == (int)count);
+    free(books);
+
+    // Incremental saves patch records, tombstone removed ones and append
+    // segments for new books
+    for (int round = 1; round <= 3; round++) {
+        cat = libOpen("snapshot", &report);
+        churn(cat, round);
+        CHECK(libHasUnsavedChanges(cat));
+        CHECK(libSave(cat) == LIB_OK);
+        CHECK(!libHasUnsavedChanges(cat));
+        CHECK(journalCheckpoint(cat, 1));
+        CHECK(cat->changes.segments == (uint32_t)round);     // patched, not rewritten
+        count = captureBooks(cat, &books);
+        libClose(cat);
+        remove("snapshot/library.journal");
+        CHECK(catalogMatches("snapshot", books, count, &report));
+        free(books);
+    }
+
+    // The same catalog written as VERSION:2 text
+    mkdir("text", 0755);
+    cat = libOpen("snapshot", &report);
+    count = captureBooks(cat, &books);
+    ByteBuffer image = {NULL, 0, 0};
+    CHECK(buildTextImage(cat, &image) && writeFileAtomic("text/library.dat", image.data, image.length));
+    bufferFree(&image);
+    libClose(cat);
+    struct stat st;
+    CHECK(stat("text/library.dat", &st) == 0 && st.st_size > PARALLEL_LOAD_MIN);
+    CHECK(catalogMatches("text", books, count, &report));
+    CHECK(report.data == LIB_OK);
+    free(books);
+
+    // Header offsets whose sums wrap past the end of the address space, and
+    // a segment cut short, are reported as corrupt instead of being read
+    SnapshotHeader header;
+    file = fopen("snapshot/library.dat", "rb");
+    CHECK(file != NULL && fseek(file, SNAPSHOT_MAGIC_LEN, SEEK_SET) == 0 &&
+          fread(&header, sizeof(header), 1, file) == 1);
+    if (file != NULL) fclose(file);
+    CHECK(header.segments == 3 && header.book_count > 0);
+    int loaded = -1;
+    SnapshotHeader wrapped = header;
+    wrapped.records_offset = UINT64_MAX - (uint64_t)header.book_count * sizeof(SnapshotRecord) + 1 + 64;
+    CHECK(openDamagedSnapshot("snapshot/library.dat", &wrapped, -1, &loaded) == LIB_ERR_CORRUPT);
+    CHECK(loaded == 0);
+    wrapped = header;
+    wrapped.heap_offset = UINT64_MAX - header.heap_size + 1 + 64;
+    CHECK(openDamagedSnapshot("snapshot/library.dat", &wrapped, -1, &loaded) == LIB_ERR_CORRUPT);
+    CHECK(loaded == 0);
+    CHECK(openDamagedSnapshot("snapshot/library.dat", NULL, fileSize("snapshot/library.dat") - 1, &loaded) ==
+          LIB_ERR_CORRUPT);
+    CHECK(loaded > 0);                  // the base and earlier segments still load
+    CHECK(openDamagedSnapshot("snapshot/library.dat", NULL, -1, &loaded) == LIB_OK);
+
+    // A damaged snapshot is reported, not loaded
+    file = fopen("snapshot/library.dat", "r+b");
+    if (file != NULL) {
+        fseek(file, SNAPSHOT_MAGIC_LEN + 8, SEEK_SET);
+        fputc(0x7f, file);
+        fputc(0x7f, file);
+        fclose(file);
+    }
+    cat = libOpen("snapshot", &report);
+    CHECK(report.data == LIB_ERR_CORRUPT);
+    libClose(cat);
+}
+
+static int copyFile(const char* from, const char* to) {
+    FILE* in = fopen(from, "rb");
+    FILE* out = in != NULL ? fopen(to, "wb") : NULL;
+    char buffer[8192];
+    size_t got;
+    int ok = out != NULL;
+    while (ok && (got = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = fwrite(buffer, 1, got, out) == got;
+    }
+    if (in != NULL) fclose(in);
+    if (out != NULL) ok &= fclose(out) == 0;
+    return ok;
+}
+
+// Changes survive through the journal alone, a torn last record is cut
+// off, checkpoints fold the journal into library.dat (also while changes
+// keep coming in), and replaying records the snapshot already holds is
+// harmless
+static void testJournal() {
+    LibOpenReport report;
+    LibBook* books;
+    size_t count;
+    char title[MAX_STR], isbn[20];
+    LibBook book;
+
+    mkdir("journal", 0755);
+    LibCatalog* cat = libOpen("journal", &report);
+    CHECK(report.journal_records == -1);
+    addBooks(cat, 2000);
+    churn(cat, 0);
+    CHECK(libSave(cat) == LIB_OK);
+    count = captureBooks(cat, &books);
+    libClose(cat);
+    CHECK(fileSize("journal/library.dat") < 0);     // nothing but the journal yet
+    CHECK(catalogMatches("journal", books, count, &report));
+    CHECK(report.data == LIB_ERR_NOT_FOUND && report.journal_records > 2000);
+    free(books);
+
+    // Changes nobody saved are still journaled when the catalog closes
+    cat = libOpen("journal", &report);
+    churn(cat, 1);
+    count = captureBooks(cat, &books);
+    libClose(cat);
+    CHECK(catalogMatches("journal", books, count, &report));
+
+    // A record torn by a crash is dropped along with whatever follows
+    long size = fileSize("journal/library.journal");
+    FILE* file = fopen("journal/library.journal", "ab");
+    CHECK(file != NULL && fwrite("\x40\0\0\0garbage", 1, 11, file) == 11);
+    if (file != NULL) fclose(file);
+    CHECK(catalogMatches("journal", books, count, &report));
+    CHECK(fileSize("journal/library.journal") == size);
+    free(books);
+
+    // A checkpoint moves everything into library.dat and empties the
+    // journal; the old journal kept around must replay harmlessly
+    CHECK(copyFile("journal/library.journal", "old.journal"));
+    cat = libOpen("journal", &report);
+    CHECK(journalCheckpoint(cat, 1));
+    count = captureBooks(cat, &books);
+    libClose(cat);
+    CHECK(fileSize("journal/library.dat") > 0);
+    CHECK(fileSize("journal/library.journal") == JOURNAL_MAGIC_LEN);
+    CHECK(fileSize("journal/library.journal.old") < 0);
+    CHECK(copyFile("old.journal", "journal/library.journal.old"));
+    CHECK(catalogMatches("journal", books, count, &report));
+    CHECK(report.data == LIB_OK && report.journal_records > 0);
+    free(books);
+
+    // Checkpoints that rewrite library.dat on the compactor thread, with
+    // changes arriving while it writes, alternating with patched ones
+    cat = libOpen("journal", &report);
+    for (int round = 2; round < 6; round++) {
+        if (round % 2 == 0) cat->changes.base_valid = 0;
+        CHECK(journalCheckpoint(cat, 0));
+        churn(cat, round);
+        libAddBook(cat, format(title, sizeof(title), "During compaction %d", round), "Late",
+                   format(isbn, sizeof(isbn), "6-%d", round), 2002, &book);
+    }
+    CHECK(libSave(cat) == LIB_OK);
+    count = captureBooks(cat, &books);
+    libClose(cat);
+    CHECK(catalogMatches("journal", books, count, &report));
+    free(books);
+
+    // A directory path well past MAX_STR whose first MAX_STR - 1
+    // characters name its parent: checkpoint temp files must still land
+    // next to the data files they replace
+    static ImportReport import;
+    char dir[400];
+    int length = snprintf(dir, sizeof(dir), "journal/%0*d", MAX_STR - 1 - 8, 0);
+    CHECK(mkdir(dir, 0755) == 0);
+    snprintf(dir + length, sizeof(dir) - length, "/%0150d", 1);
+    CHECK(mkdir(dir, 0755) == 0);
+    cat = libOpen(dir, &report);
+    addBooks(cat, 10);
+    CHECK(writeFile("long.csv", "title,author,isbn,year\nLong Path,Deep Author,978-9-99,2020\n"));
+    CHECK(libImport(cat, "long.csv", &import) == LIB_OK && import.imported == 1 && import.saved);
+    CHECK(journalCheckpoint(cat, 1));
+    count = captureBooks(cat, &books);
+    libClose(cat);
+    char path[LIB_PATH_MAX];
+    CHECK(fileSize(format(path, sizeof(path), "%s/library.dat", dir)) > 0);
+    CHECK(catalogMatches(dir, books, count, &report) && count == 11);
+    free(books);
+}
+
+static int importError(const ImportReport* report, int row, const char* reason) {
+    for (int i = 0; i < report->error_count; i++) {
+        if (report->errors[i].row == row && strcmp(report->errors[i].reason, reason) == 0) return 1;
+    }
+    return 0;
+}
+
+// CSV and TSV imports: header-driven column order, quoting, every kind of
+// rejected row with its row number, and the imported books being saved
+static void testImport() {
+    static ImportReport report;
+    LibOpenReport open_report;
+    LibBook book;
+
+    mkdir("import", 0755);
+    LibCatalog* cat = libOpen("import", &open_report);
+    CHECK(libAddBook(cat, "Already Here", "Someone", "978-1", 2000, &book) == LIB_OK);
+
+    char long_title[2 * MAX_STR];
+    memset(long_title, 'x', sizeof(long_title) - 1);
+    long_title[sizeof(long_title) - 1] = '\0';
+    char csv[1024];
+    snprintf(csv, sizeof(csv),
+             "Year,Title,ISBN,Author\n"                           // row 1
+             "1999,\"Hello, \"\"World\"\"\",978-0-306-40615-7,Ann\n"
+             "2000,Short\n"
+             "abcd,Bad Year,2,Bob\n"
+             "999,Too Old,3,Bob\n"                                // row 5
+             "2000,,4,Bob\n"
+             "2001,\"hello, \"\"world\"\"\",5,Cy\n"
+             "2002,Fresh Title,978-1,Dee\n"
+             "2003,%s,6,Eve\n"
+             "\n"                                                 // row 10
+             "2004,Windows Line,7,Fay\r\n"
+             "2005,\"Two\nLines\",8,Gus\n"
+             "  2006 , Padded , 9 , Hal \n",
+             long_title);
+    CHECK(writeFile("books.csv", csv));
+    CHECK(libImport(cat, "books.csv", &report) == LIB_OK);
+    CHECK(report.rows == 11);
+    CHECK(report.imported == 4);
+    CHECK(report.duplicates == 2);
+    CHECK(report.invalid == 5);
+    CHECK(report.isbn_warnings == 3);
+    CHECK(report.saved);
+    CHECK(report.error_count == 7);
+    CHECK(importError(&report, 3, "missing column"));
+    CHECK(importError(&report, 4, "invalid year"));
+    CHECK(importError(&report, 5, "invalid year"));
+    CHECK(importError(&report, 6, "empty title, author or ISBN"));
+    CHECK(importError(&report, 7, "duplicate title"));
+    CHECK(importError(&report, 8, "duplicate ISBN"));
+    CHECK(importError(&report, 9, "field too long"));
+
+    Book* found = searchBookByTitle(cat, "Hello, \"World\"");
+    CHECK(found != NULL && strcmp(found->author, "Ann") == 0 && found->year == 1999);
+    found = searchBookByTitle(cat, "Windows Line");
+    CHECK(found != NULL && strcmp(found->author, "Fay") == 0);
+    CHECK(searchBookByTitle(cat, "Two\nLines") != NULL);
+    found = searchBookByTitle(cat, "Padded");
+    CHECK(found != NULL && strcmp(found->isbn, "9") == 0 && strcmp(found->author, "Hal") == 0);
+    libClose(cat);
+
+    // The import was checkpointed: it is in library.dat, not the journal
+    remove("import/library.journal");
+    cat = libOpen("import", &open_report);
+    CHECK(open_report.books == 5);
+    CHECK(searchBookByTitle(cat, "Padded") != NULL);
+
+    // Tab-separated without a header: title, author, ISBN, year (a cell
+    // holding a column name would make the first row a header)
+    CHECK(writeFile("books.tsv", "Tab One\tWriter\t11\t2010\nTab Two\tWriter\t12\tnope\n"));
+    CHECK(libImport(cat, "books.tsv", &report) == LIB_OK);
+    CHECK(report.rows == 2 && report.imported == 1 && importError(&report, 2, "invalid year"));
+    found = searchBookByTitle(cat, "Tab One");
+    CHECK(found != NULL && found->year == 2010 && strcmp(found->isbn, "11") == 0);
+
+    // More rejected rows than the report keeps are still counted
+    FILE* file = fopen("many.csv", "wb");
+    for (int row = 0; file != NULL && row < IMPORT_MAX_ERRORS + 50; row++) {
+        fprintf(file, "Bad %d,Writer,%d,1\n", row, row);
+    }
+    if (file != NULL) fclose(file);
+    CHECK(libImport(cat, "many.csv", &report) == LIB_OK);
+    CHECK(report.invalid == IMPORT_MAX_ERRORS + 50 && report.error_count == IMPORT_MAX_ERRORS);
+
+    // An empty file is an import of nothing, not a read error
+    CHECK(writeFile("empty.csv", ""));
+    CHECK(libImport(cat, "empty.csv", &report) == LIB_OK);
+    CHECK(report.rows == 0 && report.imported == 0 && report.error_count == 0 && report.saved);
+
+    CHECK(libImport(cat, "missing.csv", &report) == LIB_ERR_IO);
+    libClose(cat);
+}
+
+int released = 0;
+
+static void countRelease(LibCatalog* cat, void* ptr) {
+    (void)cat;
+    released++;
+    free(ptr);
+}
+
+// Retired memory outlives every reader pinned before it was retired, and
+// result sets keep the books they hold readable after removal
+static void testEpochReclamation() {
+    LibCatalog* cat = libCreate();
+    LibResults* results;
+    LibBook book;
+
+    int pin = epochPin(cat);
+    CHECK(pin >= 0);
+    released = 0;
+    epochRetire(cat, malloc(16), countRelease);
+    epochCollect(cat);
+    epochCollect(cat);
+    CHECK(released == 0);
+    epochUnpin(cat, pin);
+    epochCollect(cat);
+    CHECK(released == 1);
+
+    addBooks(cat, 100);
+    CHECK(libSearch(cat, "Title 42", &results) == LIB_OK && libResultsCount(results) == 1);
+    CHECK(libRemoveBook(cat, 42) == LIB_OK);
+    for (int n = 0; n < 200; n++) {
+        char title[MAX_STR], isbn[20];
+        libAddBook(cat, format(title, sizeof(title), "Reuse %d", n), "Someone",
+                   format(isbn, sizeof(isbn), "1-%d", n), 2000, &book);
+        libRemoveBook(cat, book.id);
+    }
+    libResultsGet(results, 0, &book);
+    CHECK(book.id == 42 && strcmp(book.title, "Title 42") == 0);
+    libResultsFree(results);
+    libClose(cat);
+}
+
+// With every reader slot taken, single-book reads and exports fall back to
+// the catalog lock (nested locking included) while queries that hand out
+// result sets report LIB_ERR_BUSY; all recover once slots free up
+static void testReaderSlotsExhausted() {
+    LibCatalog* cat = libCreate();
+    LibResults* results;
+    LibBook book;
+    static int pins[EPOCH_SLOTS];
+
+    addBooks(cat, 50);
+    CHECK(libIssueBook(cat, 7, "Reader", 10, &book) == LIB_OK);
+    int pinned = 0;
+    while (pinned < EPOCH_SLOTS && (pins[pinned] = epochPin(cat)) >= 0) pinned++;
+    CHECK(pinned == EPOCH_SLOTS);
+    CHECK(epochPin(cat) == -1);
+
+    CHECK(libGetBook(cat, 7, &book) == LIB_OK && book.is_issued);
+    CHECK(libExportText(cat, "export.txt") == LIB_OK);
+    CHECK(libSearch(cat, "title", &results) == LIB_ERR_BUSY && results == NULL);
+    CHECK(libList(cat, FILTER_ALL, "title", &results) == LIB_ERR_BUSY);
+    CHECK(libDueSoon(cat, 5, &results) == LIB_ERR_BUSY);
+    CHECK(libPatronLoans(cat, "Reader", &results) == LIB_ERR_BUSY);
+    CHECK(libAddBook(cat, "While Busy", "Someone", "2-1", 2000, &book) == LIB_OK);
+
+    for (int i = 0; i < pinned; i++) epochUnpin(cat, pins[i]);
+    CHECK(libSearch(cat, "while busy", &results) == LIB_OK && libResultsCount(results) == 1);
+    libResultsFree(results);
+    CHECK(libPatronLoans(cat, "Reader", &results) == LIB_OK && libResultsCount(results) == 1);
+    libResultsFree(results);
+    libClose(cat);
+}
+
+// Circulation threads issue and return the first HOT_BOOKS books while
+// reader threads list by status and copy books. Every row a status listing
+// returns must match its filter, and no copy may mix two loans: the
+// borrower name carries the loan period, which must agree with the dates.
+#define HOT_BOOKS 64
+
+typedef struct {
+    LibCatalog* cat;
+    int books;
+    int stop;
+    int torn;
+    int misfiled;
+    int thread;
+} RaceJob;
+
+static void* circulationThread(void* arg) {
+    RaceJob* job = (RaceJob*)arg;
+    unsigned int state = 77u * (unsigned int)job->thread + 1;
+    char borrower[MAX_BORROWER_NAME];
+    LibBook book;
+    double fine;
+    while (!__atomic_load_n(&job->stop, __ATOMIC_RELAXED)) {
+        state = state * 1103515245u + 12345u;
+        int id = 1 + (int)((state >> 8) % (unsigned int)HOT_BOOKS);
+        int days = 1 + (int)((state >> 20) % 300);
+        if (libIssueBook(job->cat, id, format(borrower, sizeof(borrower), "Loan %d days", days), days,
+                         &book) != LIB_OK) {
+            libReturnBook(job->cat, id, &fine, &book);
+        }
+    }
+    return NULL;
+}
+
+static int consistentLoan(const LibBook* book) {
+    int days;
+    if (!book->is_issued) return 1;
+    return sscanf(book->issued_to, "Loan %d days", &days) == 1 &&
+           book->due_date - book->issue_date == (time_t)days * 24 * 60 * 60;
+}
+
+static void* listingThread(void* arg) {
+    RaceJob* job = (RaceJob*)arg;
+    for (int round = 0; round < 300; round++) {
+        StatusFilter filter = round % 2 ? FILTER_ISSUED : FILTER_AVAILABLE;
+        LibResults* results;
+        if (libList(job->cat, filter, round % 3 ? NULL : "title", &results) != LIB_OK) continue;
+        for (size_t i = 0; i < libResultsCount(results); i++) {
+            LibBook book;
+            libResultsGet(results, i, &book);
+            if (book.is_issued != (filter == FILTER_ISSUED)) __atomic_fetch_add(&job->misfiled, 1, __ATOMIC_RELAXED);
+            if (!consistentLoan(&book)) __atomic_fetch_add(&job->torn, 1, __ATOMIC_RELAXED);
+        }
+        libResultsFree(results);
+        for (int i = 0; i < 20 * HOT_BOOKS; i++) {
+            LibBook book;
+            if (libGetBook(job->cat, 1 + i % HOT_BOOKS, &book) == LIB_OK && !consistentLoan(&book)) {
+                __atomic_fetch_add(&job->torn, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void testConcurrentCirculation() {
+    enum { WRITERS = 4, READERS = 4 };
+    pthread_t writers[WRITERS], readers[READERS];
+    RaceJob jobs[WRITERS];
+    RaceJob shared;
+
+    libConfigureShards(4);
+    memset(&shared, 0, sizeof(shared));
+    shared.cat = libCreate();
+    shared.books = 2000;
+    addBooks(shared.cat, shared.books);
+    for (int i = 0; i < WRITERS; i++) {
+        jobs[i] = shared;
+        jobs[i].thread = i;
+    }
+    for (int i = 0; i < WRITERS; i++) pthread_create(&writers[i], NULL, circulationThread, &jobs[i]);
+    for (int i = 0; i < READERS; i++) pthread_create(&readers[i], NULL, listingThread, &shared);
+    for (int i = 0; i < READERS; i++) pthread_join(readers[i], NULL);
+    for (int i = 0; i < WRITERS; i++) __atomic_store_n(&jobs[i].stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < WRITERS; i++) pthread_join(writers[i], NULL);
+    CHECK(shared.misfiled == 0);
+    CHECK(shared.torn == 0);
+
+    // The live counters agree with a count of the books themselves
+    LibraryStats stats = libStatistics(shared.cat, time(NULL));
+    int issued = 0;
+    for (int id = 1; id <= shared.books; id++) {
+        LibBook book;
+        issued += libGetBook(shared.cat, id, &book) == LIB_OK && book.is_issued;
+    }
+    CHECK(stats.issued_books == issued && stats.available_books == shared.books - issued);
+    libClose(shared.cat);
+    libConfigureShards(CATALOG_SHARDS);
+}
+
+// How much of a result set's order a query promises: all of it, only the
+// due dates (equal due dates come in no particular order), or none
+typedef enum { EXACT_ORDER, DUE_ORDER, ANY_ORDER } RowOrder;
+
+static int compareBookIds(const void* a, const void* b) {
+    return compareInts(&((const LibBook*)a)->id, &((const LibBook*)b)->id);
+}
+
+// Every row of a result set, one formatted line each, for comparing the
+// answers of two catalogs; rows whose order is not promised are put in ID
+// order first. Consumes the results.
+static char* resultText(LibStatus status, LibResults* results, RowOrder order) {
+    ByteBuffer text = {NULL, 0, 0};
+    char line[512];
+    if (status != LIB_OK) return strdup("error");
+
+    size_t count = libResultsCount(results);
+    LibBook* rows = (LibBook*)malloc((count + 1) * sizeof(LibBook));
+    if (rows == NULL) {
+        libResultsFree(results);
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        libResultsGet(results, i, &rows[i]);
+        if (order == DUE_ORDER && i > 0 && rows[i].due_date < rows[i - 1].due_date) {
+            free(rows);
+            libResultsFree(results);
+            return strdup("out of due order");
+        }
+    }
+    libResultsFree(results);
+    if (order != EXACT_ORDER) qsort(rows, count, sizeof(LibBook), compareBookIds);
+
+    for (size_t i = 0; i < count; i++) {
+        int length = snprintf(line, sizeof(line), "%d|%s|%s|%s|%d|%d|%s|%ld\n", rows[i].id, rows[i].title,
+                              rows[i].author, rows[i].isbn, rows[i].year, rows[i].is_issued,
+                              rows[i].issued_to, (long)rows[i].due_date);
+        if (bufferReserve(&text, (size_t)length + 1)) bufferAppend(&text, line, (size_t)length);
+    }
+    free(rows);
+    if (bufferReserve(&text, 1)) text.data[text.length] = '\0';
+    return text.data;
+}
+
+// Whether two non-empty result sets hold the same rows; consumes both
+static int sameResults(LibStatus status_a, LibResults* a, LibStatus status_b, LibResults* b, RowOrder order) {
+    char* text_a = resultText(status_a, a, order);
+    char* text_b = resultText(status_b, b, order);
+    int same = text_a != NULL && text_b != NULL && strcmp(text_a, text_b) == 0 && text_a[0] != '\0';
+    free(text_a);
+    free(text_b);
+    return same;
+}
+
+// Lend a book with given dates, as the journal replay does
+static void issueAt(LibCatalog* cat, int id, const char* borrower, time_t issue_date, time_t due_date) {
+    Book* book = searchBook(cat, id);
+    if (book == NULL || book->is_issued) return;
+    CatalogShard* shard = shardFor(cat, id);
+    shardLock(shard);
+    catalogIssueBook(cat, book, borrower, issue_date, due_date);
+    shardUnlock(shard);
+}
+
+// The same changes applied to catalogs with 1 and 8 shards, large enough
+// for parallel scans, give the same answers to every query
+static void testShards() {
+    enum { BOOKS = PARALLEL_SCAN_MIN + 5000 };
+    LibCatalog* cats[2];
+    char title[MAX_STR], isbn[20];
+    LibBook book;
+    time_t now = time(NULL);
+
+    for (int c = 0; c < 2; c++) {
+        libConfigureShards(c == 0 ? 1 : 8);
+        cats[c] = libCreate();
+        CHECK(cats[c]->shard_count == (c == 0 ? 1 : 8));
+        addBooks(cats[c], BOOKS);
+        for (int id = 5; id <= BOOKS; id += 97) libRemoveBook(cats[c], id);
+        for (int n = 0; n < 50; n++) {
+            libAddBook(cats[c], format(title, sizeof(title), "Late book %d", n), "Churn",
+                       format(isbn, sizeof(isbn), "5-%d", n), 2001, &book);
+        }
+
+        // Loans on dates fixed up front, as libIssueBook reads the clock:
+        // current ones, a third of them returned, and some overdue
+        for (int id = 1; id <= BOOKS; id += 11) {
+            issueAt(cats[c], id, id % 13 == 0 ? "Late Reader" : "Reader", now - 86400,
+                    id % 3 == 0 ? now - (id % 30 + 1) * 86400 : now + (id % 30 + 1) * 86400);
+        }
+        for (int id = 1; id <= BOOKS; id += 33) {
+            Book* loan = searchBook(cats[c], id);
+            if (loan == NULL || !loan->is_issued) continue;
+            CatalogShard* shard = shardFor(cats[c], id);
+            shardLock(shard);
+            catalogReturnBook(cats[c], loan);
+            shardUnlock(shard);
+        }
+    }
+    libConfigureShards(CATALOG_SHARDS);
+
+    static const char* orders[] = {NULL, "title", "author", "year,title", "author,year,id"};
+    static const char* queries[] = {"title 1", "author 4", "978-12", "9", "e 7"};
+    LibResults *one, *eight;
+    LibStatus status_one, status_eight;
+    int mismatches = 0;
+    for (int filter = FILTER_ALL; filter <= FILTER_OVERDUE; filter++) {
+        for (size_t o = 0; o < sizeof(orders) / sizeof(orders[0]); o++) {
+            status_one = libList(cats[0], (StatusFilter)filter, orders[o], &one);
+            status_eight = libList(cats[1], (StatusFilter)filter, orders[o], &eight);
+            RowOrder promised = orders[o] == NULL && filter == FILTER_OVERDUE ? DUE_ORDER : EXACT_ORDER;
+            mismatches += !sameResults(status_one, one, status_eight, eight, promised);
+        }
+    }
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        status_one = libSearch(cats[0], queries[q], &one);
+        status_eight = libSearch(cats[1], queries[q], &eight);
+        mismatches += !sameResults(status_one, one, status_eight, eight, EXACT_ORDER);
+    }
+    // Every loan, so no tie on the last due date decides which rows make it
+    status_one = libDueSoon(cats[0], BOOKS, &one);
+    status_eight = libDueSoon(cats[1], BOOKS, &eight);
+    mismatches += !sameResults(status_one, one, status_eight, eight, DUE_ORDER);
+    status_one = libPatronLoans(cats[0], "Late Reader", &one);
+    status_eight = libPatronLoans(cats[1], "Late Reader", &eight);
+    mismatches += !sameResults(status_one, one, status_eight, eight, ANY_ORDER);
+    CHECK(mismatches == 0);
+
+    LibraryStats a = libStatistics(cats[0], now);
+    LibraryStats b = libStatistics(cats[1], now);
+    CHECK(a.total_books == b.total_books && a.issued_books == b.issued_books &&
+          a.available_books == b.available_books && a.overdue_books == b.overdue_books);
+    CHECK(a.overdue_books > 0 && a.total_fines > 0 && fabs(a.total_fines - b.total_fines) < 0.01);
+    libClose(cats[0]);
+    libClose(cats[1]);
+}
+
+// Books added while other threads list the catalog appear in catalog
+// order (ascending IDs here) in every listing
+typedef struct {
+    LibCatalog* cat;
+    int done;
+    int out_of_order;
+} AddJob;
+
+static void* addingThread(void* arg) {
+    AddJob* job = (AddJob*)arg;
+    char title[MAX_STR], isbn[20];
+    LibBook book;
+    for (int n = 0; n < 20000; n++) {
+        libAddBook(job->cat, format(title, sizeof(title), "Added %d", n), "Adder",
+                   format(isbn, sizeof(isbn), "3-%d", n), 2000, &book);
+    }
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Status listings and short searches scan the shards and merge them back
+// into catalog order; both see the books being added
+static void* orderCheckThread(void* arg) {
+    AddJob* job = (AddJob*)arg;
+    for (int round = 0; !__atomic_load_n(&job->done, __ATOMIC_ACQUIRE); round++) {
+        LibResults* results;
+        LibStatus status = round % 2 == 0 ? libList(job->cat, FILTER_AVAILABLE, NULL, &results) :
+                                            libSearch(job->cat, "dd", &results);
+        if (status != LIB_OK) continue;
+        int last = 0;
+        for (size_t i = 0; i < libResultsCount(results); i++) {
+            LibBook book;
+            libResultsGet(results, i, &book);
+            if (book.id <= last) __atomic_fetch_add(&job->out_of_order, 1, __ATOMIC_RELAXED);
+            last = book.id;
+        }
+        libResultsFree(results);
+    }
+    return NULL;
+}
+
+static void testConcurrentAdds() {
+    pthread_t adder, readers[3];
+    AddJob job = {NULL, 0, 0};
+
+    libConfigureShards(8);
+    job.cat = libCreate();
+    libConfigureShards(CATALOG_SHARDS);
+    pthread_create(&adder, NULL, addingThread, &job);
+    for (int i = 0; i < 3; i++) pthread_create(&readers[i], NULL, orderCheckThread, &job);
+    pthread_join(adder, NULL);
+    for (int i = 0; i < 3; i++) pthread_join(readers[i], NULL);
+    CHECK(job.out_of_order == 0);
+    CHECK(libBookCount(job.cat) == 20000);
+    libClose(job.cat);
+}
+
+// parallelFor runs every index exactly once, from plain threads and from
+// inside its own bodies
+#define POOL_OUTER 16
+#define POOL_INNER 20000
+
+typedef struct {
+    int* hits;
+    size_t count;
+    int oversized;      // ranges longer than the grain
+    size_t grain;
+} PoolCount;
+
+static void countHits(void* arg, size_t begin, size_t end) {
+    PoolCount* job = (PoolCount*)arg;
+    if (end - begin > job->grain) __atomic_fetch_add(&job->oversized, 1, __ATOMIC_RELAXED);
+    for (size_t i = begin; i < end; i++) __atomic_fetch_add(&job->hits[i], 1, __ATOMIC_RELAXED);
+}
+
+static void nestedFor(void* arg, size_t begin, size_t end) {
+    PoolCount* job = (PoolCount*)arg;
+    for (size_t outer = begin; outer < end; outer++) {
+        PoolCount inner = {job->hits + outer * POOL_INNER, POOL_INNER, 0, 64};
+        parallelFor(POOL_INNER, inner.grain, countHits, &inner);
+    }
+}
+
+static int hitOnce(const int* hits, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (hits[i] != 1) return 0;
+    }
+    return 1;
+}
+
+static void* concurrentFor(void* arg) {
+    PoolCount* job = (PoolCount*)arg;
+    parallelFor(job->count, job->grain, countHits, job);
+    return NULL;
+}
+
+// Each part lists its indices; merged in index order they must come out
+// as 0, 1, 2, ... with the sum of a serial run
+typedef struct {
+    size_t* items;
+    size_t count;
+    size_t capacity;
+    int failed;
+} IndexPart;
+
+static void listIndices(void* ctx, size_t begin, size_t end, void* partial) {
+    IndexPart* part = (IndexPart*)partial;
+    (void)ctx;
+    for (size_t i = begin; i < end && !part->failed; i++) {
+        if (part->count == part->capacity) {
+            size_t capacity = part->capacity ? part->capacity * 2 : 16;
+            size_t* grown = (size_t*)realloc(part->items, capacity * sizeof(size_t));
+            if (grown == NULL) {
+                part->failed = 1;
+                break;
+            }
+            part->items = grown;
+            part->capacity = capacity;
+        }
+        part->items[part->count++] = i;
+    }
+}
+
+static void mergeIndices(void* ctx, void* result, void* partial) {
+    IndexPart* all = (IndexPart*)result;
+    IndexPart* part = (IndexPart*)partial;
+    (void)ctx;
+    for (size_t i = 0; i < part->count; i++) {
+        listIndices(NULL, part->items[i], part->items[i] + 1, all);
+    }
+    all->failed |= part->failed;
+    free(part->items);
+}
+
+static int inOrder(const IndexPart* all, size_t count) {
+    if (all->failed || all->count != count) return 0;
+    for (size_t i = 0; i < count; i++) {
+        if (all->items[i] != i) return 0;
+    }
+    return 1;
+}
+
+static void testPool() {
+    enum { COUNT = 100003 };
+    int* hits = (int*)calloc(POOL_OUTER * POOL_INNER, sizeof(int));
+    CHECK(hits != NULL);
+    if (hits == NULL) return;
+    CHECK(poolThreads() >= 1);
+
+    PoolCount job = {hits, COUNT, 0, 7};
+    parallelFor(COUNT, job.grain, countHits, &job);
+    CHECK(hitOnce(hits, COUNT));
+    // Splitting goes depth first, far from filling a deque
+    CHECK(job.oversized == 0 || poolThreads() < 2);
+
+    // Nothing to run, and a count under the grain runs as one range
+    memset(hits, 0, COUNT * sizeof(int));
+    job.grain = 1000;
+    parallelFor(0, job.grain, countHits, &job);
+    parallelFor(999, job.grain, countHits, &job);
+    CHECK(hitOnce(hits, 999) && hits[999] == 0);
+
+    // Bodies that call parallelFor themselves
+    memset(hits, 0, POOL_OUTER * POOL_INNER * sizeof(int));
+    PoolCount outer = {hits, POOL_OUTER, 0, 1};
+    parallelFor(POOL_OUTER, 1, nestedFor, &outer);
+    CHECK(hitOnce(hits, POOL_OUTER * POOL_INNER));
+
+    // Several threads outside the pool share it at once
+    memset(hits, 0, POOL_OUTER * POOL_INNER * sizeof(int));
+    pthread_t callers[4];
+    PoolCount slices[4];
+    for (int i = 0; i < 4; i++) {
+        PoolCount slice = {hits + i * POOL_INNER, POOL_INNER, 0, 32};
+        slices[i] = slice;
+        pthread_create(&callers[i], NULL, concurrentFor, &slices[i]);
+    }
+    for (int i = 0; i < 4; i++) pthread_join(callers[i], NULL);
+    CHECK(hitOnce(hits, 4 * POOL_INNER));
+    free(hits);
+
+    // Uneven last part, a single part, and nothing at all
+    static const size_t counts[] = {COUNT, 500, 0};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        IndexPart all = {NULL, 0, 0, 0};
+        parallelReduce(counts[c], 1000, sizeof(IndexPart), listIndices, mergeIndices, NULL, &all);
+        CHECK(inOrder(&all, counts[c]));
+        free(all.items);
+    }
+}
+
+// Threads logging at once, with and without the writer thread, leave only
+// whole "[YYYY-MM-DD HH:MM:SS] LEVEL: message" lines in library.log
+#define LOG_THREADS 8
+#define LOG_LINES 3000
+
+// The n-th message of a logging thread; every 100th is too long and is
+// cut to LOG_LINE_MAX - 1 characters in the log
+static const char* logText(char* message, size_t size, int thread, int n) {
+    int length = snprintf(message, size, "worker %d line %d ", thread, n);
+    if (n % 100 == 0) {
+        memset(message + length, 'x', size - length - 1);
+        message[size - 1] = '\0';
+    }
+    return message;
+}
+
+static void* loggingThread(void* arg) {
+    int thread = (int)(intptr_t)arg;
+    char message[LOG_LINE_MAX + 100];
+    for (int n = 0; n < LOG_LINES; n++) {
+        log_message((LogLevel)(n % 3), logText(message, sizeof(message), thread, n));
+    }
+    return NULL;
+}
+
+// Threads formatting lines for different seconds each get their own
+// timestamp, as the writer thread and synchronous callers do
+typedef struct {
+    time_t when;
+    int wrong;
+} StampJob;
+
+static void* stampThread(void* arg) {
+    StampJob* job = (StampJob*)arg;
+    char expected[64], line[LOG_LINE_MAX + 64];
+    struct tm t;
+    localtime_r(&job->when, &t);
+    snprintf(expected, sizeof(expected), "[%04d-%02d-%02d %02d:%02d:%02d] ", t.tm_year + 1900,
+             t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    for (int n = 0; n < 200000; n++) {
+        // Alternate with the next second so the cache is refilled often
+        time_t when = job->when + (n & 1);
+        logFormat(line, LOG_INFO, when, "stamp");
+        if ((n & 1) == 0 && strncmp(line, expected, strlen(expected)) != 0) job->wrong++;
+    }
+    return NULL;
+}
+
+// ERROR lines logged while the log file is full
+#define LOG_ERROR_LINES 20
+
+typedef struct {
+    int done;
+    int stop;
+    long filler;        // INFO lines logged meanwhile, so no drain finds the ring empty
+} LogErrorJob;
+
+static void* errorLoggingThread(void* arg) {
+    LogErrorJob* job = (LogErrorJob*)arg;
+    for (int n = 0; n < LOG_ERROR_LINES; n++) log_message(LOG_ERROR, "log device full");
+    __atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void* fillerLoggingThread(void* arg) {
+    LogErrorJob* job = (LogErrorJob*)arg;
+    struct timespec pause = {0, 1000000};
+    while (!__atomic_load_n(&job->stop, __ATOMIC_ACQUIRE)) {
+        log_message(LOG_INFO, "log device full");
+        job->filler++;
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+static void logBurst() {
+    pthread_t threads[LOG_THREADS];
+    for (intptr_t i = 0; i < LOG_THREADS; i++) pthread_create(&threads[i], NULL, loggingThread, (void*)i);
+    for (int i = 0; i < LOG_THREADS; i++) pthread_join(threads[i], NULL);
+}
+
+// The message of a well-formed log line stamped within [from, until], or
+// NULL
+static const char* logLineMessage(const char* line, time_t from, time_t until) {
+    struct tm t;
+    int used = 0;
+    memset(&t, 0, sizeof(t));
+    if (sscanf(line, "[%4d-%2d-%2d %2d:%2d:%2d] %n", &t.tm_year, &t.tm_mon, &t.tm_mday,
+               &t.tm_hour, &t.tm_min, &t.tm_sec, &used) != 6 || used != 22) {
+        return NULL;
+    }
+    t.tm_year -= 1900;
+    t.tm_mon -= 1;
+    t.tm_isdst = -1;
+    time_t when = mktime(&t);
+    if (when < from || when > until) return NULL;
+
+    for (int level = LOG_INFO; level <= LOG_ERROR; level++) {
+        size_t length = strlen(log_level_names[level]);
+        if (strncmp(line + used, log_level_names[level], length) == 0 &&
+            strncmp(line + used + length, ": ", 2) == 0) {
+            return line + used + length + 2;
+        }
+    }
+    return NULL;
+}
+
+static void testLogLines() {
+    time_t from = time(NULL);
+    unlink(LOGFILE);
+    logConfigure(LOG_INFO, LOG_FLUSH_MS, 0);
+    logBurst();             // each caller writes its own lines
+    logOpen();
+    CHECK(logger.running);
+    logBurst();             // through the ring and the writer thread
+
+    // ERROR lines wait for the writer; a log that cannot be written must
+    // count them as dropped and let the callers go
+    logConfigure(LOG_INFO, LOG_FLUSH_MS, 1);
+    int log_fd = logger.fd;
+    int full = open("/dev/full", O_WRONLY);
+    CHECK(full >= 0);
+    pthread_t thread, filler;
+    LogErrorJob job = {0, 0, 0};
+    if (full >= 0) {
+        logger.fd = full;
+        pthread_create(&filler, NULL, fillerLoggingThread, &job);
+        pthread_create(&thread, NULL, errorLoggingThread, &job);
+        struct timespec pause = {0, 10000000};
+        for (int wait = 0; wait < 500 && !__atomic_load_n(&job.done, __ATOMIC_ACQUIRE); wait++) {
+            nanosleep(&pause, NULL);
+        }
+        CHECK(__atomic_load_n(&job.done, __ATOMIC_ACQUIRE));
+        __atomic_store_n(&job.stop, 1, __ATOMIC_RELEASE);
+        pthread_join(filler, NULL);
+        logger.fd = log_fd;
+        close(full);    // the old writer unblocks once the writes succeed again
+        pthread_join(thread, NULL);
+    }
+    logClose();
+    logConfigure(LOG_ERROR, LOG_FLUSH_MS, 1);
+    time_t until = time(NULL);
+
+    FILE* log = fopen(LOGFILE, "r");
+    CHECK(log != NULL);
+    if (log == NULL) return;
+
+    char line[LOG_LINE_MAX + 200], text[LOG_LINE_MAX];
+    char* seen = (char*)calloc(LOG_THREADS * LOG_LINES, 1);
+    long logged = 0, malformed = 0, dropped = 0, duplicates = 0;
+    while (fgets(line, sizeof(line), log) != NULL) {
+        size_t length = strlen(line);
+        const char* message = logLineMessage(line, from, until);
+        int thread, n, used = 0;
+        unsigned long count;
+        if (message == NULL || length == 0 || line[length - 1] != '\n' ||
+            strlen(message) > LOG_LINE_MAX) {
+            malformed++;
+        } else if (sscanf(message, "%lu log messages dropped%n", &count, &used) == 1 && used > 0) {
+            dropped += (long)count;
+        } else if (strcmp(message, "log device full\n") == 0) {
+            logged++;       // queued while the log was full, written after
+        } else if (sscanf(message, "worker %d line %d %n", &thread, &n, &used) == 2 && used > 0 &&
+                   thread >= 0 && thread < LOG_THREADS && n >= 0 && n < LOG_LINES &&
+                   strlen(message) == strlen(logText(text, LOG_LINE_MAX, thread, n)) + 1 &&
+                   strncmp(message, text, strlen(text)) == 0) {
+            // Both bursts log the same messages; count each at most twice
+            size_t key = (size_t)thread * LOG_LINES + (size_t)n;
+            logged++;
+            if (seen != NULL && seen[key] == 2) duplicates++;
+            if (seen != NULL && seen[key] < 2) seen[key]++;
+        } else {
+            malformed++;
+        }
+    }
+    fclose(log);
+    free(seen);
+
+    CHECK(malformed == 0);
+    CHECK(duplicates == 0);
+    CHECK(logged + dropped == 2 * LOG_THREADS * LOG_LINES + (full >= 0 ? LOG_ERROR_LINES + job.filler : 0));
+
+    pthread_t threads[4];
+    StampJob jobs[4];
+    for (int i = 0; i < 4; i++) {
+        jobs[i].when = from + 86400 * (i + 1) + 3600 * i;
+        jobs[i].wrong = 0;
+        pthread_create(&threads[i], NULL, stampThread, &jobs[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(jobs[i].wrong == 0);
+    }
+}
+
+int main() {
+    if (mkdtemp(scratch) == NULL || chdir(scratch) != 0) {
+        perror("scratch directory");
+        return 1;
+    }
+    alarm(300);     // a deadlock fails the run instead of hanging it
+
+    testIndexes();
+    testSearch();
+    testSearchKernels();
+    testSortOrders();
+    testSnapshotRoundTrip();
+    testJournal();
+    testImport();
+    testEpochReclamation();
+    testReaderSlotsExhausted();
+    testConcurrentCirculation();
+    testShards();
+    testConcurrentAdds();
+    testPool();
+    testLogLines();
+
+    removeScratch();
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures == 0 ? 0 : 1;
+}